@@ -0,0 +1,8 @@
+inline void EvolveValuesRK2_1_ens(const float *dT, float *midPointConservative, //OP_RW //temp
+            float *in, //OP_READ
+            float *inConservative, //OP_WRITE //temp
+            float *midPoint) //OP_WRITE
+{
+  for (int m = 0; m < VOLNA_ENSEMBLE; m++)
+    EvolveValuesRK2_1(dT, midPointConservative + 4*m, in + 4*m, inConservative + 4*m, midPoint + 4*m);
+}
@@ -0,0 +1,193 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+// user function
+
+__device__
+#include "EvolveValuesRK2_1_ens.h"
+
+
+// CUDA kernel function
+
+__global__ void op_cuda_EvolveValuesRK2_1_ens(
+  const float *arg0,
+  float *arg1,
+  float *arg2,
+  float *arg3,
+  float *arg4,
+  int   offset_s,
+  int   set_size ) {
+
+  float arg1_l[VOLNA_ENSEMBLE_DIM];
+  float arg2_l[VOLNA_ENSEMBLE_DIM];
+  float arg3_l[VOLNA_ENSEMBLE_DIM];
+  float arg4_l[VOLNA_ENSEMBLE_DIM];
+  int   tid = threadIdx.x%OP_WARPSIZE;
+
+  extern __shared__ char shared[];
+
+  char *arg_s = shared + offset_s*(threadIdx.x/OP_WARPSIZE);
+
+  // process set elements
+
+  for (int n=threadIdx.x+blockIdx.x*blockDim.x;
+       n<set_size; n+=blockDim.x*gridDim.x) {
+
+    int offset = n - tid;
+    int nelems = MIN(OP_WARPSIZE,set_size-offset);
+
+    // copy data into shared memory, then into local
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      ((float *)arg_s)[tid+m*nelems] = arg1[tid+m*nelems+offset*VOLNA_ENSEMBLE_DIM];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      arg1_l[m] = ((float *)arg_s)[m+tid*VOLNA_ENSEMBLE_DIM];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      ((float *)arg_s)[tid+m*nelems] = arg2[tid+m*nelems+offset*VOLNA_ENSEMBLE_DIM];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      arg2_l[m] = ((float *)arg_s)[m+tid*VOLNA_ENSEMBLE_DIM];
+
+
+    // user-supplied kernel call
+
+
+    EvolveValuesRK2_1_ens(  arg0,
+                            arg1_l,
+                            arg2_l,
+                            arg3_l,
+                            arg4_l );
+
+    // copy back into shared memory, then to device
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      ((float *)arg_s)[m+tid*VOLNA_ENSEMBLE_DIM] = arg1_l[m];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      arg1[tid+m*nelems+offset*VOLNA_ENSEMBLE_DIM] = ((float *)arg_s)[tid+m*nelems];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      ((float *)arg_s)[m+tid*VOLNA_ENSEMBLE_DIM] = arg3_l[m];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      arg3[tid+m*nelems+offset*VOLNA_ENSEMBLE_DIM] = ((float *)arg_s)[tid+m*nelems];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      ((float *)arg_s)[m+tid*VOLNA_ENSEMBLE_DIM] = arg4_l[m];
+
+    for (int m=0; m<VOLNA_ENSEMBLE_DIM; m++)
+      arg4[tid+m*nelems+offset*VOLNA_ENSEMBLE_DIM] = ((float *)arg_s)[tid+m*nelems];
+
+  }
+}
+
+
+// host stub function
+
+void op_par_loop_EvolveValuesRK2_1_ens(char const *name, op_set set,
+  op_arg arg0,
+  op_arg arg1,
+  op_arg arg2,
+  op_arg arg3,
+  op_arg arg4 ){
+
+  float *arg0h = (float *)arg0.data;
+
+  int    nargs   = 5;
+  op_arg args[5];
+
+  args[0] = arg0;
+  args[1] = arg1;
+  args[2] = arg2;
+  args[3] = arg3;
+  args[4] = arg4;
+
+  if (OP_diags>2) {
+    printf(" kernel routine w/o indirection:  EvolveValuesRK2_1_ens\n");
+  }
+
+  VOLNA_TRACE_BEGIN(halo_t1);
+  op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
+
+  // initialise timers
+
+  double cpu_t1, cpu_t2, wall_t1=0, wall_t2=0;
+  op_timing_realloc(25);
+  OP_kernels[25].name      = name;
+  OP_kernels[25].count    += 1;
+
+  if (set->size >0) {
+
+    op_timers_core(&cpu_t1, &wall_t1);
+
+    // transfer constants to GPU
+
+    int consts_bytes = 0;
+    consts_bytes += ROUND_UP(1*sizeof(float));
+
+    reallocConstArrays(consts_bytes);
+
+    consts_bytes = 0;
+    arg0.data   = OP_consts_h + consts_bytes;
+    arg0.data_d = OP_consts_d + consts_bytes;
+    for (int d=0; d<1; d++) ((float *)arg0.data)[d] = arg0h[d];
+    consts_bytes += ROUND_UP(1*sizeof(float));
+
+    mvConstArraysToDevice(consts_bytes);
+
+    // set CUDA execution parameters
+
+    #ifdef OP_BLOCK_SIZE_25
+      int nthread = OP_BLOCK_SIZE_25;
+    #else
+      // int nthread = OP_block_size;
+      int nthread = 128;
+    #endif
+
+    int nblocks = 200;
+
+    // work out shared memory requirements per element
+
+    int nshared = 0;
+    nshared = MAX(nshared,sizeof(float)*VOLNA_ENSEMBLE_DIM);
+    nshared = MAX(nshared,sizeof(float)*VOLNA_ENSEMBLE_DIM);
+    nshared = MAX(nshared,sizeof(float)*VOLNA_ENSEMBLE_DIM);
+    nshared = MAX(nshared,sizeof(float)*VOLNA_ENSEMBLE_DIM);
+
+    // execute plan
+
+    int offset_s = nshared*OP_WARPSIZE;
+
+    nshared = nshared*nthread;
+
+    op_cuda_EvolveValuesRK2_1_ens<<<nblocks,nthread,nshared>>>( (float *) arg0.data_d,
+                                                                (float *) arg1.data_d,
+                                                                (float *) arg2.data_d,
+                                                                (float *) arg3.data_d,
+                                                                (float *) arg4.data_d,
+                                                                offset_s,
+                                                                set->size );
+
+    cutilSafeCall(cudaThreadSynchronize());
+    cutilCheckMsg("op_cuda_EvolveValuesRK2_1_ens execution failed\n");
+
+  }
+
+
+  op_mpi_set_dirtybit(nargs, args);
+
+  // update kernel record
+
+  op_timers_core(&cpu_t2, &wall_t2);
+  OP_kernels[25].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  OP_kernels[25].transfer += (float)set->size * arg1.size * 2.0f;
+  OP_kernels[25].transfer += (float)set->size * arg2.size;
+  OP_kernels[25].transfer += (float)set->size * arg3.size;
+  OP_kernels[25].transfer += (float)set->size * arg4.size;
+}
+
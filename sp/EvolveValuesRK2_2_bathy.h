@@ -0,0 +1,24 @@
+inline void EvolveValuesRK2_2_bathy(const float *dT, float *outConservative, //OP_RW, discard
+            float *inConservative, //OP_READ, discard
+            float *midPointConservative, //OP_READ, discard
+            float *out, //OP_WRITE
+            const float *frames, //OP_READ, bathymetry frames k-1, k, k+1, k+2
+            const float *weights) //OP_READ, interpolation weights of the frames
+
+{
+  outConservative[0] = 0.5*(outConservative[0] * *dT + midPointConservative[0] + inConservative[0]);
+  outConservative[1] = 0.5*(outConservative[1] * *dT + midPointConservative[1] + inConservative[1]);
+  outConservative[2] = 0.5*(outConservative[2] * *dT + midPointConservative[2] + inConservative[2]);
+
+  outConservative[0] = outConservative[0] <= EPS ? EPS : outConservative[0];
+  //Zb of the next step, interpolated in time between the bathymetry frames
+  outConservative[3] = weights[0] * frames[0] + weights[1] * frames[1]
+                     + weights[2] * frames[2] + weights[3] * frames[3];
+
+  //call to ToPhysicalVariables inlined
+  float TruncatedH = outConservative[0] < EPS ? EPS : outConservative[0];
+  out[0] = outConservative[0];
+  out[1] = outConservative[1] / TruncatedH;
+  out[2] = outConservative[2] / TruncatedH;
+  out[3] = outConservative[3];
+}
@@ -0,0 +1,9 @@
+inline void EvolveValuesRK2_2_ens(const float *dT, float *outConservative, //OP_RW, discard
+            float *inConservative, //OP_READ, discard
+            float *midPointConservative, //OP_READ, discard
+            float *out) //OP_WRITE
+
+{
+  for (int m = 0; m < VOLNA_ENSEMBLE; m++)
+    EvolveValuesRK2_2(dT, outConservative + 4*m, inConservative + 4*m, midPointConservative + 4*m, out + 4*m);
+}
@@ -58,7 +58,9 @@ void op_par_loop_EvolveValuesRK2_2(char const *name, op_set set,
     printf(" kernel routine w/o indirection:  EvolveValuesRK2_2\n");
   }
 
+  VOLNA_TRACE_BEGIN(halo_t1);
   op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -70,7 +72,7 @@ void op_par_loop_EvolveValuesRK2_2(char const *name, op_set set,
   // set number of threads
 
 #ifdef _OPENMP
-  int nthreads = omp_get_max_threads( );
+  int nthreads = volna_tune_begin("EvolveValuesRK2_2", 1, NULL);
 #else
   int nthreads = 1;
 #endif
@@ -81,7 +83,7 @@ void op_par_loop_EvolveValuesRK2_2(char const *name, op_set set,
 
   // execute plan
 
-#pragma omp parallel for
+#pragma omp parallel for num_threads(nthreads)
   for (int thr=0; thr<nthreads; thr++) {
     int start  = (set->size* thr   )/nthreads;
     int finish = (set->size*(thr+1))/nthreads;
@@ -104,6 +106,8 @@ void op_par_loop_EvolveValuesRK2_2(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[1].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  volna_tune_end(1, wall_t2 - wall_t1);
   OP_kernels[1].transfer += (float)set->size * arg1.size * 2.0f;
   OP_kernels[1].transfer += (float)set->size * arg2.size;
   OP_kernels[1].transfer += (float)set->size * arg3.size;
@@ -0,0 +1,7 @@
+inline void NumericalFluxes_ens(float **maxEdgeEigenvalues, float **EdgeVolumes, float *cellVolumes, //OP_READ
+            float *zeroInit, float *minTimeStep ) //OP_MIN
+{
+  NumericalFluxes(maxEdgeEigenvalues, EdgeVolumes, cellVolumes, zeroInit, minTimeStep);
+  for (int j = 4; j < VOLNA_ENSEMBLE_DIM; j++)
+    zeroInit[j] = 0.0f;
+}
@@ -0,0 +1,271 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+// user function
+
+__device__
+#include "NumericalFluxes_ens.h"
+
+
+// CUDA kernel function
+
+__global__ void op_cuda_NumericalFluxes_ens(
+  float *ind_arg0,
+  float *ind_arg1,
+  int   *ind_map,
+  short *arg_map,
+  float *arg6,
+  float *arg7,
+  float *arg8,
+  int   *ind_arg_sizes,
+  int   *ind_arg_offs,
+  int    block_offset,
+  int   *blkmap,
+  int   *offset,
+  int   *nelems,
+  int   *ncolors,
+  int   *colors,
+  int   nblocks,
+  int   set_size) {
+
+  float arg8_l[1];
+  for (int d=0; d<1; d++) arg8_l[d]=arg8[d+blockIdx.x*1];
+  float *arg0_vec[3];
+  float *arg1_vec[3];
+
+  __shared__ int   *ind_arg0_map, ind_arg0_size;
+  __shared__ int   *ind_arg1_map, ind_arg1_size;
+  __shared__ float *ind_arg0_s;
+  __shared__ float *ind_arg1_s;
+  __shared__ int    nelem, offset_b;
+
+  extern __shared__ char shared[];
+
+  if (blockIdx.x+blockIdx.y*gridDim.x >= nblocks) return;
+  if (threadIdx.x==0) {
+
+    // get sizes and shift pointers and direct-mapped data
+
+    int blockId = blkmap[blockIdx.x + blockIdx.y*gridDim.x  + block_offset];
+
+    nelem    = nelems[blockId];
+    offset_b = offset[blockId];
+
+    ind_arg0_size = ind_arg_sizes[0+blockId*2];
+    ind_arg1_size = ind_arg_sizes[1+blockId*2];
+
+    ind_arg0_map = &ind_map[0*set_size] + ind_arg_offs[0+blockId*2];
+    ind_arg1_map = &ind_map[3*set_size] + ind_arg_offs[1+blockId*2];
+
+    // set shared memory pointers
+
+    int nbytes = 0;
+    ind_arg0_s = (float *) &shared[nbytes];
+    nbytes    += ROUND_UP(ind_arg0_size*sizeof(float)*1);
+    ind_arg1_s = (float *) &shared[nbytes];
+  }
+
+  __syncthreads(); // make sure all of above completed
+
+  // copy indirect datasets into shared memory or zero increment
+
+  for (int n=threadIdx.x; n<ind_arg0_size*1; n+=blockDim.x)
+    ind_arg0_s[n] = ind_arg0[n%1+ind_arg0_map[n/1]*1];
+
+  for (int n=threadIdx.x; n<ind_arg1_size*1; n+=blockDim.x)
+    ind_arg1_s[n] = ind_arg1[n%1+ind_arg1_map[n/1]*1];
+
+  __syncthreads();
+
+  // process set elements
+
+  for (int n=threadIdx.x; n<nelem; n+=blockDim.x) {
+
+      arg0_vec[0] = ind_arg0_s+arg_map[0*set_size+n+offset_b]*1;
+      arg0_vec[1] = ind_arg0_s+arg_map[1*set_size+n+offset_b]*1;
+      arg0_vec[2] = ind_arg0_s+arg_map[2*set_size+n+offset_b]*1;
+
+      arg1_vec[0] = ind_arg1_s+arg_map[3*set_size+n+offset_b]*1;
+      arg1_vec[1] = ind_arg1_s+arg_map[4*set_size+n+offset_b]*1;
+      arg1_vec[2] = ind_arg1_s+arg_map[5*set_size+n+offset_b]*1;
+
+      // user-supplied kernel call
+
+
+      NumericalFluxes_ens(  arg0_vec,
+                            arg1_vec,
+                            arg6+(n+offset_b)*1,
+                            arg7+(n+offset_b)*VOLNA_ENSEMBLE_DIM,
+                            arg8_l );
+  }
+
+
+  // global reductions
+
+  for(int d=0; d<1; d++)
+    op_reduction<OP_MIN>(&arg8[d+blockIdx.x*1],arg8_l[d]);
+}
+
+
+// host stub function
+
+void op_par_loop_NumericalFluxes_ens(char const *name, op_set set,
+  op_arg arg0,
+  op_arg arg3,
+  op_arg arg6,
+  op_arg arg7,
+  op_arg arg8 ){
+
+  float *arg8h = (float *)arg8.data;
+
+  int    nargs   = 9;
+  op_arg args[9];
+
+  arg0.idx = 0;
+  args[0] = arg0;
+  for (int v = 1; v < 3; v++) {
+    args[0 + v] = op_arg_dat(arg0.dat, v, arg0.map, 1, "float", OP_READ);
+  }
+  arg3.idx = 0;
+  args[3] = arg3;
+  for (int v = 1; v < 3; v++) {
+    args[3 + v] = op_arg_dat(arg3.dat, v, arg3.map, 1, "float", OP_READ);
+  }
+  args[6] = arg6;
+  args[7] = arg7;
+  args[8] = arg8;
+
+  int    ninds   = 2;
+  int    inds[9] = {0,0,0,1,1,1,-1,-1,-1};
+
+  if (OP_diags>2) {
+    printf(" kernel routine with indirection: NumericalFluxes_ens\n");
+  }
+
+  // get plan
+
+  #ifdef OP_PART_SIZE_23
+    int part_size = OP_PART_SIZE_23;
+  #else
+    int part_size = OP_part_size;
+  #endif
+
+  VOLNA_TRACE_BEGIN(halo_t1);
+  int set_size = op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
+
+  // initialise timers
+
+  double cpu_t1, cpu_t2, wall_t1=0, wall_t2=0;
+  op_timing_realloc(23);
+  OP_kernels[23].name      = name;
+  OP_kernels[23].count    += 1;
+
+  if (set->size >0) {
+
+    op_plan *Plan = op_plan_get(name,set,part_size,nargs,args,ninds,inds);
+
+    op_timers_core(&cpu_t1, &wall_t1);
+
+    // transfer global reduction data to GPU
+
+    int maxblocks = 0;
+    for (int col=0; col < Plan->ncolors; col++)
+      maxblocks = MAX(maxblocks,Plan->ncolblk[col]);
+
+    int reduct_bytes = 0;
+    int reduct_size  = 0;
+    reduct_bytes += ROUND_UP(maxblocks*1*sizeof(float));
+    reduct_size   = MAX(reduct_size,sizeof(float));
+
+    reallocReductArrays(reduct_bytes);
+
+    reduct_bytes = 0;
+    arg8.data   = OP_reduct_h + reduct_bytes;
+    arg8.data_d = OP_reduct_d + reduct_bytes;
+    for (int b=0; b<maxblocks; b++)
+      for (int d=0; d<1; d++)
+        ((float *)arg8.data)[d+b*1] = arg8h[d];
+    reduct_bytes += ROUND_UP(maxblocks*1*sizeof(float));
+
+    mvReductArraysToDevice(reduct_bytes);
+
+    // execute plan
+
+    int block_offset = 0;
+
+    for (int col=0; col < Plan->ncolors; col++) {
+
+      if (col==Plan->ncolors_core) {
+        VOLNA_TRACE_BEGIN(wait_t1);
+        op_mpi_wait_all(nargs,args);
+        VOLNA_TRACE_END(wait_t1, name, "mpi wait");
+      }
+
+    #ifdef OP_BLOCK_SIZE_23
+      int nthread = OP_BLOCK_SIZE_23;
+    #else
+      int nthread = OP_block_size;
+    #endif
+
+      dim3 nblocks = dim3(Plan->ncolblk[col] >= (1<<16) ? 65535 : Plan->ncolblk[col],
+                      Plan->ncolblk[col] >= (1<<16) ? (Plan->ncolblk[col]-1)/65535+1: 1, 1);
+      if (Plan->ncolblk[col] > 0) {
+        int nshared = MAX(Plan->nshared,reduct_size*nthread);
+        op_cuda_NumericalFluxes_ens<<<nblocks,nthread,nshared>>>(
+           (float *)arg0.data_d,
+           (float *)arg3.data_d,
+           Plan->ind_map,
+           Plan->loc_map,
+           (float *)arg6.data_d,
+           (float *)arg7.data_d,
+           (float *)arg8.data_d,
+           Plan->ind_sizes,
+           Plan->ind_offs,
+           block_offset,
+           Plan->blkmap,
+           Plan->offset,
+           Plan->nelems,
+           Plan->nthrcol,
+           Plan->thrcol,
+           Plan->ncolblk[col],
+           set_size);
+
+        cutilSafeCall(cudaThreadSynchronize());
+        cutilCheckMsg("op_cuda_NumericalFluxes_ens execution failed\n");
+
+        // transfer global reduction data back to CPU
+
+        if (col == Plan->ncolors_owned - 1)
+
+          mvReductArraysToHost(reduct_bytes);
+
+      }
+
+      block_offset += Plan->ncolblk[col];
+    }
+
+    op_timing_realloc(23);
+    OP_kernels[23].transfer  += Plan->transfer;
+    OP_kernels[23].transfer2 += Plan->transfer2;
+    for (int b=0; b<maxblocks; b++)
+      for (int d=0; d<1; d++)
+        arg8h[d] = MIN(arg8h[d],((float *)arg8.data)[d+b*1]);
+
+  arg8.data = (char *)arg8h;
+
+  op_mpi_reduce(&arg8,arg8h);
+
+  }
+
+
+  op_mpi_set_dirtybit(nargs, args);
+
+  // update kernel record
+
+  op_timers_core(&cpu_t2, &wall_t2);
+  OP_kernels[23].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+}
+
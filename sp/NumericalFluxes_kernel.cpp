@@ -97,6 +97,52 @@ void op_x86_NumericalFluxes(
 }
 
 
+#ifdef VOLNA_NATIVE_OMP
+
+// x86 kernel function indexing the global arrays through the map
+
+void op_x86_NumericalFluxes_native(
+  int    blockIdx,
+  float *ind_arg0,
+  float *ind_arg1,
+  int   *arg0_map,
+  float *arg6,
+  float *arg7,
+  float *arg8,
+  int    block_offset,
+  int   *blkmap,
+  int   *offset,
+  int   *nelems) {
+
+  float *arg0_vec[3];
+  float *arg1_vec[3];
+
+  int blockId = blkmap[blockIdx + block_offset];
+  int start   = offset[blockId];
+  int finish  = start + nelems[blockId];
+
+  // process set elements
+
+  for (int n=start; n<finish; n++) {
+
+    arg0_vec[0] = ind_arg0+arg0_map[3*n+0]*1;
+    arg0_vec[1] = ind_arg0+arg0_map[3*n+1]*1;
+    arg0_vec[2] = ind_arg0+arg0_map[3*n+2]*1;
+
+    arg1_vec[0] = ind_arg1+arg0_map[3*n+0]*1;
+    arg1_vec[1] = ind_arg1+arg0_map[3*n+1]*1;
+    arg1_vec[2] = ind_arg1+arg0_map[3*n+2]*1;
+
+    NumericalFluxes(  arg0_vec,
+                      arg1_vec,
+                      arg6+n*1,
+                      arg7+n*4,
+                      arg8 );
+  }
+}
+#endif
+
+
 // host stub function
 
 void op_par_loop_NumericalFluxes(char const *name, op_set set,
@@ -140,7 +186,9 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
     int part_size = OP_part_size;
   #endif
 
+  VOLNA_TRACE_BEGIN(halo_t1);
   int set_size = op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -152,7 +200,7 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
   // set number of threads
 
 #ifdef _OPENMP
-  int nthreads = omp_get_max_threads( );
+  int nthreads = volna_tune_begin("NumericalFluxes", 17, &part_size);
 #else
   int nthreads = 1;
 #endif
@@ -174,12 +222,31 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
     int block_offset = 0;
 
     for (int col=0; col < Plan->ncolors; col++) {
-      if (col==Plan->ncolors_core) op_mpi_wait_all(nargs, args);
+      if (col==Plan->ncolors_core) {
+        VOLNA_TRACE_BEGIN(wait_t1);
+        op_mpi_wait_all(nargs, args);
+        VOLNA_TRACE_END(wait_t1, name, "mpi wait");
+      }
 
       int nblocks = Plan->ncolblk[col];
 
-#pragma omp parallel for
+#pragma omp parallel for num_threads(nthreads)
       for (int blockIdx=0; blockIdx<nblocks; blockIdx++)
+#ifdef VOLNA_NATIVE_OMP
+      if (volna_native_omp)
+      op_x86_NumericalFluxes_native( blockIdx,
+         (float *)arg0.data,
+         (float *)arg3.data,
+         arg0.map_data,
+         (float *)arg6.data,
+         (float *)arg7.data,
+         &arg8_l[64*omp_get_thread_num()],
+         block_offset,
+         Plan->blkmap,
+         Plan->offset,
+         Plan->nelems);
+      else
+#endif
       op_x86_NumericalFluxes( blockIdx,
          (float *)arg0.data,
          (float *)arg3.data,
@@ -225,5 +292,7 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[17].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  volna_tune_end(17, wall_t2 - wall_t1);
 }
 
@@ -151,7 +151,9 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
     int part_size = OP_part_size;
   #endif
 
+  VOLNA_TRACE_BEGIN(halo_t1);
   int set_size = op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -195,7 +197,11 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
 
     for (int col=0; col < Plan->ncolors; col++) {
 
-      if (col==Plan->ncolors_core) op_mpi_wait_all(nargs,args);
+      if (col==Plan->ncolors_core) {
+        VOLNA_TRACE_BEGIN(wait_t1);
+        op_mpi_wait_all(nargs,args);
+        VOLNA_TRACE_END(wait_t1, name, "mpi wait");
+      }
 
     #ifdef OP_BLOCK_SIZE_17
       int nthread = OP_BLOCK_SIZE_17;
@@ -260,5 +266,6 @@ void op_par_loop_NumericalFluxes(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[17].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
 }
 
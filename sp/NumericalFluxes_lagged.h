@@ -0,0 +1,17 @@
+//NumericalFluxes without the global minTimeStep reduction, the stable
+//step of each cell is kept for the lagged time step (dtLag=)
+inline void NumericalFluxes_lagged(float **maxEdgeEigenvalues, float **EdgeVolumes, float *cellVolumes, //OP_READ
+            float *zeroInit, //OP_WRITE
+            float *localDt) //OP_WRITE
+{
+  float local = 0.0f;
+  for (int j = 0; j < 3; j++) {
+    local += *maxEdgeEigenvalues[j] * *(EdgeVolumes[j]);
+  }
+  zeroInit[0] = 0.0f;
+  zeroInit[1] = 0.0f;
+  zeroInit[2] = 0.0f;
+  zeroInit[3] = 0.0f;
+
+  *localDt = 2.0f * *cellVolumes / local;
+}
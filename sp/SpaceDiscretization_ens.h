@@ -0,0 +1,11 @@
+inline void SpaceDiscretization_ens(float *left, //OP_INC
+              float *right, //OP_INC
+              float *edgeFluxes, //OP_READ
+              float *bathySource, //OP_READ
+              float *edgeNormals, int *isRightBoundary, float **cellVolumes //OP_READ
+)
+{
+  for (int m = 0; m < VOLNA_ENSEMBLE; m++)
+    SpaceDiscretization(left + 4*m, right + 4*m, edgeFluxes + 3*m, bathySource + 2*m,
+                        edgeNormals, isRightBoundary, cellVolumes);
+}
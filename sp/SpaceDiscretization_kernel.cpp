@@ -120,6 +120,50 @@ void op_x86_SpaceDiscretization(
 }
 
 
+#ifdef VOLNA_NATIVE_OMP
+
+// x86 kernel function indexing the global arrays through the map, blocks
+// of the same colour never increment the same cell
+
+void op_x86_SpaceDiscretization_native(
+  int    blockIdx,
+  float *ind_arg0,
+  float *ind_arg1,
+  int   *arg0_map,
+  float *arg2,
+  float *arg3,
+  float *arg4,
+  int *arg5,
+  int    block_offset,
+  int   *blkmap,
+  int   *offset,
+  int   *nelems) {
+
+  float *arg1_vec[2];
+
+  int blockId = blkmap[blockIdx + block_offset];
+  int start   = offset[blockId];
+  int finish  = start + nelems[blockId];
+
+  // process set elements
+
+  for (int n=start; n<finish; n++) {
+
+    arg1_vec[0] = ind_arg1+arg0_map[2*n+0]*1;
+    arg1_vec[1] = ind_arg1+arg0_map[2*n+1]*1;
+
+    SpaceDiscretization(  ind_arg0+arg0_map[2*n+0]*4,
+                          ind_arg0+arg0_map[2*n+1]*4,
+                          arg2+n*3,
+                          arg3+n*2,
+                          arg4+n*2,
+                          arg5+n*1,
+                          arg1_vec);
+  }
+}
+#endif
+
+
 // host stub function
 
 void op_par_loop_SpaceDiscretization(char const *name, op_set set,
@@ -162,7 +206,17 @@ void op_par_loop_SpaceDiscretization(char const *name, op_set set,
     int part_size = OP_part_size;
   #endif
 
+  // set number of threads
+
+#ifdef _OPENMP
+  int nthreads = volna_tune_begin("SpaceDiscretization", 18, &part_size);
+#else
+  int nthreads = 1;
+#endif
+
+  VOLNA_TRACE_BEGIN(halo_t1);
   int set_size = op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -182,12 +236,32 @@ void op_par_loop_SpaceDiscretization(char const *name, op_set set,
     int block_offset = 0;
 
     for (int col=0; col < Plan->ncolors; col++) {
-      if (col==Plan->ncolors_core) op_mpi_wait_all(nargs, args);
+      if (col==Plan->ncolors_core) {
+        VOLNA_TRACE_BEGIN(wait_t1);
+        op_mpi_wait_all(nargs, args);
+        VOLNA_TRACE_END(wait_t1, name, "mpi wait");
+      }
 
       int nblocks = Plan->ncolblk[col];
 
-#pragma omp parallel for
+#pragma omp parallel for num_threads(nthreads)
       for (int blockIdx=0; blockIdx<nblocks; blockIdx++)
+#ifdef VOLNA_NATIVE_OMP
+      if (volna_native_omp)
+      op_x86_SpaceDiscretization_native( blockIdx,
+         (float *)arg0.data,
+         (float *)arg6.data,
+         arg0.map_data,
+         (float *)arg2.data,
+         (float *)arg3.data,
+         (float *)arg4.data,
+         (int *)arg5.data,
+         block_offset,
+         Plan->blkmap,
+         Plan->offset,
+         Plan->nelems);
+      else
+#endif
       op_x86_SpaceDiscretization( blockIdx,
          (float *)arg0.data,
          (float *)arg6.data,
@@ -225,5 +299,7 @@ void op_par_loop_SpaceDiscretization(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[18].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  volna_tune_end(18, wall_t2 - wall_t1);
 }
 
@@ -0,0 +1,18 @@
+//computeFluxes for every member of an ensemble, the edge geometry is read once
+//for all of them. maxEdgeEigenvalues is the maximum over the members, so
+//the time step is the smallest one of the ensemble
+inline void computeFluxes_ens(float *cellLeft, float *cellRight,
+                                float *edgeLength, float *edgeNormals,
+                                int *isRightBoundary, //OP_READ
+                                float *bathySource, float *out, //OP_WRITE
+                                float *maxEdgeEigenvalues) //OP_WRITE
+{
+  float maximum = 0.0f;
+  for (int m = 0; m < VOLNA_ENSEMBLE; m++) {
+    float eigenvalue;
+    computeFluxes(cellLeft + 4*m, cellRight + 4*m, edgeLength, edgeNormals, isRightBoundary,
+                  bathySource + 2*m, out + 3*m, &eigenvalue);
+    maximum = maximum > eigenvalue ? maximum : eigenvalue;
+  }
+  *maxEdgeEigenvalues = maximum;
+}
@@ -83,6 +83,47 @@ void op_x86_computeFluxes(
 }
 
 
+#ifdef VOLNA_NATIVE_OMP
+
+// x86 kernel function indexing the global arrays through the map
+
+void op_x86_computeFluxes_native(
+  int    blockIdx,
+  float *ind_arg0,
+  int   *arg0_map,
+  float *arg2,
+  float *arg3,
+  int *arg4,
+  float *arg5,
+  float *arg6,
+  float *arg7,
+  int    block_offset,
+  int   *blkmap,
+  int   *offset,
+  int   *nelems) {
+
+  int blockId = blkmap[blockIdx + block_offset];
+  int start   = offset[blockId];
+  int finish  = start + nelems[blockId];
+
+  // process set elements, the cells are only read
+
+#pragma omp simd
+  for (int n=start; n<finish; n++) {
+
+    computeFluxes(  ind_arg0+arg0_map[2*n+0]*4,
+                    ind_arg0+arg0_map[2*n+1]*4,
+                    arg2+n*1,
+                    arg3+n*2,
+                    arg4+n*1,
+                    arg5+n*2,
+                    arg6+n*3,
+                    arg7+n*1 );
+  }
+}
+#endif
+
+
 // host stub function
 
 void op_par_loop_computeFluxes(char const *name, op_set set,
@@ -123,7 +164,17 @@ void op_par_loop_computeFluxes(char const *name, op_set set,
     int part_size = OP_part_size;
   #endif
 
+  // set number of threads
+
+#ifdef _OPENMP
+  int nthreads = volna_tune_begin("computeFluxes", 16, &part_size);
+#else
+  int nthreads = 1;
+#endif
+
+  VOLNA_TRACE_BEGIN(halo_t1);
   int set_size = op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -143,12 +194,33 @@ void op_par_loop_computeFluxes(char const *name, op_set set,
     int block_offset = 0;
 
     for (int col=0; col < Plan->ncolors; col++) {
-      if (col==Plan->ncolors_core) op_mpi_wait_all(nargs, args);
+      if (col==Plan->ncolors_core) {
+        VOLNA_TRACE_BEGIN(wait_t1);
+        op_mpi_wait_all(nargs, args);
+        VOLNA_TRACE_END(wait_t1, name, "mpi wait");
+      }
 
       int nblocks = Plan->ncolblk[col];
 
-#pragma omp parallel for
+#pragma omp parallel for num_threads(nthreads)
       for (int blockIdx=0; blockIdx<nblocks; blockIdx++)
+#ifdef VOLNA_NATIVE_OMP
+      if (volna_native_omp)
+      op_x86_computeFluxes_native( blockIdx,
+         (float *)arg0.data,
+         arg0.map_data,
+         (float *)arg2.data,
+         (float *)arg3.data,
+         (int *)arg4.data,
+         (float *)arg5.data,
+         (float *)arg6.data,
+         (float *)arg7.data,
+         block_offset,
+         Plan->blkmap,
+         Plan->offset,
+         Plan->nelems);
+      else
+#endif
       op_x86_computeFluxes( blockIdx,
          (float *)arg0.data,
          Plan->ind_map,
@@ -187,5 +259,7 @@ void op_par_loop_computeFluxes(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[16].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  volna_tune_end(16, wall_t2 - wall_t1);
 }
 
@@ -0,0 +1,41 @@
+//computeFluxes with the deep water edges (edgeSpeed > 0, see initLinearEdges)
+//handled by a Rusanov flux whose wave speed sqrt(g*h0) was computed from the
+//still water depth once, so they skip the wet/dry treatment and the square
+//roots of the HLL wave speeds. Other edges use the full HLL flux
+inline void computeFluxes_linear(float *cellLeft, float *cellRight,
+                                float *edgeLength, float *edgeNormals,
+                                int *isRightBoundary, //OP_READ
+                                float *bathySource, float *out, //OP_WRITE
+                                float *maxEdgeEigenvalues, //OP_WRITE
+                                float *edgeSpeed) //OP_READ
+{
+  if (*edgeSpeed <= 0.0f) {
+    computeFluxes(cellLeft, cellRight, edgeLength, edgeNormals, isRightBoundary,
+                  bathySource, out, maxEdgeEigenvalues);
+    return;
+  }
+  //Deep water edges are not on the boundary, and both cells stay wet
+  float InterfaceBathy = cellLeft[3] > cellRight[3] ? cellLeft[3] : cellRight[3];
+  float hL = cellLeft[0] + cellLeft[3] - InterfaceBathy;
+  float hR = cellRight[0] + cellRight[3] - InterfaceBathy;
+  bathySource[0] = .5f * g * (cellLeft[0]*cellLeft[0] - hL*hL) * *edgeLength;
+  bathySource[1] = .5f * g * (cellRight[0]*cellRight[0] - hR*hR) * *edgeLength;
+
+  float uLn = cellLeft[1] * edgeNormals[0] + cellLeft[2] * edgeNormals[1];
+  float uRn = cellRight[1] * edgeNormals[0] + cellRight[2] * edgeNormals[1];
+  float s = *edgeSpeed + (fabs(uLn) > fabs(uRn) ? fabs(uLn) : fabs(uRn));
+
+  float qL = hL * uLn;
+  float qR = hR * uRn;
+  float pressure = .25f * g * (hL*hL + hR*hR);
+  out[0] = .5f * (qL + qR) - .5f * s * (hR - hL);
+  out[1] = .5f * (qL * cellLeft[1] + qR * cellRight[1]) + pressure * edgeNormals[0]
+         - .5f * s * (hR * cellRight[1] - hL * cellLeft[1]);
+  out[2] = .5f * (qL * cellLeft[2] + qR * cellRight[2]) + pressure * edgeNormals[1]
+         - .5f * s * (hR * cellRight[2] - hL * cellLeft[2]);
+  out[0] *= *edgeLength;
+  out[1] *= *edgeLength;
+  out[2] *= *edgeLength;
+
+  *maxEdgeEigenvalues = s;
+}
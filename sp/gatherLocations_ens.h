@@ -0,0 +1,4 @@
+inline void gatherLocations_ens(float *values, float *dest) {
+	for (int m = 0; m < VOLNA_ENSEMBLE; m++)
+		gatherLocations(values + 4*m, dest + m);
+}
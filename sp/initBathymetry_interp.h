@@ -0,0 +1,4 @@
+inline void initBathymetry_interp(const float *frames, float *values, const float *weights) {
+  values[3] = weights[0] * frames[0] + weights[1] * frames[1]
+            + weights[2] * frames[2] + weights[3] * frames[3];
+}
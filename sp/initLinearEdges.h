@@ -0,0 +1,15 @@
+//Flag the edges between two cells deeper than linearDepth (-Zb) for the
+//deep water flux of computeFluxes_linear, with the wave speed of the deepest
+//water on the edge. edgeSpeed is 0 on the other edges
+inline void initLinearEdges(float *cellLeft, float *cellRight,
+                            int *isRightBoundary, const float *linearDepth,
+                            float *edgeSpeed) {
+  *edgeSpeed = 0.0f;
+  if (*isRightBoundary) return;
+  if (-cellLeft[3] > *linearDepth && -cellRight[3] > *linearDepth) {
+    float h = cellLeft[0] > cellRight[0] ? cellLeft[0] : cellRight[0];
+    h = h > -cellLeft[3] ? h : -cellLeft[3];
+    h = h > -cellRight[3] ? h : -cellRight[3];
+    *edgeSpeed = sqrt(g * h);
+  }
+}
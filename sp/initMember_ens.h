@@ -0,0 +1,7 @@
+inline void initMember_ens(float *values, //OP_READ
+            float *valuesEns, float *maxElevation, //OP_RW
+            const int *member)
+{
+  simulation_1(valuesEns + 4 * *member, values);
+  maxElevation[*member] = values[0] + values[3];
+}
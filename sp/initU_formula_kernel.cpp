@@ -50,7 +50,9 @@ void op_par_loop_initU_formula(char const *name, op_set set,
     printf(" kernel routine w/o indirection:  initU_formula\n");
   }
 
+  VOLNA_TRACE_BEGIN(halo_t1);
   op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
 
   // initialise timers
 
@@ -94,6 +96,7 @@ void op_par_loop_initU_formula(char const *name, op_set set,
 
   op_timers_core(&cpu_t2, &wall_t2);
   OP_kernels[5].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
   OP_kernels[5].transfer += (float)set->size * arg0.size;
   OP_kernels[5].transfer += (float)set->size * arg1.size * 2.0f;
 }
@@ -0,0 +1,14 @@
+//Class c of a cell: it steps with 2^c times the smallest local step,
+//params = {smallest local step, largest class}
+inline void ltsClass(const float *params, //OP_READ
+                     float *localDt, //OP_READ
+                     int *cellClass) //OP_WRITE
+{
+  int c = 0;
+  float ratio = *localDt / params[0];
+  while (c < (int)params[1] && ratio >= 2.0f) {
+    ratio *= 0.5f;
+    c++;
+  }
+  *cellClass = c;
+}
@@ -0,0 +1,8 @@
+//An edge steps with the faster of its two cells
+inline void ltsEdgeClass(int *cellLeft, int *cellRight, //OP_READ
+                         int *isRightBoundary, //OP_READ
+                         int *edgeClass) //OP_WRITE
+{
+  *edgeClass = *cellLeft;
+  if (!*isRightBoundary && *cellRight < *cellLeft) *edgeClass = *cellRight;
+}
@@ -0,0 +1,14 @@
+//computeFluxes on the edges whose rate class starts a step at this substep
+//(weights[edgeClass] != 0), the fluxes of the other edges are frozen
+inline void ltsFluxes(float *cellLeft, float *cellRight,
+                      float *edgeLength, float *edgeNormals,
+                      int *isRightBoundary, //OP_READ
+                      float *bathySource, float *out, //OP_WRITE
+                      float *maxEdgeEigenvalues, //OP_WRITE
+                      int *edgeClass, //OP_READ
+                      const float *weights) //OP_READ, step of each class, 0 if idle
+{
+  if (weights[*edgeClass] == 0.0f) return;
+  computeFluxes(cellLeft, cellRight, edgeLength, edgeNormals, isRightBoundary,
+                bathySource, out, maxEdgeEigenvalues);
+}
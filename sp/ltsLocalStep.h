@@ -0,0 +1,17 @@
+//NumericalFluxes per cell: the local stable step, and the smallest step over
+//the mesh with the current classes {min localDt/2^class, min localDt, -max localDt}
+inline void ltsLocalStep(float **maxEdgeEigenvalues, float **EdgeVolumes, float *cellVolumes, //OP_READ
+            int *cellClass, //OP_READ
+            float *localDt, //OP_WRITE
+            float *minTimeStep ) //OP_MIN
+{
+  float local = 0.0f;
+  for (int j = 0; j < 3; j++) {
+    local += *maxEdgeEigenvalues[j] * *(EdgeVolumes[j]);
+  }
+  *localDt = 2.0f * *cellVolumes / local;
+
+  minTimeStep[0] = MIN(minTimeStep[0], *localDt / (float)(1 << *cellClass));
+  minTimeStep[1] = MIN(minTimeStep[1], *localDt);
+  minTimeStep[2] = MIN(minTimeStep[2], -*localDt);
+}
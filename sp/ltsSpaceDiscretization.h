@@ -0,0 +1,23 @@
+//SpaceDiscretization of the active edges, scaled by the step of the edge class
+//so that both cells receive the same amount (the scheme stays conservative
+//across class interfaces)
+inline void ltsSpaceDiscretization(float *left, //OP_INC
+              float *right, //OP_INC
+              float *edgeFluxes, //OP_READ
+              float *bathySource, //OP_READ
+              float *edgeNormals, int *isRightBoundary, float **cellVolumes, //OP_READ
+              int *edgeClass, //OP_READ
+              const float *weights) //OP_READ, step of each class, 0 if idle
+{
+  float dt = weights[*edgeClass];
+  if (dt == 0.0f) return;
+  left[0] -= dt * (edgeFluxes[0])/cellVolumes[0][0];
+  left[1] -= dt * (edgeFluxes[1] + bathySource[0] * edgeNormals[0])/cellVolumes[0][0];
+  left[2] -= dt * (edgeFluxes[2] + bathySource[0] * edgeNormals[1])/cellVolumes[0][0];
+
+  if (!*isRightBoundary) {
+    right[0] += dt * edgeFluxes[0]/cellVolumes[1][0];
+    right[1] += dt * (edgeFluxes[1] + bathySource[1] * edgeNormals[0])/cellVolumes[1][0];
+    right[2] += dt * (edgeFluxes[2] + bathySource[1] * edgeNormals[1])/cellVolumes[1][0];
+  }
+}
@@ -0,0 +1,22 @@
+//Predictor of the cells starting a step at this substep (weights[cellClass] != 0),
+//the other cells keep their values
+inline void ltsStage(const float *weights, //OP_READ, step of each class, 0 if idle
+            float *in, //OP_READ
+            float *R1, //OP_READ, increments of the first stage
+            int *cellClass, //OP_READ
+            float *stage) //OP_WRITE
+{
+  if (weights[*cellClass] == 0.0f) {
+    stage[0] = in[0];
+    stage[1] = in[1];
+    stage[2] = in[2];
+    stage[3] = in[3];
+    return;
+  }
+  float H = in[0] + R1[0];
+  float TruncatedH = H < EPS ? EPS : H;
+  stage[0] = H;
+  stage[1] = (in[0] * in[1] + R1[1]) / TruncatedH;
+  stage[2] = (in[0] * in[2] + R1[2]) / TruncatedH;
+  stage[3] = in[3];
+}
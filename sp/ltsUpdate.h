@@ -0,0 +1,24 @@
+//Accumulate the Heun increments of the substep, and apply them to the cells
+//whose step ends with it (ending[cellClass] != 0)
+inline void ltsUpdate(const float *ending, //OP_READ
+            float *values, //OP_RW
+            float *R1, float *R2, //OP_RW, increments of both stages, zeroed
+            float *acc, //OP_RW, increments since the cell step started
+            int *cellClass) //OP_READ
+{
+  acc[0] += 0.5f * (R1[0] + R2[0]);
+  acc[1] += 0.5f * (R1[1] + R2[1]);
+  acc[2] += 0.5f * (R1[2] + R2[2]);
+  R1[0] = 0.0f; R1[1] = 0.0f; R1[2] = 0.0f;
+  R2[0] = 0.0f; R2[1] = 0.0f; R2[2] = 0.0f;
+  if (ending[*cellClass] == 0.0f) return;
+
+  float H = values[0] + acc[0];
+  H = H <= EPS ? EPS : H;
+  values[1] = (values[0] * values[1] + acc[1]) / H;
+  values[2] = (values[0] * values[2] + acc[2]) / H;
+  values[0] = H;
+  acc[0] = 0.0f;
+  acc[1] = 0.0f;
+  acc[2] = 0.0f;
+}
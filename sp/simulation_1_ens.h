@@ -0,0 +1,11 @@
+//Copies the new values of every member and updates their maximum elevation,
+//member 0 is also copied to the values seen by the events of the base scenario
+inline void simulation_1_ens(float *out, float *in, float *base, //OP_WRITE, OP_READ, OP_WRITE
+            float *maxElevation) //OP_RW
+{
+  for (int m = 0; m < VOLNA_ENSEMBLE; m++) {
+    simulation_1(out + 4*m, in + 4*m);
+    getMaxElevation(in + 4*m, maxElevation + m);
+  }
+  simulation_1(base, in);
+}
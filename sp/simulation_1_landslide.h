@@ -0,0 +1,17 @@
+inline void simulation_1_landslide(float *out, float *in, float *center, const float *landslide)
+{
+  //landslide = {mesh_xmin, A, t, lx, ly, v, cutoff}, t is the time of the next step
+  out[0] = in[0];
+  out[1] = in[1];
+  out[2] = in[2];
+
+  //Zb of the next step as in initGaussianLandslide, the exp is only
+  //evaluated where its argument is below the cutoff
+  float x = center[0];
+  float y = center[1];
+  float xs = landslide[2] < 1.0/landslide[5] ? x+3.0-landslide[5]*landslide[2] : x+3.0-1.0;
+  float arg = landslide[3]*landslide[3]*xs*xs + landslide[4]*landslide[4]*y*y;
+  out[3] = (landslide[0]-x)*(x<0.0)-5.0*(x>=0.0);
+  if (arg < landslide[6])
+    out[3] += landslide[1]*exp(-arg);
+}
@@ -1,7 +1,9 @@
 #include "volna_common.h"
 #include "EvolveValuesRK2_1.h"
 #include "EvolveValuesRK2_2.h"
+#include "EvolveValuesRK2_2_bathy.h"
 #include "simulation_1.h"
+#include "simulation_1_landslide.h"
 #include "limits.h"
 
 #include "op_seq.h"
@@ -46,7 +48,7 @@ int main(int argc, char **argv) {
 
   hid_t file;
   const char *filename_h5 = argv[1];
-  file = H5Fopen(filename_h5, H5F_ACC_RDONLY, H5P_DEFAULT);
+  file = volna_open_hdf5(filename_h5);
 
 	//Read the above parameters
   check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsx0", &bore_params.x0));
@@ -58,6 +60,10 @@ int main(int argc, char **argv) {
   check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamsv", &gaussian_landslide_params.v));
   check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamslx", &gaussian_landslide_params.lx));
   check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamsly", &gaussian_landslide_params.ly));
+  //Relative size below which the Gaussian landslide is not evaluated (landslideCutoff=)
+  const char *landslide_cutoff = volna_option(argc, argv, "landslideCutoff");
+  gaussian_landslide_params.cutoff = landslide_cutoff ? atof(landslide_cutoff) : 1e-7;
+  gaussian_landslide_params.fused = 0;
   check_hdf5_error(H5LTread_dataset_int(file, "nx", &rect_params.nx));
   check_hdf5_error(H5LTread_dataset_int(file, "ny", &rect_params.ny));
   check_hdf5_error(H5LTread_dataset_float(file, "xmin", &rect_params.xmin));
@@ -75,85 +81,138 @@ int main(int argc, char **argv) {
 	//Read Event "objects" (Init and Output events) into timers and events
   read_events_hdf5(file, num_events, &timers, &events, &num_outputLocation);
 
-  check_hdf5_error(H5Fclose(file));
+  //Additional OutputLocation gauges may be given in a side file (gauges=filename),
+  //these are located on the mesh here instead of in volna2hdf5
+  int num_gauges = 0;
+  int *output_map = NULL;
+  const char *gauges_file = volna_option(argc, argv, "gauges");
+  if (gauges_file != NULL) {
+    //the cells are located on the whole mesh, before the partitioning
+    if (volna_comm_size() > 1) {
+      op_printf("gauges= is not supported with MPI, add the gauges to the input file with volna2hdf5\n");
+      exit(-1);
+    }
+    read_gauges_file(gauges_file, &timers, &events, &num_gauges);
+    output_map = (int *)malloc((num_outputLocation + num_gauges) * sizeof(int));
+    if (num_outputLocation)
+      check_hdf5_error(H5LTread_dataset_int(file, "outputLocation_map", output_map));
+  }
+
+  //Init formulas stored as programs by volna2hdf5 are compiled here, so the solver does not
+  //have to be rebuilt when they change
+  volna_formula_init(argc, argv, &events);
+
+  //Resolve the event types and schedule the events
+  init_events(&timers, &events);
+
+  //Checkpoints (checkpoint=filename) and restarts from them (restart=filename)
+  volna_checkpoint_init(argc, argv);
+  const char *restart_file = volna_option(argc, argv, "restart");
+
+  //Scenarios advanced together with this one on the same mesh (ensemble=listfile)
+  const char *ensemble_list = volna_option(argc, argv, "ensemble");
+  if (ensemble_list != NULL && (volna_checkpoint_enabled() || restart_file != NULL)) {
+    op_printf("Checkpoints are not supported in ensemble mode\n");
+    exit(-1);
+  }
+
+  //Resident service running the scenarios of a spool directory on this mesh (spool=directory)
+  volna_service_init(argc, argv);
+  if (volna_service_enabled() && (volna_checkpoint_enabled() || restart_file != NULL || ensemble_list != NULL)) {
+    op_printf("Checkpoints and ensembles are not supported in service mode\n");
+    exit(-1);
+  }
+
+  //Mesh and geometry data may be stored in a separate file shared by the scenarios on the same mesh
+  char filename_mesh[1024];
+  read_mesh_filename(file, filename_h5, filename_mesh);
+  hid_t meshfile = strcmp(filename_mesh, filename_h5) ? volna_open_hdf5(filename_mesh) : file;
 
   /*
    * Define OP2 sets - Read mesh and geometry data from HDF5
    */
-  op_set nodes = op_decl_set_hdf5(filename_h5, "nodes");
-  op_set edges = op_decl_set_hdf5(filename_h5, "edges");
-  op_set cells = op_decl_set_hdf5(filename_h5, "cells");
+  op_set nodes = volna_decl_set_hdf5(meshfile, "nodes");
+  op_set edges = volna_decl_set_hdf5(meshfile, "edges");
+  op_set cells = volna_decl_set_hdf5(meshfile, "cells");
 
 	
   /*
    * Define OP2 set maps
    */
-  op_map cellsToNodes = op_decl_map_hdf5(cells, nodes, N_NODESPERCELL,
-                                  filename_h5,
+  op_map cellsToNodes = volna_decl_map_hdf5(cells, nodes, N_NODESPERCELL,
+                                  meshfile,
                                   "cellsToNodes");
-  op_map edgesToCells = op_decl_map_hdf5(edges, cells, N_CELLSPEREDGE,
-                                  filename_h5,
+  op_map edgesToCells = volna_decl_map_hdf5(edges, cells, N_CELLSPEREDGE,
+                                  meshfile,
                                   "edgesToCells");
-  op_map cellsToEdges = op_decl_map_hdf5(cells, edges, N_NODESPERCELL,
-                                  filename_h5,
+  op_map cellsToEdges = volna_decl_map_hdf5(cells, edges, N_NODESPERCELL,
+                                  meshfile,
                                   "cellsToEdges");
 
-  //When using OutputLocation events we have already computed the cell index of the points
-  //so we don't have to locate the cell every time
-	op_set outputLocation = NULL;
-	op_map outputLocation_map = NULL;
-	op_dat outputLocation_dat = NULL;
-  if (num_outputLocation) {
-		outputLocation = op_decl_set_hdf5(filename_h5, "outputLocation");
-		outputLocation_map = op_decl_map_hdf5(outputLocation, cells, 1,
-	                                  filename_h5,
-	                                  "outputLocation_map");
-		outputLocation_dat = op_decl_dat_hdf5(outputLocation, 1, "float",
-																					filename_h5,
-																          "outputLocation_dat");
-	}
-	
   /*
    * Define OP2 datasets
    */
-  op_dat cellCenters = op_decl_dat_hdf5(cells, MESH_DIM, "float",
-                                    filename_h5,
+  op_dat cellCenters = volna_decl_dat_hdf5(cells, MESH_DIM, "float",
+                                    meshfile,
                                     "cellCenters");
 
-  op_dat cellVolumes = op_decl_dat_hdf5(cells, 1, "float",
-                                    filename_h5,
+  op_dat cellVolumes = volna_decl_dat_hdf5(cells, 1, "float",
+                                    meshfile,
                                     "cellVolumes");
 
-  op_dat edgeNormals = op_decl_dat_hdf5(edges, MESH_DIM, "float",
-                                    filename_h5,
+  op_dat edgeNormals = volna_decl_dat_hdf5(edges, MESH_DIM, "float",
+                                    meshfile,
                                     "edgeNormals");
 
-  op_dat edgeLength = op_decl_dat_hdf5(edges, 1, "float",
-                                    filename_h5,
+  op_dat edgeLength = volna_decl_dat_hdf5(edges, 1, "float",
+                                    meshfile,
                                     "edgeLength");
 
-  op_dat nodeCoords = op_decl_dat_hdf5(nodes, MESH_DIM, "float",
-                                      filename_h5,
+  op_dat nodeCoords = volna_decl_dat_hdf5(nodes, MESH_DIM, "float",
+                                      meshfile,
                                       "nodeCoords");
 
-  op_dat values = op_decl_dat_hdf5(cells, N_STATEVAR, "float",
-                                    filename_h5,
+  op_dat values = volna_decl_dat_hdf5(cells, N_STATEVAR, "float",
+                                    file,
                                     "values");
-  op_dat isBoundary = op_decl_dat_hdf5(edges, 1, "int",
-                                    filename_h5,
+  op_dat isBoundary = volna_decl_dat_hdf5(edges, 1, "int",
+                                    meshfile,
                                     "isBoundary");
 
+  //When using OutputLocation events we have already computed the cell index of the points
+  //so we don't have to locate the cell every time
+	op_set outputLocation = NULL;
+	op_map outputLocation_map = NULL;
+	op_dat outputLocation_dat = NULL;
+  if (num_gauges) {
+		locate_gauges(&events, num_outputLocation, num_gauges, output_map, cells, nodeCoords, cellsToNodes);
+		num_outputLocation += num_gauges;
+		outputLocation = op_decl_set(num_outputLocation, "outputLocation");
+		outputLocation_map = op_decl_map(outputLocation, cells, 1, output_map, "outputLocation_map");
+		outputLocation_dat = op_decl_dat(outputLocation, 1, "float",
+		                                 (char *)calloc(num_outputLocation, sizeof(float)),
+		                                 "outputLocation_dat");
+	} else if (num_outputLocation) {
+		outputLocation = volna_decl_set_hdf5(file, "outputLocation");
+		outputLocation_map = volna_decl_map_hdf5(outputLocation, cells, 1,
+	                                  file,
+	                                  "outputLocation_map");
+		outputLocation_dat = volna_decl_dat_hdf5(outputLocation, 1, "float",
+																					file,
+																          "outputLocation_dat");
+	}
+
 
   /*
    * Read constants from HDF5
    */
   float ftime, dtmax;
-  op_get_const_hdf5("CFL", 1, "float", (char *) &CFL, filename_h5);
+  check_hdf5_error(H5LTread_dataset_float(file, "CFL", &CFL));
 
   // Final time: as defined by Volna the end of real-time simulation
-  op_get_const_hdf5("ftime", 1, "float", (char *) &ftime, filename_h5);
-  op_get_const_hdf5("dtmax", 1, "float", (char *) &dtmax, filename_h5);
-  op_get_const_hdf5("g", 1, "float", (char *) &g, filename_h5);
+  check_hdf5_error(H5LTread_dataset_float(file, "ftime", &ftime));
+  check_hdf5_error(H5LTread_dataset_float(file, "dtmax", &dtmax));
+  check_hdf5_error(H5LTread_dataset_float(file, "g", &g));
 
   op_decl_const(1, "float", &CFL);
   op_decl_const(1, "float", &EPS);
@@ -163,13 +222,27 @@ int main(int argc, char **argv) {
   op_dat temp_initEta         = NULL;
   op_dat* temp_initBathymetry = NULL;  // Store initBathymtery in an array: there might be more input files for different timesteps
   int n_initBathymetry = 0; // Number of initBathymetry files
+  op_dat bathymetryFrames = NULL, cellGlobalIndex = NULL; // Used when there are multiple initBathymetry files
+  int bathymetry_istart = 0, bathymetry_istep = 1;
+  //Multiple initBathymetry files may be interpolated in time (bathyInterp=linear|cubic)
+  //instead of applied when each one is due (bathyInterp=step, the default)
+  int bathymetry_interp = 0; //0 - step, 1 - linear, 2 - cubic
+  const char *bathy_interp = volna_option(argc, argv, "bathyInterp");
+  if (bathy_interp != NULL) {
+    if (!strcmp(bathy_interp, "linear")) bathymetry_interp = 1;
+    else if (!strcmp(bathy_interp, "cubic")) bathymetry_interp = 2;
+    else if (strcmp(bathy_interp, "step")) {
+      op_printf("Unknown bathyInterp=%s, use step, linear or cubic\n", bathy_interp);
+      exit(-1);
+    }
+  }
 	
 	//Read InitBathymetry and InitEta event data when they come from files
   for (unsigned int i = 0; i < events.size(); i++) {
       if (!strcmp(events[i].className.c_str(), "InitEta")) {
         if (strcmp(events[i].streamName.c_str(), ""))
-          temp_initEta = op_decl_dat_hdf5(cells, 1, "float",
-              filename_h5,
+          temp_initEta = volna_decl_dat_hdf5(cells, 1, "float",
+              file,
               "initEta");
       } else if (!strcmp(events[i].className.c_str(), "InitBathymetry")) {
         if (strcmp(events[i].streamName.c_str(), "")){
@@ -177,8 +250,8 @@ int main(int argc, char **argv) {
           if (strstr(events[i].streamName.c_str(), "%i") == NULL){
             n_initBathymetry = 1;
             temp_initBathymetry = (op_dat*) malloc(sizeof(op_dat));
-            temp_initBathymetry[0] = op_decl_dat_hdf5(cells, 1, "float",
-                          filename_h5,
+            temp_initBathymetry[0] = volna_decl_dat_hdf5(cells, 1, "float",
+                          file,
                           "initBathymetry");
           // If multiple initBathymetry files are used
           } else{
@@ -188,32 +261,86 @@ int main(int argc, char **argv) {
               int tmp_iend = ftime/dtmax;
               n_initBathymetry = (tmp_iend-timers[i].istart)/timers[i].istep + 1;
             }
-            op_printf("Reading %d consecutive InitBathymetry data array... ", n_initBathymetry);
-            temp_initBathymetry = (op_dat*) malloc(n_initBathymetry * sizeof(op_dat));
-            for(int k=0; k<n_initBathymetry; k++) {
-                char dat_name[255];
-                // iniBathymetry data is stored with sequential numbering instead of iteration step numbering!
-                sprintf(dat_name,"initBathymetry%d",k);
-                temp_initBathymetry[k] = op_decl_dat_hdf5(cells, 1, "float",
-                                filename_h5,
-                                dat_name);
-            }
-            op_printf("done.\n");
+            // The frames are not all loaded, they are streamed during the simulation
+            op_printf("Streaming %d consecutive InitBathymetry data arrays\n", n_initBathymetry);
+            bathymetry_istart = timers[i].istart;
+            bathymetry_istep = timers[i].istep;
+            bathymetry_stream_decl(cells, bathymetry_interp, &bathymetryFrames, &cellGlobalIndex);
           }
         }
       }
   }
 
+  //Checkpoints store the cells in the order of the input file, to be independent of the partitioning,
+  //and the other scenarios of an ensemble and the jobs of the service are read in that order, the deep
+  //halo is built from the mesh file by global index
+  if (cellGlobalIndex == NULL && (volna_checkpoint_enabled() || restart_file != NULL || ensemble_list != NULL ||
+                                  volna_service_enabled() || volna_option(argc, argv, "deepHalo") != NULL))
+    cellGlobalIndex = volna_decl_global_index(cells, "cellGlobalIndex");
+
   op_diagnostic_output();
 
-  op_partition("PARMETIS", "GEOM", NULL, NULL, cellCenters);
+  volna_partition(argc, argv, file, meshfile, cells, edges, edgesToCells, cellCenters);
+
+  if (meshfile != file) check_hdf5_error(H5Fclose(meshfile));
+  check_hdf5_error(H5Fclose(file));
+
+  if (n_initBathymetry > 1)
+    bathymetry_stream_open(filename_h5, n_initBathymetry, bathymetry_istart, bathymetry_istep,
+                           bathymetry_interp, cells, bathymetryFrames, cellGlobalIndex);
+
+  //Timeline of the loops, events and I/O, written at the end (trace=filename, -DVOLNA_TRACE builds)
+  volna_trace_init(argc, argv);
 
   double cpu_t1, cpu_t2, wall_t1, wall_t2;
   op_timers(&cpu_t1, &wall_t1);
 
-  //Very first Init loop
-  processEvents(&timers, &events, 1/*firstTime*/, 1/*update timers*/, 0.0/*=dt*/, 1/*remove finished events*/, 2/*init loop, not pre/post*/,
-                     cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes, temp_initEta, temp_initBathymetry, n_initBathymetry, bore_params, gaussian_landslide_params, outputLocation_map, outputLocation_dat);
+  //The other scenarios of an ensemble are initialised before this one
+  volna_ensemble_init(argc, argv, &timers, &events, cells, edges, cellGlobalIndex, cellVolumes,
+                      cellCenters, nodeCoords, cellsToNodes, outputLocation_map);
+
+  if (restart_file != NULL) {
+    //The state is loaded from the checkpoint instead of running the Init events
+    volna_restart(restart_file, values, cellGlobalIndex, &timers, &events, &gaussian_landslide_params.fused);
+  } else {
+    //Very first Init loop
+    processEvents(&timers, &events, 1/*firstTime*/, 1/*update timers*/, 0.0/*=dt*/, 2/*init loop, not pre/post*/,
+                       cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes, temp_initEta, temp_initBathymetry, n_initBathymetry, bore_params, gaussian_landslide_params, outputLocation_map, outputLocation_dat);
+  }
+
+  //Load monitor, an unbalanced run stops to be restarted with the load of the cells (rebalance=threshold)
+  volna_rebalance_init(argc, argv, cells);
+
+  //Then it is copied into the ensemble
+  volna_ensemble_start(values);
+
+  //Cells step with a power of two multiple of the smallest stable step (lts=classes)
+  volna_lts_init(argc, argv, cells, edges);
+  if (volna_lts_enabled() && (bathymetry_interp || volna_ensemble_size())) {
+    op_printf("Local time stepping is not supported with bathyInterp and in ensemble mode\n");
+    exit(-1);
+  }
+
+  //Deep water edges get the cheap flux (linearDepth=)
+  volna_linear_init(argc, argv, edges, edgesToCells, isBoundary, values);
+
+  //The RK2 step by cache sized tiles of the mesh (tiles=cells per tile)
+  volna_tiling_init(argc, argv, cells, edges, edgesToCells, cellsToEdges,
+                    !bathymetry_interp && !volna_ensemble_size() && !volna_lts_enabled() && !volna_linear_enabled());
+
+  //The loops of the RK2 step captured once and replayed in one parallel region (replay=1)
+  volna_replay_init(argc, argv, cells, edges, edgesToCells, cellsToEdges,
+                    !bathymetry_interp && !volna_ensemble_size() && !volna_lts_enabled() &&
+                    !volna_linear_enabled() && !volna_tiling_enabled());
+
+  //Two layers of halo cells computed redundantly, one exchange per RK2 step (deepHalo=1)
+  volna_halo_init(argc, argv, filename_mesh, cells, cellGlobalIndex,
+                  !bathymetry_interp && !volna_ensemble_size() && !volna_lts_enabled() &&
+                  !volna_linear_enabled() && !volna_tiling_enabled() && !volna_replay_enabled());
+
+  //The global time step reduction only every dtLag= steps
+  volna_lagged_init(argc, argv, cells, !volna_ensemble_size() && !volna_lts_enabled() && !volna_tiling_enabled() &&
+                    !volna_replay_enabled() && !volna_halo_enabled());
 
 
   //Corresponding to CellValues and tmp in Simulation::run() (simulation.hpp)
@@ -238,11 +365,35 @@ int main(int argc, char **argv) {
   //NumericalFluxes
   op_dat maxEdgeEigenvalues = op_decl_dat_temp(edges, 1, "float", tmp_elem, "maxEdgeEigenvalues"); //temp - edges - dim 1
 
-  double timestep;
+  //Threads pinned, and the mesh and the dats of the RK2 step on huge pages first touched by the
+  //threads that use them (numa=1)
+  op_dat numaDats[13] = {values, values_new, midPointConservative, inConservative, outConservative, midPoint,
+                         bathySource, edgeFluxes, maxEdgeEigenvalues, edgeNormals, edgeLength, cellVolumes,
+                         isBoundary};
+  op_map numaMaps[2] = {edgesToCells, cellsToEdges};
+  volna_numa_init(argc, argv, 13, numaDats, 2, numaMaps);
+
+  //Part size and threads of the OpenMP loops of the RK2 step, tuned or read from the cache (ompTune=filename)
+  volna_tune_init(argc, argv, cells);
 
-  while (timestamp < ftime) {
+  //Native OpenMP loops, and their benchmark against the generated ones (ompNative=, ompBenchmark=)
+  volna_native_init(argc, argv, values, midPointConservative, bathySource, edgeFluxes, maxEdgeEigenvalues,
+                    edgeNormals, edgeLength, cellVolumes, isBoundary, cells, edges, edgesToCells, cellsToEdges);
+
+  //Bandwidth, FLOP rate and time split of the run, written at the end (report=filename)
+  volna_report_init(argc, argv, cells, edges);
+
+  double timestep;
+  double step_cpu, step_t1, step_t2;
+
+  //In service mode the next job is loaded when a scenario is finished
+  while (timestamp < ftime ||
+         volna_service_next(argc, argv, &timers, &events, &ftime, &dtmax, &bore_params, &gaussian_landslide_params,
+                            cells, values, cellGlobalIndex, cellVolumes, cellCenters, nodeCoords, cellsToNodes,
+                            &temp_initEta, &temp_initBathymetry, &n_initBathymetry,
+                            outputLocation_map, outputLocation_dat)) {
 		//process post_update==false events (usually Init events)
-    processEvents(&timers, &events, 0, 0, 0.0, 0, 0,
+    processEvents(&timers, &events, 0, 0, 0.0, 0,
                   cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes,
  									temp_initEta, temp_initBathymetry, n_initBathymetry, bore_params,
 									gaussian_landslide_params, outputLocation_map, outputLocation_dat);
@@ -251,7 +402,36 @@ int main(int argc, char **argv) {
     printf("Call to EvolveValuesRK2 CellValues H %g U %g V %g Zb %g\n", normcomp(values, 0), normcomp(values, 1),normcomp(values, 2),normcomp(values, 3));
 #endif
 
-    { //begin EvolveValuesRK2
+    op_timers_core(&step_cpu, &step_t1);
+    if (volna_ensemble_size()) {
+      //All members of the ensemble advance with the smallest time step among them
+      timestep = volna_ensemble_step(cells, edges, edgesToCells, cellsToEdges, edgeNormals, edgeLength,
+                                     cellVolumes, isBoundary, maxEdgeEigenvalues, values);
+    } else if (volna_lts_enabled()) {
+      //One macro step, the cells of every class do their substeps
+      timestep = volna_lts_step(cells, edges, edgesToCells, cellsToEdges, edgeNormals, edgeLength,
+                                cellVolumes, isBoundary, bathySource, edgeFluxes, maxEdgeEigenvalues,
+                                values, dtmax);
+    } else if (volna_tiling_enabled()) {
+      //Both loop chains of EvolveValuesRK2 by tiles, split by the minTimestep reduction
+      timestep = volna_tiling_step(values, values_new, midPointConservative, inConservative, outConservative,
+                                   midPoint, bathySource, edgeFluxes, maxEdgeEigenvalues, edgeNormals,
+                                   edgeLength, cellVolumes, isBoundary);
+    } else if (volna_replay_enabled()) {
+      //The captured loops of EvolveValuesRK2 in one parallel region
+      timestep = volna_replay_step(values, values_new, midPointConservative, inConservative, outConservative,
+                                   midPoint, bathySource, edgeFluxes, maxEdgeEigenvalues, edgeNormals,
+                                   edgeLength, cellVolumes, isBoundary);
+    } else if (volna_halo_enabled()) {
+      //Both stages of EvolveValuesRK2 after a single exchange of two halo layers
+      timestep = volna_halo_step(values, values_new);
+    } else if (volna_lagged_enabled()) {
+      //EvolveValuesRK2 with the last reduced time step, checked every dtLag steps
+      timestep = volna_lagged_step(values, values_new, midPointConservative, inConservative, outConservative,
+                                   midPoint, bathySource, edgeFluxes, maxEdgeEigenvalues, edgeNormals,
+                                   edgeLength, cellVolumes, isBoundary, cells, edges, edgesToCells,
+                                   cellsToEdges, dtmax, ftime, &timers, &events);
+    } else { //begin EvolveValuesRK2
       float minTimestep = 0.0;
       spaceDiscretization(values, midPointConservative, &minTimestep,
           bathySource, edgeFluxes, maxEdgeEigenvalues,
@@ -262,7 +442,7 @@ int main(int argc, char **argv) {
 #endif
       float dT = CFL * minTimestep;
 
-      op_par_loop(EvolveValuesRK2_1, "EvolveValuesRK2_2", cells,
+      op_par_loop(EvolveValuesRK2_1, "EvolveValuesRK2_1", cells,
           op_arg_gbl(&dT,1,"float", OP_READ),
           op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_RW),
           op_arg_dat(values, -1, OP_ID, 4, "float", OP_READ),
@@ -277,22 +457,56 @@ int main(int argc, char **argv) {
           edgeNormals, edgeLength, cellVolumes, isBoundary,
           cells, edges, edgesToCells, cellsToEdges, 1);
 
-      op_par_loop(EvolveValuesRK2_2, "EvolveValuesRK2_2", cells,
-          op_arg_gbl(&dT,1,"float", OP_READ),
-          op_arg_dat(outConservative, -1, OP_ID, 4, "float", OP_RW),
-          op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_READ),
-          op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_READ),
-          op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_WRITE));
+      //Zb of the next step interpolated between the bathymetry frames, the next
+      //step sees timer iteration itercount+2
+      float bathyWeights[4];
+      op_dat bathyFrames = bathymetry_stream_interpolate(itercount + 2, bathyWeights);
+      if (bathyFrames == NULL) {
+        op_par_loop(EvolveValuesRK2_2, "EvolveValuesRK2_2", cells,
+            op_arg_gbl(&dT,1,"float", OP_READ),
+            op_arg_dat(outConservative, -1, OP_ID, 4, "float", OP_RW),
+            op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_READ),
+            op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_READ),
+            op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_WRITE));
+      } else {
+        op_par_loop(EvolveValuesRK2_2_bathy, "EvolveValuesRK2_2_bathy", cells,
+            op_arg_gbl(&dT,1,"float", OP_READ),
+            op_arg_dat(outConservative, -1, OP_ID, 4, "float", OP_RW),
+            op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_READ),
+            op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_READ),
+            op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_WRITE),
+            op_arg_dat(bathyFrames, -1, OP_ID, 4, "float", OP_READ),
+            op_arg_gbl(bathyWeights,4,"float", OP_READ));
+      }
 
       timestep = dT;
     } //end EvolveValuesRK2
 
-    op_par_loop(simulation_1, "simulation_1", cells,
-        op_arg_dat(values, -1, OP_ID, 4, "float", OP_WRITE),
-        op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_READ));
-
     timestep = timestep < dtmax ? timestep : dtmax;
 
+    //When the Gaussian landslide moves the bathymetry in the next step, its Zb is
+    //computed while copying the new values instead of in a separate pass
+    gaussian_landslide_params.fused = !volna_lts_enabled() &&
+      event_happens_next(&timers, &events, EVENT_INIT_GAUSSIAN_LANDSLIDE, timestep);
+    if (gaussian_landslide_params.fused) {
+      float landslide[7] = {gaussian_landslide_params.mesh_xmin, gaussian_landslide_params.A,
+                            (float)(timestamp + timestep), gaussian_landslide_params.lx,
+                            gaussian_landslide_params.ly, gaussian_landslide_params.v,
+                            gaussian_landslide_params.cutoff > 0.0f ? -logf(gaussian_landslide_params.cutoff) : INFINITY};
+      op_par_loop(simulation_1_landslide, "simulation_1_landslide", cells,
+          op_arg_dat(values, -1, OP_ID, 4, "float", OP_WRITE),
+          op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_dat(cellCenters, -1, OP_ID, 2, "float", OP_READ),
+          op_arg_gbl(landslide, 7, "float", OP_READ));
+    } else if (!volna_ensemble_size() && !volna_lts_enabled()) { //otherwise updated by volna_ensemble_step or volna_lts_step
+      op_par_loop(simulation_1, "simulation_1", cells,
+          op_arg_dat(values, -1, OP_ID, 4, "float", OP_WRITE),
+          op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_READ));
+    }
+    op_timers_core(&step_cpu, &step_t2);
+    volna_report_time(VOLNA_REPORT_SOLVER, step_t2 - step_t1);
+    VOLNA_TRACE_SPAN("time step", "solver", step_t1, step_t2);
+
 #ifdef DEBUG
 //    if (itercount%50 == 0) {
 //      printf("itercount %d\n", itercount);
@@ -319,10 +533,16 @@ int main(int argc, char **argv) {
     timestamp += timestep;
 
 		//process post_update==true events (usually Output events)
-    processEvents(&timers, &events, 0, 1, timestep, 1, 1,
+    processEvents(&timers, &events, 0, 1, timestep, 1,
                   cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes,
 									temp_initEta, temp_initBathymetry, n_initBathymetry, bore_params,
 									gaussian_landslide_params, outputLocation_map, outputLocation_dat);
+
+    volna_rebalance_step(values);
+
+    //Periodic and signal-triggered checkpoints, SIGTERM stops the simulation
+    if (volna_checkpoint_step(values, cellGlobalIndex, &events, gaussian_landslide_params.fused))
+      break;
   }
 
 	/*
@@ -349,11 +569,27 @@ int main(int argc, char **argv) {
   if (op_free_dat_temp(maxEdgeEigenvalues) < 0)
           op_printf("Error: temporary op_dat %s cannot be removed\n",maxEdgeEigenvalues->name);
 
+  volna_ensemble_close(argc, argv, cellGlobalIndex);
+  volna_checkpoint_close();
+  volna_rebalance_close();
+  volna_service_close();
+  volna_linear_close();
+  volna_lts_close();
+  volna_tiling_close();
+  volna_replay_close();
+  volna_halo_close();
+  volna_lagged_close();
+  volna_tune_close();
+  volna_formula_free();
+  bathymetry_stream_close();
+
   op_timers(&cpu_t2, &wall_t2);
+  volna_report_write(wall_t2 - wall_t1);
+  volna_trace_close();
   op_timing_output();
   op_printf("Max total runtime = \n%lf\n",wall_t2-wall_t1);
 
   op_exit();
 
-  return 0;
+  return volna_rebalance_status();
 }
@@ -22,6 +22,12 @@
 #include "simulation.hpp"
 #include "paramFileParser.hpp"
 #include "event.hpp"
+// after simulation.hpp, Eigen/StdVector has to come before <vector>
+#include "../volna_spatial.h"
+#include "../volna_partition.h"
+#ifdef HAVE_METIS
+#include <metis.h>
+#endif
 
 //
 // Define meta data
@@ -64,51 +70,125 @@ void read_event_data(const char *streamname, float* event_data, int ncell) {
 
 }
 
-void triangleIndex(float *val, const float* x, const float* y, float* nodeCoordsA, float* nodeCoordsB, float* nodeCoordsC, float* values) {
-  // Return value on cell if the given point is inside the cell
-  bool isInside = false;
-
-  // First, check if the point is in the bounding box of the triangle
-  // vertices (else, the algorithm is not nearly robust enough)
-  float xmin = MIN(MIN(nodeCoordsA[0], nodeCoordsB[0]), nodeCoordsC[0]);
-  float xmax = MAX(MAX(nodeCoordsA[0], nodeCoordsB[0]), nodeCoordsC[0]);
-  float ymin = MIN(MIN(nodeCoordsA[1], nodeCoordsB[1]), nodeCoordsC[1]);
-  float ymax = MAX(MAX(nodeCoordsA[1], nodeCoordsB[1]), nodeCoordsC[1]);
-
-  if ( ( *x < xmin ) || ( *x > xmax ) ||
-      ( *y < ymin ) || ( *y > ymax ) ) {
-    isInside = false;
-  }else{
-    // Case where the point is in the bounding box. Here, if abc is not
-    // Check if the Triangle vertices are clockwise or
-    // counter-clockwise
-    float insider = 1.0f;
-    float p[2] = {*x, *y};
-
-#define ORIENT2D(pA, pB, pC) (pA[0] - pC[0]) * (pB[1] - pC[1]) - (pA[1] - pC[1]) * (pB[0] - pC[0])
-    if ( ORIENT2D(nodeCoordsA, nodeCoordsB, nodeCoordsC) > 0 ) {  // counter clockwise
-      insider =  ORIENT2D( nodeCoordsA, p, nodeCoordsC);
-      insider *= ORIENT2D( nodeCoordsA, nodeCoordsB, p);
-      insider *= ORIENT2D( nodeCoordsB, nodeCoordsC, p);
-    }
-    else {      // clockwise
-      insider =  ORIENT2D( nodeCoordsA, p, nodeCoordsB);
-      insider *= ORIENT2D( nodeCoordsA, nodeCoordsC, p);
-      insider *= ORIENT2D( nodeCoordsC, nodeCoordsB, p);
-    }
-    isInside = insider > 0.0f;
+// Write an array to HDF5 the way op_write_hdf5 stores op_dats and op_maps
+void write_dat_hdf5(hid_t h5file, const char *name, int size, int dim, const char *type, hid_t h5type, const void *data) {
+  hsize_t dims[2] = {(hsize_t)size, (hsize_t)dim};
+  int elem_size = dim * (int)H5Tget_size(h5type);
+  check_hdf5_error(H5LTmake_dataset(h5file, name, 2, dims, h5type, data));
+  check_hdf5_error(H5LTset_attribute_int(h5file, name, "dim", &dim, 1));
+  check_hdf5_error(H5LTset_attribute_int(h5file, name, "size", &elem_size, 1));
+  check_hdf5_error(H5LTset_attribute_string(h5file, name, "type", type));
+}
+
+// FNV-1a hash, used to recognise meshes that have already been converted
+unsigned long long fnv1a(const void *data, size_t len, unsigned long long hash) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Name of the mesh file: the Gmsh file name (or "rectangle") and a hash of
+// its contents (or of the rectangle parameters). The hash is also returned
+// in mesh_hash, it is stored in the mesh file to check it on reuse
+void mesh_filename(Simulation &sim, char *filename_mesh, char *mesh_hash) {
+  const int version = 1; // bump when the mesh file layout changes
+  unsigned long long hash = fnv1a(&version, sizeof(int), 14695981039346656037ULL);
+  std::ifstream ifs(sim.MeshFileName.c_str(), std::ios::binary);
+  std::string base;
+  if (ifs) {
+    char buf[65536];
+    while (ifs.read(buf, sizeof(buf)) || ifs.gcount() > 0)
+      hash = fnv1a(buf, ifs.gcount(), hash);
+    base = sim.MeshFileName.substr(sim.MeshFileName.find_last_of('/') + 1);
+    base = base.substr(0, base.find_last_of('.'));
+  } else {
+    float rect[4] = {(float)sim.mesh.xmin, (float)sim.mesh.xmax, (float)sim.mesh.ymin, (float)sim.mesh.ymax};
+    int n[2] = {(int)sim.mesh.nx, (int)sim.mesh.ny};
+    hash = fnv1a(n, sizeof(n), hash);
+    hash = fnv1a(rect, sizeof(rect), hash);
+    base = "rectangle";
   }
+  sprintf(filename_mesh, "%s_mesh_%016llx.h5", base.c_str(), hash);
+  sprintf(mesh_hash, "%016llx", hash);
+}
 
-  if ( isInside )
-    *val = values[0] + values[3]; // H + Zb
+// Whether the mesh file was converted from the mesh with this hash, files
+// without the hash (or unreadable) are not reused
+int mesh_matches(const char *path_mesh, const char *mesh_hash) {
+  hid_t meshfile = H5Fopen(path_mesh, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (meshfile < 0) return 0;
+  char stored[32] = "";
+  hsize_t dims;
+  H5T_class_t cls;
+  size_t size;
+  int match = H5LTfind_dataset(meshfile, "meshHash") > 0 &&
+              H5LTget_dataset_info(meshfile, "meshHash", &dims, &cls, &size) >= 0 &&
+              size <= sizeof(stored) &&
+              H5LTread_dataset_string(meshfile, "meshHash", stored) >= 0 &&
+              strcmp(stored, mesh_hash) == 0;
+  H5Fclose(meshfile);
+  return match;
 }
 
+// Simulation::init rejects the InitFormulas, the reuse path does not call it
+void check_init_formulas(Simulation &sim) {
+  if (sim.InitFormulas.eta != "" || sim.InitFormulas.U != "" ||
+      sim.InitFormulas.V != "" || sim.InitFormulas.bathymetry != "") {
+    printf("Unsupported method of specifiying initial values: please use Init events\n");
+    exit(-1);
+  }
+}
+
+// Partition the dual graph of the mesh (cells sharing an edge) into nparts
+// parts with METIS, or along a Hilbert curve through the cell centres when
+// volna2hdf5 is built without METIS
+void partition_cells(int ncell, int nedge, const int *ecell, const float *ccent, int nparts, int *part) {
+#ifdef HAVE_METIS
+  std::vector<idx_t> xadj(ncell+1, 0);
+  for (int i = 0; i < nedge; i++) {
+    if (ecell[2*i] == ecell[2*i+1]) continue; // boundary edge
+    xadj[ecell[2*i]+1]++;
+    xadj[ecell[2*i+1]+1]++;
+  }
+  for (int i = 0; i < ncell; i++) xadj[i+1] += xadj[i];
+  std::vector<idx_t> adjncy(xadj[ncell]);
+  std::vector<idx_t> fill(xadj.begin(), xadj.end()-1);
+  for (int i = 0; i < nedge; i++) {
+    if (ecell[2*i] == ecell[2*i+1]) continue;
+    adjncy[fill[ecell[2*i]]++] = ecell[2*i+1];
+    adjncy[fill[ecell[2*i+1]]++] = ecell[2*i];
+  }
+  idx_t options[METIS_NOPTIONS];
+  METIS_SetDefaultOptions(options);
+  options[METIS_OPTION_NUMBERING] = 0;
+  idx_t nvtxs = ncell, ncon = 1, np = nparts, edgecut = 0;
+  std::vector<idx_t> p(ncell);
+  if (METIS_PartGraphKway(&nvtxs, &ncon, &xadj[0], &adjncy[0], NULL, NULL, NULL, &np,
+                          NULL, NULL, options, &edgecut, &p[0]) != METIS_OK) {
+    printf("METIS failed to partition the mesh into %d parts\n", nparts);
+    exit(-1);
+  }
+  for (int i = 0; i < ncell; i++) part[i] = p[i];
+  printf("Partitioned the mesh into %d parts with METIS, edge-cut %d\n", nparts, (int)edgecut);
+#else
+  hsfcPartition(ncell, ccent, NULL, nparts, part);
+  int edgecut = 0;
+  for (int i = 0; i < nedge; i++)
+    if (part[ecell[2*i]] != part[ecell[2*i+1]]) edgecut++;
+  printf("Partitioned the mesh into %d parts along a Hilbert curve, edge-cut %d\n", nparts, edgecut);
+#endif
+}
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  if (argc < 2) {
     printf("Wrong parameters! Please specify the VOLNA configuration "
         "script filename with the *.vln extension, "
-        "e.g. ./volna2hdf5 bump.vln \n");
+        "e.g. ./volna2hdf5 bump.vln \n"
+        "Optionally list the numbers of MPI processes to precompute partitions for, "
+        "e.g. ./volna2hdf5 bump.vln 16 64 256 \n");
     exit(-1);
   }
 
@@ -160,6 +240,7 @@ int main(int argc, char **argv) {
   std::vector<int> event_post_update(num_events);
   std::vector < std::string > event_className(num_events);
   std::vector < std::string > event_formula(num_events);
+  std::vector < std::string > event_program(num_events);
   std::vector < std::string > event_streamName(num_events);
   int num_outputLocation = 0;
   std::string numbers("0123456789.");
@@ -184,6 +265,11 @@ int main(int argc, char **argv) {
     std::string temp;
     int str_i = e_p.formula.find("return");
     if (str_i >= 0 && str_i < e_p.formula.length()) {
+      // Program the solver compiles at startup, so that it does not have to
+      // be rebuilt with the formula headers written below
+      event_program[i] = sim.mesh.mathParser.compile(e_p.formula.begin(), e_p.formula.end());
+      if (event_program[i].empty())
+        printf("Formula of %s can not be stored as a program, the solver has to be rebuilt with it\n", e_p.className.c_str());
       str_i += 6;
       for (; str_i < e_p.formula.length(); str_i++) {
         temp = e_p.formula.substr(str_i, 1);
@@ -251,9 +337,38 @@ int main(int argc, char **argv) {
         //event_formula[i] = e_p.formula;
 		if (strcmp(e_p.className.c_str(), "OutputLocation") == 0) num_outputLocation++;
   }
-  // Initialize simulation: load mesh, calculate geometry data
-  sim.init();
-  op_printf("Initializing original volna code... done\n");
+  //
+  // Define HDF5 filenames
+  //
+  char *filename_h5 = (char*)malloc(strlen(file)+1); // gaussian_landslide.vln -->  gaussian_landslide.h5
+  strcpy(filename_h5, file);
+  const char* substituteIndexPattern = ".vln";
+  char* pos;
+  pos = strstr(filename_h5, substituteIndexPattern);
+  char substituteIndex[255];
+  sprintf(substituteIndex, ".h5");
+  strcpy(pos, substituteIndex);
+
+  // The mesh and geometry data only depend on the mesh, they are written to
+  // a separate file named after a hash of the mesh, placed next to the
+  // scenario file. Other scenarios on the same mesh reuse it as it is, once
+  // the hash stored in it has been checked against the mesh; a stale file
+  // is converted again.
+  char filename_mesh[1024];
+  char path_mesh[2048];
+  char mesh_hash[32];
+  mesh_filename(sim, filename_mesh, mesh_hash);
+  const char *slash = strrchr(filename_h5, '/');
+  sprintf(path_mesh, "%.*s%s", slash == NULL ? 0 : (int)(slash - filename_h5 + 1), filename_h5, filename_mesh);
+  FILE *fp_mesh = fopen(path_mesh, "r");
+  int reuse_mesh = fp_mesh != NULL;
+  if (reuse_mesh) fclose(fp_mesh);
+  if (reuse_mesh && !mesh_matches(path_mesh, mesh_hash)) {
+    op_printf("Mesh file %s does not match %s, converting the mesh again\n", path_mesh,
+              sim.MeshFileName != "" ? sim.MeshFileName.c_str() : "the rectangle");
+    remove(path_mesh);
+    reuse_mesh = 0;
+  }
 
   //
   ////////////// INITIALIZE OP2 DATA /////////////////////
@@ -282,143 +397,224 @@ int main(int argc, char **argv) {
   // Number of nodes, cells, edges and iterations
   int nnode = 0, ncell = 0, nedge = 0;
 
-  // Use this variable to obtain the no. nodes.
-  // E.g. sim.mesh.Nodes.size() would return invalid data
-  nnode = sim.mesh.NPoints;
-  ncell = sim.mesh.NVolumes;
-  nedge = sim.mesh.NFaces;
-
-  printf("GMSH file data statistics: \n");
-  printf("  No. nodes    = %d\n", nnode);
-  printf("  No. cells    = %d\n", ncell);
-  printf("Connectivity data statistics: \n");
-  printf("  No. of edges = %d\n", nedge);
-
-  // Arrays for mapping data
-  cell = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
-  ecell = (int*) malloc(N_CELLSPEREDGE * nedge * sizeof(int));
-  ccell = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
-  cedge = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
-  ccent = (float*) malloc(MESH_DIM * ncell * sizeof(float));
-  carea = (float*) malloc(ncell * sizeof(float));
-  enorm = (float*) malloc(MESH_DIM * nedge * sizeof(float));
-  ecent = (float*) malloc(MESH_DIM * nedge * sizeof(float));
-  eleng = (float*) malloc(nedge * sizeof(float));
-  isBoundary = (int*) malloc(nedge * sizeof(int));
-  initEta = (float*) malloc(ncell * sizeof(float));
-//  initBathymetry = (float*) malloc(ncell * sizeof(float));
-  initBathymetry = (float**) malloc(sizeof(float*));
-  initBathymetry[0] = (float*) malloc(ncell*sizeof(float));
-  x = (float*) malloc(MESH_DIM * nnode * sizeof(float));
-  w = (float*) malloc(N_STATEVAR * ncell * sizeof(float));
-  float *event_data;
-  event_data = (float*) malloc(ncell*sizeof(float));
-  int n_initBathymetry = 0; // Number of initBathymetry input files
+  if (reuse_mesh) {
+    check_init_formulas(sim);
+    op_printf("Reusing mesh file %s\n", path_mesh);
+    hid_t meshfile = H5Fopen(path_mesh, H5F_ACC_RDONLY, H5P_DEFAULT);
+    check_hdf5_error(H5LTread_dataset_int(meshfile, "nodes", &nnode));
+    check_hdf5_error(H5LTread_dataset_int(meshfile, "cells", &ncell));
+    check_hdf5_error(H5LTread_dataset_int(meshfile, "edges", &nedge));
+    cell = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
+    x = (float*) malloc(MESH_DIM * nnode * sizeof(float));
+    check_hdf5_error(H5LTread_dataset_int(meshfile, "cellsToNodes", cell));
+    check_hdf5_error(H5LTread_dataset_float(meshfile, "nodeCoords", x));
+    check_hdf5_error(H5Fclose(meshfile));
+  } else {
+    // Initialize simulation: load mesh, calculate geometry data
+    sim.init();
+    op_printf("Initializing original volna code... done\n");
+
+    // Use this variable to obtain the no. nodes.
+    // E.g. sim.mesh.Nodes.size() would return invalid data
+    nnode = sim.mesh.NPoints;
+    ncell = sim.mesh.NVolumes;
+    nedge = sim.mesh.NFaces;
+
+    printf("GMSH file data statistics: \n");
+    printf("  No. nodes    = %d\n", nnode);
+    printf("  No. cells    = %d\n", ncell);
+    printf("Connectivity data statistics: \n");
+    printf("  No. of edges = %d\n", nedge);
+
+    // Arrays for mapping data
+    cell = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
+    ecell = (int*) malloc(N_CELLSPEREDGE * nedge * sizeof(int));
+    ccell = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
+    cedge = (int*) malloc(N_NODESPERCELL * ncell * sizeof(int));
+    ccent = (float*) malloc(MESH_DIM * ncell * sizeof(float));
+    carea = (float*) malloc(ncell * sizeof(float));
+    enorm = (float*) malloc(MESH_DIM * nedge * sizeof(float));
+    ecent = (float*) malloc(MESH_DIM * nedge * sizeof(float));
+    eleng = (float*) malloc(nedge * sizeof(float));
+    isBoundary = (int*) malloc(nedge * sizeof(int));
+    x = (float*) malloc(MESH_DIM * nnode * sizeof(float));
+
+    //
+    ////////////// USE VOLNA FOR DATA IMPORT //////////////
+    //
+    int i = 0;
+    // Import node coordinates
+    for (i = 0; i < sim.mesh.NPoints; i++) {
+      x[i * MESH_DIM] = sim.mesh.Nodes[i+1].x();
+      x[i * MESH_DIM + 1] = sim.mesh.Nodes[i+1].y();
+      //    std::cout << i << "  x,y,z = " << sim.mesh.Nodes[i].x() << " "
+      //        << sim.mesh.Nodes[i].y() << " " << sim.mesh.Nodes[i].z()
+      //        << endl;
+    }
 
+    // Boost arrays for temporarly storing mesh data
+    boost::array<int, N_NODESPERCELL> vertices;
+    boost::array<int, N_NODESPERCELL> neighbors;
+    boost::array<int, N_NODESPERCELL> facet_ids;
+    for (i = 0; i < sim.mesh.NVolumes; i++) {
+
+      vertices = sim.mesh.Cells[i].vertices();
+      neighbors = sim.mesh.Cells[i].neighbors();
+      facet_ids = sim.mesh.Cells[i].facets();
+
+      cell[i * N_NODESPERCELL] = vertices[0]    -1;
+      cell[i * N_NODESPERCELL + 1] = vertices[1]-1;
+      cell[i * N_NODESPERCELL + 2] = vertices[2]-1;
+
+      ccell[i * N_NODESPERCELL] = neighbors[0];
+      ccell[i * N_NODESPERCELL + 1] = neighbors[1];
+      ccell[i * N_NODESPERCELL + 2] = neighbors[2];
+
+      cedge[i * N_NODESPERCELL] = facet_ids[0];
+      cedge[i * N_NODESPERCELL + 1] = facet_ids[1];
+      cedge[i * N_NODESPERCELL + 2] = facet_ids[2];
+
+      ccent[i * MESH_DIM] = sim.mesh.CellCenters.x(i);
+      ccent[i * MESH_DIM + 1] = sim.mesh.CellCenters.y(i);
+
+      carea[i] = sim.mesh.CellVolumes(i);
+
+      //    std::cout << "Cell " << i << " nodes = " << vertices[0] << " "
+      //        << vertices[1] << " " << vertices[2] << std::endl;
+      //    std::cout << "Cell " << i << " neighbours = " << neighbors[0]
+      //        << " " << neighbors[1] << " " << neighbors[2] << std::endl;
+      //    std::cout << "Cell " << i << " facets  = " << facet_ids[0] << " "
+      //        << facet_ids[1] << " " << facet_ids[2] << std::endl;
+      //    std::cout << "Cell " << i << " center  = [ "
+      //        << ccent[i * N_NODESPERCELL] << " , "
+      //        << ccent[i * N_NODESPERCELL + 1] << " ]" << std::endl;
+      //    std::cout << "Cell " << i << " area  = " << carea[i] << std::endl;
+      //    std::cout << "Cell " << i << " w = [H u v Zb] = [ "
+      //        << w[i * N_STATEVAR] << " " << w[i * N_STATEVAR + 1] << " "
+      //        << w[i * N_STATEVAR + 2] << " " << w[i * N_STATEVAR + 3]
+      //        << " ] " << std::endl;
+    }
 
-  //
-  ////////////// USE VOLNA FOR DATA IMPORT //////////////
-  //
-  int i = 0;
-  // Import node coordinates
-  for (i = 0; i < sim.mesh.NPoints; i++) {
-    x[i * MESH_DIM] = sim.mesh.Nodes[i+1].x();
-    x[i * MESH_DIM + 1] = sim.mesh.Nodes[i+1].y();
-    //    std::cout << i << "  x,y,z = " << sim.mesh.Nodes[i].x() << " "
-    //        << sim.mesh.Nodes[i].y() << " " << sim.mesh.Nodes[i].z()
-    //        << endl;
-  }
+    // Store edge data: edge-cell map, edge normal vectors
+    int leftCellId  = 0;
+    int rightCellId = 0;
+    for (i = 0; i < sim.mesh.NFaces; i++) {
+      leftCellId  = sim.mesh.Facets[i].LeftCell();
+      rightCellId = sim.mesh.Facets[i].RightCell();
+      ecell[i * N_CELLSPEREDGE]     = leftCellId;
+      /* If the right cell ID is -1, then the edge is a boundary edge.
+       * In this case make the right cell ID identical to the left, to
+       * avoid conflicts when using op_map.
+       */
+      if(rightCellId == -1) {
+        ecell[i * N_CELLSPEREDGE + 1] = leftCellId;
+        isBoundary[i] = 1;
+      } else {
+        ecell[i * N_CELLSPEREDGE + 1] = rightCellId;
+        isBoundary[i] = 0;
+      }
 
-  // Boost arrays for temporarly storing mesh data
-  boost::array<int, N_NODESPERCELL> vertices;
-  boost::array<int, N_NODESPERCELL> neighbors;
-  boost::array<int, N_NODESPERCELL> facet_ids;
-  if (sim.CellValues.H.size() < sim.mesh.NVolumes) printf("SMALLER %d %d\n", sim.CellValues.H.size(), sim.mesh.NVolumes);
-  for (i = 0; i < sim.mesh.NVolumes; i++) {
-
-    vertices = sim.mesh.Cells[i].vertices();
-    neighbors = sim.mesh.Cells[i].neighbors();
-    facet_ids = sim.mesh.Cells[i].facets();
-
-    cell[i * N_NODESPERCELL] = vertices[0]    -1;
-    cell[i * N_NODESPERCELL + 1] = vertices[1]-1;
-    cell[i * N_NODESPERCELL + 2] = vertices[2]-1;
-
-    ccell[i * N_NODESPERCELL] = neighbors[0];
-    ccell[i * N_NODESPERCELL + 1] = neighbors[1];
-    ccell[i * N_NODESPERCELL + 2] = neighbors[2];
-
-    cedge[i * N_NODESPERCELL] = facet_ids[0];
-    cedge[i * N_NODESPERCELL + 1] = facet_ids[1];
-    cedge[i * N_NODESPERCELL + 2] = facet_ids[2];
-
-    ccent[i * MESH_DIM] = sim.mesh.CellCenters.x(i);
-    ccent[i * MESH_DIM + 1] = sim.mesh.CellCenters.y(i);
-
-    carea[i] = sim.mesh.CellVolumes(i);
-
-    w[i * N_STATEVAR] = sim.CellValues.H(i);
-    w[i * N_STATEVAR + 1] = sim.CellValues.U(i);
-    w[i * N_STATEVAR + 2] = sim.CellValues.V(i);
-    w[i * N_STATEVAR + 3] = sim.CellValues.Zb(i);
-
-    //    std::cout << "Cell " << i << " nodes = " << vertices[0] << " "
-    //        << vertices[1] << " " << vertices[2] << std::endl;
-    //    std::cout << "Cell " << i << " neighbours = " << neighbors[0]
-    //        << " " << neighbors[1] << " " << neighbors[2] << std::endl;
-    //    std::cout << "Cell " << i << " facets  = " << facet_ids[0] << " "
-    //        << facet_ids[1] << " " << facet_ids[2] << std::endl;
-    //    std::cout << "Cell " << i << " center  = [ "
-    //        << ccent[i * N_NODESPERCELL] << " , "
-    //        << ccent[i * N_NODESPERCELL + 1] << " ]" << std::endl;
-    //    std::cout << "Cell " << i << " area  = " << carea[i] << std::endl;
-    //    std::cout << "Cell " << i << " w = [H u v Zb] = [ "
-    //        << w[i * N_STATEVAR] << " " << w[i * N_STATEVAR + 1] << " "
-    //        << w[i * N_STATEVAR + 2] << " " << w[i * N_STATEVAR + 3]
-    //        << " ] " << std::endl;
-  }
 
-  // Store edge data: edge-cell map, edge normal vectors
-  int leftCellId  = 0;
-  int rightCellId = 0;
-  for (i = 0; i < sim.mesh.NFaces; i++) {
-    leftCellId  = sim.mesh.Facets[i].LeftCell();
-    rightCellId = sim.mesh.Facets[i].RightCell();
-    ecell[i * N_CELLSPEREDGE]     = leftCellId;
-    /* If the right cell ID is -1, then the edge is a boundary edge.
-     * In this case make the right cell ID identical to the left, to
-     * avoid conflicts when using op_map.
-     */
-    if(rightCellId == -1) {
-      ecell[i * N_CELLSPEREDGE + 1] = leftCellId;
-      isBoundary[i] = 1;
-    } else {
-      ecell[i * N_CELLSPEREDGE + 1] = rightCellId;
-      isBoundary[i] = 0;
-    }
+      enorm[i * N_CELLSPEREDGE] = sim.mesh.FacetNormals.x(i);
+      enorm[i * N_CELLSPEREDGE + 1] = sim.mesh.FacetNormals.y(i);
 
+      ecent[i * N_CELLSPEREDGE] = sim.mesh.FacetCenters.x(i);
+      ecent[i * N_CELLSPEREDGE + 1] = sim.mesh.FacetCenters.y(i);
 
-    enorm[i * N_CELLSPEREDGE] = sim.mesh.FacetNormals.x(i);
-    enorm[i * N_CELLSPEREDGE + 1] = sim.mesh.FacetNormals.y(i);
+      eleng[i] = sim.mesh.FacetVolumes(i);
 
-    ecent[i * N_CELLSPEREDGE] = sim.mesh.FacetCenters.x(i);
-    ecent[i * N_CELLSPEREDGE + 1] = sim.mesh.FacetCenters.y(i);
+      //    std::cout << "Edge " << i << "   left cell = "
+      //        << sim.mesh.Facets[i].LeftCell() << "   right cell = "
+      //        << sim.mesh.Facets[i].RightCell() << std::endl;
+      //    std::cout << "Edge " << i << "   normal vector = [ "
+      //        << enorm[i * N_CELLSPEREDGE] << " , "
+      //        << enorm[i * N_CELLSPEREDGE + 1] << " ]" << std::endl;
+      //    std::cout << "Edge " << i << "   center vector = [ "
+      //        << ecent[i * N_CELLSPEREDGE] << " , "
+      //        << ecent[i * N_CELLSPEREDGE + 1] << " ]" << std::endl;
+      //    std::cout << "Edge " << i << "   length =  " << eleng[i]
+      //        << std::endl;
+    }
 
-    eleng[i] = sim.mesh.FacetVolumes(i);
 
-    //    std::cout << "Edge " << i << "   left cell = "
-    //        << sim.mesh.Facets[i].LeftCell() << "   right cell = "
-    //        << sim.mesh.Facets[i].RightCell() << std::endl;
-    //    std::cout << "Edge " << i << "   normal vector = [ "
-    //        << enorm[i * N_CELLSPEREDGE] << " , "
-    //        << enorm[i * N_CELLSPEREDGE + 1] << " ]" << std::endl;
-    //    std::cout << "Edge " << i << "   center vector = [ "
-    //        << ecent[i * N_CELLSPEREDGE] << " , "
-    //        << ecent[i * N_CELLSPEREDGE + 1] << " ]" << std::endl;
-    //    std::cout << "Edge " << i << "   length =  " << eleng[i]
-    //        << std::endl;
+    //
+    // Define OP2 sets, maps and datasets of the mesh, and write them to the mesh file
+    //
+    op_set nodes = op_decl_set(nnode, "nodes");
+    op_set edges = op_decl_set(nedge, "edges");
+    op_set cells = op_decl_set(ncell, "cells");
+
+    op_decl_map(cells, nodes, N_NODESPERCELL, cell,
+                        "cellsToNodes");
+    op_decl_map(edges, cells, N_CELLSPEREDGE, ecell,
+                "edgesToCells");
+    op_decl_map(cells, cells, N_NODESPERCELL, ccell,
+                "cellsToCells");
+    op_decl_map(cells, edges, N_NODESPERCELL, cedge,
+                "cellsToEdges");
+
+    op_decl_dat(cells, MESH_DIM, "float", ccent,
+                "cellCenters");
+    op_decl_dat(cells, 1, "float", carea, "cellVolumes");
+    op_decl_dat(edges, MESH_DIM, "float", enorm,
+                "edgeNormals");
+    op_decl_dat(edges, MESH_DIM, "float", ecent,
+                "edgeCenters");
+    op_decl_dat(edges, 1, "float", eleng, "edgeLength");
+    op_decl_dat(nodes, MESH_DIM, "float", x, "nodeCoords");
+    op_decl_dat(edges, 1, "int", isBoundary, "isBoundary");
+
+    op_printf("Writing mesh to HDF5 file: %s \n", path_mesh);
+    op_write_hdf5(path_mesh);
+    hid_t meshfile = H5Fopen(path_mesh, H5F_ACC_RDWR, H5P_DEFAULT);
+    check_hdf5_error(H5LTmake_dataset_string(meshfile, "meshHash", mesh_hash));
+    check_hdf5_error(H5LTmake_dataset_string(meshfile, "meshSource",
+                                             sim.MeshFileName != "" ? sim.MeshFileName.c_str() : "rectangle"));
+    check_hdf5_error(H5Fclose(meshfile));
   }
 
+  //
+  // Precompute partitions of the cells for the requested numbers of MPI
+  // processes, stored in the mesh file as partition<nparts> so the solver
+  // does not have to repartition when it runs on that many processes
+  //
+  if (argc > 2) {
+    if (ecell == NULL) {
+      hid_t meshfile = H5Fopen(path_mesh, H5F_ACC_RDONLY, H5P_DEFAULT);
+      ecell = (int*) malloc(N_CELLSPEREDGE * nedge * sizeof(int));
+      ccent = (float*) malloc(MESH_DIM * ncell * sizeof(float));
+      check_hdf5_error(H5LTread_dataset_int(meshfile, "edgesToCells", ecell));
+      check_hdf5_error(H5LTread_dataset_float(meshfile, "cellCenters", ccent));
+      check_hdf5_error(H5Fclose(meshfile));
+    }
+    hid_t meshfile = H5Fopen(path_mesh, H5F_ACC_RDWR, H5P_DEFAULT);
+    int *part = (int*) malloc(ncell * sizeof(int));
+    for (int k = 2; k < argc; k++) {
+      int nparts = atoi(argv[k]);
+      char name[32];
+      sprintf(name, "partition%d", nparts);
+      if (nparts < 2) {
+        printf("Ignoring partition count %s\n", argv[k]);
+      } else if (H5LTfind_dataset(meshfile, name) > 0) {
+        printf("Partitioning for %d processes already stored in %s\n", nparts, path_mesh);
+      } else {
+        partition_cells(ncell, nedge, ecell, ccent, nparts, part);
+        write_dat_hdf5(meshfile, name, ncell, 1, "int", H5T_NATIVE_INT, part);
+      }
+    }
+    free(part);
+    check_hdf5_error(H5Fclose(meshfile));
+  }
+
+  // Initial values are always zero, they are set by the Init events
+  w = (float*) calloc(N_STATEVAR * ncell, sizeof(float));
+  initEta = (float*) malloc(ncell * sizeof(float));
+  initBathymetry = (float**) malloc(sizeof(float*));
+  initBathymetry[0] = (float*) malloc(ncell*sizeof(float));
+  float *event_data;
+  event_data = (float*) malloc(ncell*sizeof(float));
+  int n_initBathymetry = 0; // Number of initBathymetry input files
+
   /*
    * If event data is stored in a file, import it and put in HDF5
    */
@@ -479,98 +675,59 @@ int main(int argc, char **argv) {
     }
   }
 
-  //
-  // Define OP2 sets
-  //
-  op_set nodes = op_decl_set(nnode, "nodes");
-  op_set edges = op_decl_set(nedge, "edges");
-  op_set cells = op_decl_set(ncell, "cells");
-
-
-	op_set outputLocation = NULL;
-	op_map outputLocation_map = NULL;
-	op_dat outputLocation_dat = NULL;
+  int *output_map = NULL;
+  float *output_dat = NULL;
 	if (num_outputLocation) {
-		float def = -1.0f*INFINITY;
-		int *output_map = (int *)malloc(num_outputLocation*sizeof(int));
-		float *output_dat = (float *)malloc(num_outputLocation*sizeof(float));
-		outputLocation = op_decl_set(num_outputLocation, "outputLocation");
-		for (int e = 0; e < ncell; e++) {
-			int j = 0;
-			for (int i = 0; i < event_className.size(); i++) {
-				if (strcmp(event_className[i].c_str(), "OutputLocation")) continue;
-				triangleIndex(&def, &event_location_x[i], &event_location_y[i], &x[2*cell[3*e]]
-							, &x[2*cell[3*e+1]], &x[2*cell[3*e+2]],	&w[4*e]);
-				if (def != -1.0f*INFINITY) {
-					output_map[j] = e;
-					def = -1.0f*INFINITY;
-					printf("Location %d found in cell %d\n", j, e);
-				}
-				j++;
+		output_map = (int *)malloc(num_outputLocation*sizeof(int));
+		output_dat = (float *)calloc(num_outputLocation, sizeof(float));
+		SpatialIndex index;
+		buildSpatialIndex(&index, x, cell, ncell);
+		int j = 0;
+		for (int i = 0; i < event_className.size(); i++) {
+			if (strcmp(event_className[i].c_str(), "OutputLocation")) continue;
+			int e = locateCell(&index, event_location_x[i], event_location_y[i]);
+			if (e >= 0) {
+				printf("Location %d found in cell %d\n", j, e);
+			} else {
+				e = nearestCell(&index, event_location_x[i], event_location_y[i], ncell);
+				printf("Warning: location %d (%g, %g) is outside the mesh, using nearest cell %d\n",
+						j, event_location_x[i], event_location_y[i], e);
 			}
+			output_map[j] = e;
+			j++;
 		}
-		outputLocation_map = op_decl_map(outputLocation, cells, 1, output_map, "outputLocation_map");
-		outputLocation_dat = op_decl_dat(outputLocation, 1, "float", output_dat, "outputLocation_dat");
 	}
 
-
-  //
-  // Define OP2 set maps
   //
-  op_decl_map(cells, nodes, N_NODESPERCELL, cell,
-                      "cellsToNodes");
-  op_decl_map(edges, cells, N_CELLSPEREDGE, ecell,
-              "edgesToCells");
-  op_decl_map(cells, cells, N_NODESPERCELL, ccell,
-              "cellsToCells");
-  op_decl_map(cells, edges, N_NODESPERCELL, cedge,
-              "cellsToEdges");
-  
+  // Write the scenario data (initial values, event data and gauges) to HDF5,
+  // with the same layout as op_write_hdf5 so the solver reads them with
+  // op_decl_*_hdf5, and the name of the mesh file it refers to
   //
-  // Define OP2 datasets
-  //
-  op_decl_dat(cells, MESH_DIM, "float", ccent,
-              "cellCenters");
-  op_decl_dat(cells, 1, "float", carea, "cellVolumes");
-  op_decl_dat(edges, MESH_DIM, "float", enorm,
-              "edgeNormals");
-  op_decl_dat(edges, MESH_DIM, "float", ecent,
-              "edgeCenters");
-  op_decl_dat(edges, 1, "float", eleng, "edgeLength");
-  op_decl_dat(nodes, MESH_DIM, "float", x, "nodeCoords");
-  op_decl_dat(cells, N_STATEVAR, "float", w, "values");
-  op_decl_dat(edges, 1, "int", isBoundary, "isBoundary");
-  op_decl_dat(cells, 1, "float", initEta, "initEta");
-  if(n_initBathymetry == 0) {
-    op_decl_dat(cells, 1, "float", initBathymetry[0], "initBathymetry");
-  } else if(n_initBathymetry == 1) {
-    op_decl_dat(cells, 1, "float", initBathymetry[0], "initBathymetry");
-  } else if (n_initBathymetry > 1){
+  op_printf("Writing data to HDF5 file: %s \n", filename_h5);
+  hid_t h5file;
+  h5file = H5Fcreate(filename_h5, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  check_hdf5_error(H5LTmake_dataset_string(h5file, "meshFile", filename_mesh));
+  int length = strlen(filename_mesh)+1;
+  check_hdf5_error(H5LTset_attribute_int(h5file, "meshFile", "length", &length, 1));
+  write_dat_hdf5(h5file, "values", ncell, N_STATEVAR, "float", H5T_NATIVE_FLOAT, w);
+  write_dat_hdf5(h5file, "initEta", ncell, 1, "float", H5T_NATIVE_FLOAT, initEta);
+  if (n_initBathymetry <= 1) {
+    write_dat_hdf5(h5file, "initBathymetry", ncell, 1, "float", H5T_NATIVE_FLOAT, initBathymetry[0]);
+  } else {
     for(int k=0; k<n_initBathymetry; k++) {
       char dat_name[255];
       // Store iniBathymetry data with sequential numbering instead of iteration step numbering
       sprintf(dat_name,"initBathymetry%d",k);
-      op_decl_dat(cells, 1, "float", initBathymetry[k], dat_name);
+      write_dat_hdf5(h5file, dat_name, ncell, 1, "float", H5T_NATIVE_FLOAT, initBathymetry[k]);
     }
   }
-
-  //
-  // Define HDF5 filename
-  //
-  char *filename_h5 = (char*)malloc(strlen(file)); // gaussian_landslide.vln -->  gaussian_landslide.h5
-  strcpy(filename_h5, file);
-  const char* substituteIndexPattern = ".vln";
-  char* pos;
-  pos = strstr(filename_h5, substituteIndexPattern);
-  char substituteIndex[255];
-  sprintf(substituteIndex, ".h5");
-  strcpy(pos, substituteIndex);
-  op_printf("Writing data to HDF5 file: %s \n", filename_h5);
-
-  //
-  // Write mesh and geometry data to HDF5
-  //
-  op_write_hdf5(filename_h5);
+  if (num_outputLocation) {
+    const hsize_t one = 1;
+    check_hdf5_error(H5LTmake_dataset_int(h5file, "outputLocation", 1, &one, &num_outputLocation));
+    write_dat_hdf5(h5file, "outputLocation_map", num_outputLocation, 1, "int", H5T_NATIVE_INT, output_map);
+    write_dat_hdf5(h5file, "outputLocation_dat", num_outputLocation, 1, "float", H5T_NATIVE_FLOAT, output_dat);
+  }
+  check_hdf5_error(H5Fclose(h5file));
 
   //
   // Read constants and write to HDF5
@@ -588,7 +745,6 @@ int main(int argc, char **argv) {
   op_write_const_hdf5("g", 1, "float", (char *) &g, filename_h5);
 
   //WRITING VALUES MANUALLY
-  hid_t h5file;
   h5file = H5Fopen(filename_h5, H5F_ACC_RDWR, H5P_DEFAULT);
   
   const hsize_t dims = 1;
@@ -659,7 +815,6 @@ int main(int argc, char **argv) {
 
   // Store event names and their value sources (formula or filename)
   char buffer[22];
-  int length = 0;
   for (unsigned int i = 0; i < event_className.size(); i++) {
     memset(buffer, 0, 22);
     sprintf(buffer, "event_className%d", i);
@@ -676,6 +831,13 @@ int main(int argc, char **argv) {
     check_hdf5_error(
         H5LTset_attribute_int(h5file, buffer, "length", &length, 1));
     memset(buffer, 0, 22);
+    sprintf(buffer, "event_program%d", i);
+    check_hdf5_error(
+        H5LTmake_dataset_string(h5file, buffer, event_program[i].c_str()));
+    length = strlen(event_program[i].c_str())+1;
+    check_hdf5_error(
+        H5LTset_attribute_int(h5file, buffer, "length", &length, 1));
+    memset(buffer, 0, 22);
     
     sprintf(buffer, "event_streamName%d", i);
     check_hdf5_error(
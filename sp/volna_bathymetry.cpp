@@ -0,0 +1,236 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <pthread.h>
+#include <limits.h>
+
+#ifdef VOLNA_CUDA
+void op_upload_dat(op_dat dat);
+#endif
+
+/*
+ * Streaming of time-dependent bathymetry (InitBathymetry with a %i stream
+ * pattern). Instead of declaring every initBathymetry%d frame, only the
+ * frames in use are held in an op_dat, and a background thread reads the
+ * next frame into a host buffer while the current ones are used. Memory use
+ * does not depend on the number of frames.
+ *
+ * With bathyInterp=linear|cubic the dat holds a window of the four frames
+ * k-1..k+2 around the current time (dim 4, cell-major), and Zb is
+ * interpolated between them in EvolveValuesRK2_2_bathy at every step instead
+ * of being replaced when a frame is due, so much sparser frames can be used.
+ *
+ * The frame dat and the global index of each cell are declared before
+ * op_partition, so after partitioning every process knows which elements
+ * of a frame it owns and reads only those.
+ */
+#define BATHY_WINDOW 4
+
+struct BathymetryStream {
+  hid_t file;
+  int nframes;
+  int interp;          // 0 - step, 1 - linear, 2 - cubic
+  int istart, istep;   // timer of the InitBathymetry event
+  int window;          // frames held per cell: 1, or BATHY_WINDOW when interpolating
+  op_dat frames;       // resident frames, cell-major
+  int ids[BATHY_WINDOW]; // frame held in each slot, -1 if none
+  int first;           // frame index of the first slot, before clamping
+  int n;               // number of owned cells
+  hsize_t *points;     // global indices of the owned cells, for H5Sselect_elements
+  float *next;         // prefetched frame
+  int nextFrame;
+  int pending;
+  pthread_t thread;
+};
+
+static BathymetryStream *bathymetryStream = NULL;
+
+static void read_frame(BathymetryStream *s, int k, float *data) {
+  char dat_name[255];
+  // iniBathymetry data is stored with sequential numbering instead of iteration step numbering!
+  sprintf(dat_name, "initBathymetry%d", k);
+  volna_hdf5_lock();
+  VOLNA_TRACE_BEGIN(read_t1);
+  hid_t dset = H5Dopen(s->file, dat_name, H5P_DEFAULT);
+  if (dset < 0) {
+    op_printf("dataset %s not found\n", dat_name);
+    exit(-1);
+  }
+  hid_t fspace = H5Dget_space(dset);
+  int rank = H5Sget_simple_extent_ndims(fspace);
+  hsize_t count = s->n;
+  if (rank == 1) {
+    check_hdf5_error(H5Sselect_elements(fspace, H5S_SELECT_SET, s->n, s->points));
+  } else {
+    // [ncell][1] layout: every point has a row and a column index
+    std::vector<hsize_t> points2(2 * s->n, 0);
+    for (int i = 0; i < s->n; i++) points2[2*i] = s->points[i];
+    check_hdf5_error(H5Sselect_elements(fspace, H5S_SELECT_SET, s->n, s->n ? &points2[0] : NULL));
+  }
+  hid_t mspace = H5Screate_simple(1, &count, NULL);
+  check_hdf5_error(H5Dread(dset, H5T_NATIVE_FLOAT, mspace, fspace, H5P_DEFAULT, data));
+  H5Sclose(mspace);
+  H5Sclose(fspace);
+  H5Dclose(dset);
+  VOLNA_TRACE_END(read_t1, "read initBathymetry", "io");
+  volna_hdf5_unlock();
+}
+
+static void *prefetch(void *arg) {
+  BathymetryStream *s = (BathymetryStream *)arg;
+  read_frame(s, s->nextFrame, s->next);
+  return NULL;
+}
+
+static int clamp_frame(BathymetryStream *s, int k) {
+  return MIN(MAX(k, 0), s->nframes - 1);
+}
+
+/*
+ * Move the window so that its first slot is frame first (clamped to the
+ * frames that exist). Frames already held are shifted within each cell,
+ * the one entering the window normally comes from the prefetch buffer.
+ */
+static void move_window(BathymetryStream *s, int first) {
+  if (first == s->first) return;
+  if (s->pending) {
+    pthread_join(s->thread, NULL);
+    s->pending = 0;
+  }
+  int w = s->window;
+  int ids[BATHY_WINDOW], from[BATHY_WINDOW];
+  float *src[BATHY_WINDOW];
+  for (int j = 0; j < w; j++) {
+    ids[j] = clamp_frame(s, first + j);
+    from[j] = -1;
+    src[j] = NULL;
+    for (int l = 0; l < w; l++)
+      if (s->ids[l] == ids[j]) from[j] = l;
+    if (from[j] >= 0) continue;
+    for (int l = 0; l < j; l++)
+      if (ids[l] == ids[j]) src[j] = src[l];
+    if (src[j] != NULL) continue;
+    if (ids[j] == s->nextFrame) {
+      src[j] = s->next;
+    } else {
+      // Only when the window jumps (the first time, or frames not used in order)
+      src[j] = (float *)malloc(s->n * sizeof(float));
+      read_frame(s, ids[j], src[j]);
+    }
+  }
+  float *data = (float *)s->frames->data;
+  for (int i = 0; i < s->n; i++) {
+    float old[BATHY_WINDOW];
+    for (int l = 0; l < w; l++) old[l] = data[i*w + l];
+    for (int j = 0; j < w; j++)
+      data[i*w + j] = from[j] >= 0 ? old[from[j]] : src[j][i];
+  }
+  for (int j = 0; j < w; j++) {
+    int owned = src[j] != NULL && src[j] != s->next;
+    for (int l = 0; l < j; l++)
+      if (src[l] == src[j]) owned = 0;
+    if (owned) free(src[j]);
+  }
+#ifdef VOLNA_CUDA
+  op_upload_dat(s->frames);
+#endif
+  memcpy(s->ids, ids, sizeof(ids));
+  s->first = first;
+  // Start reading the frame that enters the window next
+  s->nextFrame = -1;
+  int k = first + w;
+  if (k < s->nframes) {
+    s->nextFrame = k;
+    s->pending = 1;
+    pthread_create(&s->thread, NULL, prefetch, s);
+  }
+}
+
+/*
+ * Declare the resident frames and the global cell indices; has to be
+ * called before op_partition
+ */
+void bathymetry_stream_decl(op_set cells, int interp, op_dat *frames, op_dat *cellGlobalIndex) {
+  int window = interp ? BATHY_WINDOW : 1;
+  *frames = op_decl_dat(cells, window, "float",
+                        (float *)calloc((size_t)cells->size * window, sizeof(float)), "initBathymetryFrames");
+  *cellGlobalIndex = volna_decl_global_index(cells, "cellGlobalIndex");
+}
+
+void bathymetry_stream_open(const char *filename_h5, int nframes, int istart, int istep, int interp,
+                            op_set cells, op_dat frames, op_dat cellGlobalIndex) {
+  BathymetryStream *s = new BathymetryStream;
+  s->file = H5Fopen(filename_h5, H5F_ACC_RDONLY, H5P_DEFAULT);
+  s->nframes = nframes;
+  s->interp = interp;
+  s->istart = istart;
+  s->istep = istep;
+  s->window = frames->dim;
+  s->frames = frames;
+  for (int j = 0; j < BATHY_WINDOW; j++) s->ids[j] = -1;
+  s->first = INT_MIN;
+  s->n = cells->size;
+  s->points = (hsize_t *)malloc(s->n * sizeof(hsize_t));
+  for (int i = 0; i < s->n; i++)
+    s->points[i] = ((int *)cellGlobalIndex->data)[i];
+  s->next = (float *)malloc(s->n * sizeof(float));
+  s->nextFrame = 0;
+  s->pending = 1;
+  pthread_create(&s->thread, NULL, prefetch, s);
+  bathymetryStream = s;
+}
+
+/*
+ * Returns the dat holding frame k, and starts reading frame k+1
+ */
+op_dat bathymetry_stream_frame(int k) {
+  BathymetryStream *s = bathymetryStream;
+  move_window(s, k);
+  return s->frames;
+}
+
+int bathymetry_stream_interpolated() {
+  return bathymetryStream != NULL && bathymetryStream->interp;
+}
+
+/*
+ * Frames and weights giving Zb at timer iteration iter, as
+ * weights[0..3] applied to frames k-1..k+2 where k <= s < k+1 and
+ * s = (iter-istart)/istep. Returns NULL before the first frame is due,
+ * after the last one the bathymetry stays at the last frame.
+ */
+op_dat bathymetry_stream_interpolate(int iter, float *weights) {
+  BathymetryStream *s = bathymetryStream;
+  if (!bathymetry_stream_interpolated() || iter < s->istart) return NULL;
+  int k = (iter - s->istart) / s->istep;
+  float t = (float)((iter - s->istart) % s->istep) / s->istep;
+  if (k >= s->nframes - 1) {
+    k = s->nframes - 1;
+    t = 0.0f;
+  }
+  move_window(s, k - 1);
+  if (s->interp == 1) {
+    weights[0] = 0.0f;
+    weights[1] = 1.0f - t;
+    weights[2] = t;
+    weights[3] = 0.0f;
+  } else {
+    // Catmull-Rom spline, passes through the frames and has a continuous slope
+    float t2 = t * t, t3 = t2 * t;
+    weights[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+    weights[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+    weights[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+    weights[3] = 0.5f * (t3 - t2);
+  }
+  return s->frames;
+}
+
+void bathymetry_stream_close() {
+  BathymetryStream *s = bathymetryStream;
+  if (s == NULL) return;
+  if (s->pending) pthread_join(s->thread, NULL);
+  H5Fclose(s->file);
+  free(s->points);
+  free(s->next);
+  delete s;
+  bathymetryStream = NULL;
+}
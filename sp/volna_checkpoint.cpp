@@ -0,0 +1,276 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Checkpoint/restart. With checkpoint=filename the state of the simulation
+ * (cell values, maximum elevation, time, iteration, event timers and the
+ * length of the gauge files) is written every checkpointEvery=N iterations,
+ * and when a process gets SIGUSR1 (checkpoint and continue) or SIGTERM
+ * (checkpoint and stop, as sent by batch systems before the time limit).
+ *
+ * The cell data are gathered on rank 0 in the order of the cells in the
+ * input file, using the global cell index that follows the cells through
+ * op_partition, so restart=filename works with any number of processes.
+ * Rank 0 writes the file in a background thread while the simulation
+ * goes on; it is written under a temporary name and renamed when complete,
+ * so a crash while writing leaves the previous checkpoint intact.
+ */
+
+static volatile sig_atomic_t checkpoint_signal = 0; // 1 - SIGUSR1, 2 - SIGTERM
+
+static void checkpoint_handler(int sig) {
+  int request = sig == SIGTERM ? 2 : 1;
+  if (request > checkpoint_signal) checkpoint_signal = request;
+}
+
+struct Checkpoint {
+  char filename[1024];
+  int every;     // iterations between checkpoints, 0 - only on signals
+  int last;      // itercount of the last checkpoint
+  // State handed over to the writer thread
+  int ncell;
+  std::vector<float> values, maxElevation;
+  float timestamp;
+  int itercount;
+  int fused;
+  EventState events;
+  std::vector<long long> gaugeSizes;
+  op_dat rebalanceWeights;              // set by the load monitor, stops after the checkpoint
+  std::vector<float> partitionWeights;
+  pthread_t thread;
+  int pending;
+};
+
+static Checkpoint *checkpoint = NULL;
+
+static int comm_rank() {
+  int rank = 0;
+  if (volna_comm_size() > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return rank;
+}
+
+void volna_checkpoint_init(int argc, char **argv) {
+  const char *filename = volna_option(argc, argv, "checkpoint");
+  if (filename == NULL) return;
+  Checkpoint *c = new Checkpoint;
+  strncpy(c->filename, filename, sizeof(c->filename) - 1);
+  c->filename[sizeof(c->filename) - 1] = '\0';
+  const char *every = volna_option(argc, argv, "checkpointEvery");
+  c->every = every ? atoi(every) : 0;
+  c->last = itercount;
+  c->pending = 0;
+  c->rebalanceWeights = NULL;
+  signal(SIGUSR1, checkpoint_handler);
+  signal(SIGTERM, checkpoint_handler);
+  checkpoint = c;
+  op_printf("Checkpointing to %s every %d iterations and on SIGUSR1/SIGTERM\n", c->filename, c->every);
+}
+
+int volna_checkpoint_enabled() {
+  return checkpoint != NULL;
+}
+
+static void write_int(hid_t file, const char *name, int value) {
+  hsize_t one = 1;
+  check_hdf5_error(H5LTmake_dataset_int(file, name, 1, &one, &value));
+}
+
+static void write_array(hid_t file, const char *name, hid_t type, size_t n, const void *data) {
+  hsize_t dims = n;
+  check_hdf5_error(H5LTmake_dataset(file, name, 1, &dims, type, data));
+}
+
+static void *write_checkpoint(void *arg) {
+  Checkpoint *c = (Checkpoint *)arg;
+  char tmpname[1040];
+  sprintf(tmpname, "%s.tmp", c->filename);
+  volna_hdf5_lock();
+  VOLNA_TRACE_BEGIN(write_t1);
+  hid_t file = H5Fcreate(tmpname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (file < 0) {
+    volna_hdf5_unlock();
+    op_printf("can't create checkpoint file %s\n", tmpname);
+    return NULL;
+  }
+  hsize_t dims[2] = {(hsize_t)c->ncell, N_STATEVAR};
+  check_hdf5_error(H5LTmake_dataset_float(file, "values", 2, dims, &c->values[0]));
+  if (c->maxElevation.size() > 0)
+    check_hdf5_error(H5LTmake_dataset_float(file, "maxElevation", 1, dims, &c->maxElevation[0]));
+  hsize_t one = 1;
+  check_hdf5_error(H5LTmake_dataset_float(file, "timestamp", 1, &one, &c->timestamp));
+  write_int(file, "itercount", c->itercount);
+  write_int(file, "landslideFused", c->fused);
+  // Event timers
+  size_t nevents = c->events.fireIter.size();
+  write_int(file, "numEvents", (int)nevents);
+  write_int(file, "eventIter", (int)c->events.iter);
+  check_hdf5_error(H5LTmake_dataset_float(file, "eventTime", 1, &one, &c->events.t));
+  if (nevents > 0) {
+    write_array(file, "eventFireIter", H5T_NATIVE_UINT, nevents, &c->events.fireIter[0]);
+    write_array(file, "eventLocalTime", H5T_NATIVE_FLOAT, nevents, &c->events.localTime[0]);
+    write_array(file, "eventFinished", H5T_NATIVE_INT, nevents, &c->events.finished[0]);
+  }
+  if (c->gaugeSizes.size() > 0)
+    write_array(file, "gaugeSizes", H5T_NATIVE_LLONG, c->gaugeSizes.size(), &c->gaugeSizes[0]);
+  if (c->partitionWeights.size() > 0)
+    write_array(file, "partitionWeights", H5T_NATIVE_FLOAT, c->partitionWeights.size(), &c->partitionWeights[0]);
+  check_hdf5_error(H5Fclose(file));
+  VOLNA_TRACE_END(write_t1, "write checkpoint", "io");
+  volna_hdf5_unlock();
+  if (rename(tmpname, c->filename))
+    op_printf("can't rename checkpoint file %s\n", tmpname);
+  return NULL;
+}
+
+static void wait_checkpoint(Checkpoint *c) {
+  if (!c->pending) return;
+  pthread_join(c->thread, NULL);
+  c->pending = 0;
+}
+
+/*
+ * Called between two steps. Writes a checkpoint when one is due or was
+ * requested by a signal on any process, and returns 1 if the simulation
+ * has to stop (SIGTERM or rebalance).
+ */
+int volna_checkpoint_step(op_dat values, op_dat cellGlobalIndex, std::vector<EventParams> *events, int fused) {
+  Checkpoint *c = checkpoint;
+  if (c == NULL) return 0;
+  // A lagged time step may still be rolled back, the request waits for its check
+  if (volna_lagged_pending()) return 0;
+  int request = checkpoint_signal;
+  if (c->every > 0 && itercount - c->last >= c->every) request = MAX(request, 1);
+  if (c->rebalanceWeights != NULL) request = 2;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &request, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  if (request == 0) return 0;
+  checkpoint_signal = 0;
+
+  // The previous checkpoint has to be written before its buffers are reused
+  VOLNA_TRACE_BEGIN(gather_t1);
+  wait_checkpoint(c);
+  int ncell = values->set->size;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &ncell, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  c->ncell = ncell;
+  op_fetch_data(values);
+  volna_gather_cells(values, cellGlobalIndex, ncell, &c->values);
+  c->maxElevation.clear();
+  if (currentMaxElevation != NULL) {
+    op_fetch_data(currentMaxElevation);
+    volna_gather_cells(currentMaxElevation, cellGlobalIndex, ncell, &c->maxElevation);
+  }
+  c->partitionWeights.clear();
+  if (c->rebalanceWeights != NULL)
+    volna_gather_cells(c->rebalanceWeights, cellGlobalIndex, ncell, &c->partitionWeights);
+  c->last = itercount;
+  if (comm_rank() == 0) {
+    c->timestamp = timestamp;
+    c->itercount = itercount;
+    c->fused = fused;
+    save_events(&c->events);
+    // Gauge files are appended to, a restart cuts them back to this length
+    c->gaugeSizes.clear();
+    for (unsigned int i = 0; i < (*events).size(); i++) {
+      if ((*events)[i].type != EVENT_OUTPUT_LOCATION) continue;
+      struct stat st;
+      c->gaugeSizes.push_back(stat((*events)[i].streamName.c_str(), &st) ? -1 : (long long)st.st_size);
+    }
+    op_printf("Checkpoint at iteration %d, t = %g\n", itercount, timestamp);
+    c->pending = 1;
+    pthread_create(&c->thread, NULL, write_checkpoint, c);
+  }
+  VOLNA_TRACE_END(gather_t1, "gather checkpoint", "io");
+  if (request == 2) {
+    wait_checkpoint(c);
+    op_printf("Stopping after checkpoint (%s)\n", c->rebalanceWeights != NULL ? "rebalance" : "SIGTERM");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Write a checkpoint with the load of the cells and stop at the next call
+ * of volna_checkpoint_step; called on all processes
+ */
+void volna_checkpoint_rebalance(op_dat weights) {
+  if (checkpoint != NULL) checkpoint->rebalanceWeights = weights;
+}
+
+void volna_checkpoint_close() {
+  Checkpoint *c = checkpoint;
+  if (c == NULL) return;
+  wait_checkpoint(c);
+  delete c;
+  checkpoint = NULL;
+}
+
+/*
+ * Load the state written by volna_checkpoint_step; replaces the init
+ * events. Has to be called after op_partition and init_events.
+ */
+void volna_restart(const char *filename, op_dat values, op_dat cellGlobalIndex,
+                   std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *fused) {
+  // The bathymetry stream may already be prefetching its first frame
+  volna_hdf5_lock();
+  hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file < 0) {
+    op_printf("can't open checkpoint file %s\n", filename);
+    exit(-1);
+  }
+  int nevents = 0;
+  check_hdf5_error(H5LTread_dataset_int(file, "numEvents", &nevents));
+  if (nevents != (int)(*events).size()) {
+    op_printf("Checkpoint %s has %d events, the simulation has %d\n", filename, nevents, (int)(*events).size());
+    exit(-1);
+  }
+  volna_read_cells_hdf5(file, "values", values, cellGlobalIndex);
+  if (H5LTfind_dataset(file, "maxElevation") > 0) {
+    float *temp = NULL;
+    currentMaxElevation = op_decl_dat_temp(values->set, 1, "float", temp, "maxElevation");
+    volna_read_cells_hdf5(file, "maxElevation", currentMaxElevation, cellGlobalIndex);
+  }
+  check_hdf5_error(H5LTread_dataset_float(file, "timestamp", &timestamp));
+  check_hdf5_error(H5LTread_dataset_int(file, "itercount", &itercount));
+  check_hdf5_error(H5LTread_dataset_int(file, "landslideFused", fused));
+
+  EventState state;
+  int iter = 0;
+  check_hdf5_error(H5LTread_dataset_int(file, "eventIter", &iter));
+  state.iter = iter;
+  check_hdf5_error(H5LTread_dataset_float(file, "eventTime", &state.t));
+  state.fireIter.resize(nevents);
+  state.localTime.resize(nevents);
+  state.finished.resize(nevents);
+  if (nevents > 0) {
+    check_hdf5_error(H5LTread_dataset(file, "eventFireIter", H5T_NATIVE_UINT, &state.fireIter[0]));
+    check_hdf5_error(H5LTread_dataset_float(file, "eventLocalTime", &state.localTime[0]));
+    check_hdf5_error(H5LTread_dataset_int(file, "eventFinished", &state.finished[0]));
+  }
+  restore_events(timers, events, &state);
+
+  if (comm_rank() == 0 && H5LTfind_dataset(file, "gaugeSizes") > 0) {
+    int k = 0;
+    for (unsigned int i = 0; i < (*events).size(); i++)
+      if ((*events)[i].type == EVENT_OUTPUT_LOCATION) k++;
+    std::vector<long long> sizes(k);
+    if (k > 0)
+      check_hdf5_error(H5LTread_dataset(file, "gaugeSizes", H5T_NATIVE_LLONG, &sizes[0]));
+    k = 0;
+    for (unsigned int i = 0; i < (*events).size(); i++) {
+      if ((*events)[i].type != EVENT_OUTPUT_LOCATION) continue;
+      if (sizes[k] >= 0 && truncate((*events)[i].streamName.c_str(), sizes[k]))
+        op_printf("Warning: can't truncate gauge file %s\n", (*events)[i].streamName.c_str());
+      k++;
+    }
+  }
+  check_hdf5_error(H5Fclose(file));
+  volna_hdf5_unlock();
+  if (checkpoint != NULL) checkpoint->last = itercount;
+  op_printf("Restarted from %s at iteration %d, t = %g\n", filename, itercount, timestamp);
+}
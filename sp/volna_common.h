@@ -5,6 +5,10 @@
 #include <hdf5.h>
 #include <hdf5_hl.h>
 #include "op_lib_cpp.h"
+#include "volna_ensemble.h"
+#include "volna_lts.h"
+#include "volna_native.h"
+#include "volna_trace.h"
 
 //
 // Define meta data
@@ -34,6 +38,8 @@ extern op_dat currentMaxElevation;
 
 struct GaussianLandslideParams {
   float A, v, lx, ly, mesh_xmin;//TODO: mesh_xmin compute
+  float cutoff; // the Gaussian is ignored where it is below cutoff*A
+  int fused; // Zb was already updated at the end of the previous step (simulation_1_landslide)
 };
 
 struct TimerParams {
@@ -41,32 +47,120 @@ struct TimerParams {
   unsigned int istart, iend, istep, localIter, iter;
 };
 
+enum EventType {
+  EVENT_INIT_ETA, EVENT_INIT_U, EVENT_INIT_V, EVENT_INIT_BATHYMETRY, EVENT_INIT_BORE,
+  EVENT_INIT_GAUSSIAN_LANDSLIDE, EVENT_OUTPUT_TIME, EVENT_OUTPUT_CONSERVED_QUANTITIES,
+  EVENT_OUTPUT_LOCATION, EVENT_OUTPUT_SIMULATION, EVENT_OUTPUT_MAX_ELEVATION, EVENT_UNKNOWN
+};
+
 struct EventParams {
   float location_x, location_y;
   int post_update;
   std::string className;
   std::string formula;
   std::string streamName;
+  std::string program; // formula in postfix form, compiled at startup (volna_formula.cpp)
+  int type;            // EventType of className, set by init_events
+  int gaugeId;         // OutputLocation: index into outputLocation_dat
 };
 
 int timer_happens(TimerParams *p);
+struct EventState {
+  unsigned int iter;
+  float t;
+  std::vector<unsigned int> fireIter;
+  std::vector<float> localTime;
+  std::vector<int> finished;
+};
+
+void init_events(std::vector<TimerParams> *timers, std::vector<EventParams> *events);
+void save_events(EventState *state);
+void restore_events(std::vector<TimerParams> *timers, std::vector<EventParams> *events, const EventState *state);
+int event_happens_next(std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                       int type, float timeIncrement);
+int events_due_next(std::vector<TimerParams> *timers, float timeIncrement);
 void read_events_hdf5(hid_t h5file, int num_events, std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *num_outputLocation);
+void read_mesh_filename(hid_t h5file, const char *filename_h5, char *filename_mesh);
+int volna_comm_size();
+void volna_partition(int argc, char **argv, hid_t file, hid_t meshfile,
+                     op_set cells, op_set edges, op_map edgesToCells, op_dat cellCenters);
+hid_t volna_open_hdf5(const char *filename);
+op_set volna_decl_set_hdf5(hid_t file, const char *name);
+op_map volna_decl_map_hdf5(op_set from, op_set to, int dim, hid_t file, const char *name);
+op_dat volna_decl_dat_hdf5(op_set set, int dim, const char *type, hid_t file, const char *name);
+op_dat volna_decl_global_index(op_set set, const char *name);
+void volna_gather_cells(op_dat dat, op_dat cellGlobalIndex, int ncell, std::vector<float> *out);
+void volna_read_rows_hdf5(hid_t file, const char *name, hid_t type, int n, const int *gidx, int dim, void *data);
+void volna_read_cells_hdf5(hid_t file, const char *name, op_dat dat, op_dat cellGlobalIndex);
+void volna_hdf5_lock();
+void volna_hdf5_unlock();
+void bathymetry_stream_decl(op_set cells, int interp, op_dat *frames, op_dat *cellGlobalIndex);
+void bathymetry_stream_open(const char *filename_h5, int nframes, int istart, int istep, int interp,
+                            op_set cells, op_dat frames, op_dat cellGlobalIndex);
+op_dat bathymetry_stream_frame(int k);
+int bathymetry_stream_interpolated();
+op_dat bathymetry_stream_interpolate(int iter, float *weights);
+void bathymetry_stream_close();
+const char *volna_option(int argc, char **argv, const char *key);
+void read_gauges_file(const char *filename, std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *num_gauges);
+void locate_gauges(std::vector<EventParams> *events, int first, int num_gauges, int *output_map,
+                   op_set cells, op_dat nodeCoords, op_map cellsToNodes);
 void processEvents(std::vector<TimerParams> *timers, std::vector<EventParams> *events, int firstTime, int updateTimers,
- 									 float timeIncrement, int removeFinished, int initPrePost, op_set cells, op_dat values, op_dat cellVolumes,
+ 									 float timeIncrement, int initPrePost, op_set cells, op_dat values, op_dat cellVolumes,
 									 op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes, op_dat temp_initEta, op_dat* temp_initBathymetry,
 									 int n_initBathymetry, BoreParams bore_params, GaussianLandslideParams gaussian_landslide_params, op_map outputLocation_map,
 									 op_dat outputLocation_dat);
 
+void volna_checkpoint_init(int argc, char **argv);
+int volna_checkpoint_enabled();
+int volna_checkpoint_step(op_dat values, op_dat cellGlobalIndex, std::vector<EventParams> *events, int fused);
+void volna_checkpoint_rebalance(op_dat weights);
+void volna_checkpoint_close();
+#define VOLNA_REBALANCE_EXIT 3 // exit status asking for a restart from the checkpoint
+void volna_rebalance_init(int argc, char **argv, op_set cells);
+void volna_rebalance_step(op_dat values);
+int volna_rebalance_status();
+void volna_rebalance_close();
+void volna_restart(const char *filename, op_dat values, op_dat cellGlobalIndex,
+                   std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *fused);
+
+void volna_ensemble_init(int argc, char **argv, std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                         op_set cells, op_set edges, op_dat cellGlobalIndex, op_dat cellVolumes,
+                         op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes, op_map outputLocation_map);
+void volna_ensemble_start(op_dat values);
+int volna_ensemble_size();
+float volna_ensemble_step(op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges,
+                          op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                          op_dat maxEdgeEigenvalues, op_dat values);
+op_dat volna_ensemble_gauges(op_map outputLocation_map);
+void volna_ensemble_close(int argc, char **argv, op_dat cellGlobalIndex);
+
+void volna_service_init(int argc, char **argv);
+int volna_service_enabled();
+int volna_service_next(int argc, char **argv, std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                       float *ftime, float *dtmax, BoreParams *bore_params,
+                       GaussianLandslideParams *gaussian_landslide_params,
+                       op_set cells, op_dat values, op_dat cellGlobalIndex, op_dat cellVolumes,
+                       op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes,
+                       op_dat *temp_initEta, op_dat **temp_initBathymetry, int *n_initBathymetry,
+                       op_map outputLocation_map, op_dat outputLocation_dat);
+void volna_service_close();
+
+void volna_formula_init(int argc, char **argv, std::vector<EventParams> *events);
+op_dat volna_formula_eval(EventParams *event, op_set cells, op_dat cellCenters);
+void volna_formula_free();
+
 void InitEta(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile);
-void InitU(op_set cells, op_dat cellCenters, op_dat values);
-void InitV(op_set cells, op_dat cellCenters, op_dat values);
+void InitU(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile);
+void InitV(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile);
 void InitBathymetry(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile, int firstTime);
+void InitBathymetryFrames(op_set cells, op_dat values, op_dat frames, float *weights, int firstTime);
 void InitBore(op_set cells, op_dat cellCenters, op_dat values, BoreParams params);
 void InitGaussianLandslide(op_set cells, op_dat cellCenters, op_dat values, GaussianLandslideParams params, int firstTime);
 
 void OutputTime(TimerParams *timer);
 void OutputConservedQuantities(op_set cells, op_dat cellVolumes, op_dat values);
-void OutputLocation(EventParams *event, int eventid, TimerParams* timer, op_set cells, op_dat nodeCoords, op_map cellsToNodes, op_dat values, op_map outputLocation_map, op_dat outputLocation_dat);
+void OutputLocation(int n, EventParams **events, TimerParams **timers, op_dat values, op_map outputLocation_map, op_dat outputLocation_dat);
 void OutputSimulation(int type, EventParams *event, TimerParams* timer, op_dat nodeCoords, op_map cellsToNodes, op_dat values);
 void OutputMaxElevation(EventParams *event, TimerParams* timer, op_dat nodeCoords, op_map cellsToNodes, op_dat values, op_set cells);
 float normcomp(op_dat dat, int off);
@@ -76,6 +170,64 @@ void spaceDiscretization(op_dat data_in, op_dat data_out, float *minTimestep,
     op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
     op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
     op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges, int most);
+void volna_linear_init(int argc, char **argv, op_set edges, op_map edgesToCells, op_dat isBoundary, op_dat values);
+void volna_linear_update(op_dat values);
+int volna_linear_enabled();
+void volna_linear_close();
+void volna_lagged_init(int argc, char **argv, op_set cells, int supported);
+int volna_lagged_enabled();
+int volna_lagged_pending();
+float volna_lagged_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary, op_set cells, op_set edges,
+                        op_map edgesToCells, op_map cellsToEdges, float dtmax, float ftime,
+                        std::vector<TimerParams> *timers, std::vector<EventParams> *events);
+void volna_lagged_close();
+void volna_native_init(int argc, char **argv, op_dat values, op_dat out,
+    op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
+    op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+    op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges);
+void volna_tune_init(int argc, char **argv, op_set cells);
+void volna_tune_close();
+void volna_numa_init(int argc, char **argv, int ndats, op_dat *dats, int nmaps, op_map *maps);
+#define VOLNA_REPORT_SOLVER 0 // phases of the wall time in the performance report
+#define VOLNA_REPORT_EVENTS 1
+#define VOLNA_REPORT_OUTPUT 2
+#define VOLNA_REPORT_PHASES 3
+void volna_report_init(int argc, char **argv, op_set cells, op_set edges);
+void volna_report_time(int phase, double seconds);
+void volna_report_write(double wall);
+void volna_trace_init(int argc, char **argv);
+void volna_trace_close();
+void volna_lts_init(int argc, char **argv, op_set cells, op_set edges);
+int volna_lts_enabled();
+float volna_lts_step(op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges,
+                     op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                     op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
+                     op_dat values, float dtmax);
+void volna_lts_close();
+void volna_tiling_init(int argc, char **argv, op_set cells, op_set edges, op_map edgesToCells,
+                       op_map cellsToEdges, int supported);
+int volna_tiling_enabled();
+float volna_tiling_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary);
+void volna_tiling_close();
+void volna_replay_init(int argc, char **argv, op_set cells, op_set edges, op_map edgesToCells,
+                       op_map cellsToEdges, int supported);
+int volna_replay_enabled();
+float volna_replay_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary);
+void volna_replay_close();
+void volna_halo_init(int argc, char **argv, const char *filename_mesh, op_set cells, op_dat cellGlobalIndex,
+                     int supported);
+int volna_halo_enabled();
+float volna_halo_step(op_dat values, op_dat values_new);
+void volna_halo_close();
 
 //
 //helper functions
@@ -0,0 +1,13 @@
+#ifndef VOLNA_ENSEMBLE_H
+#define VOLNA_ENSEMBLE_H
+
+// Number of scenarios advanced together in ensemble mode (ensemble=), fixed
+// at compile time as the kernels loop over the members of a cell
+#ifndef VOLNA_ENSEMBLE
+#define VOLNA_ENSEMBLE 8
+#endif
+
+// Cell values in ensemble mode: [member][H, U, V, Zb] for every cell
+#define VOLNA_ENSEMBLE_DIM (4*VOLNA_ENSEMBLE)
+
+#endif
@@ -0,0 +1,417 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+#include "volna_common.h"
+#include "computeFluxes.h"
+#include "NumericalFluxes.h"
+#include "SpaceDiscretization.h"
+#include "EvolveValuesRK2_1.h"
+#include "EvolveValuesRK2_2.h"
+#include "simulation_1.h"
+#include "getMaxElevation.h"
+#include "gatherLocations.h"
+#include "computeFluxes_ens.h"
+#include "NumericalFluxes_ens.h"
+#include "SpaceDiscretization_ens.h"
+#include "EvolveValuesRK2_1_ens.h"
+#include "EvolveValuesRK2_2_ens.h"
+#include "simulation_1_ens.h"
+#include "initMember_ens.h"
+#include "gatherLocations_ens.h"
+#include <mpi.h>
+
+#include "op_lib_cpp.h"
+//int op2_stride = 1;
+//#define OP2_STRIDE(arr, idx) arr[op2_stride*(idx)]
+
+//
+// op_par_loop declarations
+//
+
+void op_par_loop_initMember_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_computeFluxes_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_NumericalFluxes_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_SpaceDiscretization_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_EvolveValuesRK2_1_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_EvolveValuesRK2_2_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_simulation_1_ens(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_gatherLocations_ens(char const *, op_set,
+  op_arg,
+  op_arg );
+
+/*
+ * Ensemble mode (ensemble=listfile): the scenarios listed in the file, one
+ * HDF5 file per line, are advanced together with the one given on the
+ * command line, which is member 0. They have to be on the same mesh. The
+ * values of a cell are stored as [member][H, U, V, Zb], so the mesh, maps
+ * and edge geometry are read once per step for all members, and the
+ * kernels loop over the members of a cell.
+ *
+ * All members use the smallest time step of the ensemble. The Init events
+ * of every scenario are applied at the start; Init events that happen
+ * later (streamed bathymetry, landslides) are not supported. The events of
+ * member 0 run as usual on its values, OutputLocation gauges write one
+ * column per member, and the maximum elevation of every member is written
+ * at the end (ensembleMaxElevation=filename).
+ */
+
+struct Ensemble {
+  int size;                    // number of scenarios, at most VOLNA_ENSEMBLE
+  op_dat values, valuesNew;    // [cell][member][H, U, V, Zb]
+  op_dat midPointConservative, inConservative, outConservative, midPoint;
+  op_dat bathySource, edgeFluxes;
+  op_dat maxElevation;         // [cell][member]
+  op_dat gauges;               // [gauge][member], H + Zb at the OutputLocation gauges
+};
+
+static Ensemble *ensemble = NULL;
+
+static int global_size(op_set set) {
+  int n = set->size;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &n, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  return n;
+}
+
+/*
+ * The members only share the time stepping, so their Init events have to
+ * be done before the first step
+ */
+static void check_init_events(std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                              const char *filename) {
+  for (unsigned int i = 0; i < (*events).size(); i++) {
+    if ((*events)[i].post_update) continue;
+    TimerParams *p = &(*timers)[i];
+    int once = p->istart == 0 && p->start <= 0.0f && (p->iend <= 1 || p->end <= 0.0f);
+    if (!once || strstr((*events)[i].streamName.c_str(), "%i") != NULL ||
+        (*events)[i].className == "InitGaussianLandslide") {
+      op_printf("%s: %s changes the state after the first step, which is not supported in ensemble mode "
+                "(use iend=1 for Init events applied at the start)\n", filename, (*events)[i].className.c_str());
+      exit(-1);
+    }
+  }
+}
+
+static void set_member(op_dat values, int member) {
+  op_par_loop_initMember_ens("initMember_ens",values->set,
+             op_arg_dat(values,-1,OP_ID,4,"float",OP_READ),
+             op_arg_dat(ensemble->values,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_RW),
+             op_arg_dat(ensemble->maxElevation,-1,OP_ID,VOLNA_ENSEMBLE,"float",OP_RW),
+             op_arg_gbl(&member,1,"int",OP_READ));
+}
+
+/*
+ * Run the Init events of the scenario in filename on values. The cell data
+ * stored in the file are read by global cell index, as the cells have
+ * already been partitioned.
+ */
+static void init_member(int argc, char **argv, const char *filename, op_set cells, op_dat values,
+                        op_dat cellGlobalIndex, op_dat cellVolumes, op_dat cellCenters,
+                        op_dat nodeCoords, op_map cellsToNodes) {
+  hid_t file = volna_open_hdf5(filename);
+  int num_events = 0, num_outputLocation = 0;
+  check_hdf5_error(H5LTread_dataset_int(file, "numEvents", &num_events));
+  std::vector<TimerParams> timers(num_events);
+  std::vector<EventParams> events(num_events);
+  read_events_hdf5(file, num_events, &timers, &events, &num_outputLocation);
+  // The outputs are the ones of member 0
+  for (int i = num_events - 1; i >= 0; i--) {
+    if (!events[i].post_update) continue;
+    timers.erase(timers.begin() + i);
+    events.erase(events.begin() + i);
+  }
+  check_init_events(&timers, &events, filename);
+
+  hsize_t dims[2];
+  check_hdf5_error(H5LTget_dataset_info(file, "values", dims, NULL, NULL));
+  if ((int)dims[0] != global_size(cells)) {
+    op_printf("%s has %d cells, the mesh of the ensemble has %d\n", filename, (int)dims[0], global_size(cells));
+    exit(-1);
+  }
+  // All members take the same time step and share the kernel constants
+  float cfl, gravity;
+  check_hdf5_error(H5LTread_dataset_float(file, "CFL", &cfl));
+  check_hdf5_error(H5LTread_dataset_float(file, "g", &gravity));
+  if (cfl != CFL || gravity != g) {
+    op_printf("%s has CFL = %g and g = %g, member 0 has %g and %g\n", filename, cfl, gravity, CFL, g);
+    exit(-1);
+  }
+  volna_read_cells_hdf5(file, "values", values, cellGlobalIndex);
+
+  BoreParams bore_params;
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsx0", &bore_params.x0));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsHl", &bore_params.Hl));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsul", &bore_params.ul));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsvl", &bore_params.vl));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsS", &bore_params.S));
+  GaussianLandslideParams gaussian_landslide_params = GaussianLandslideParams();
+
+  float *tmp_elem = NULL;
+  op_dat temp_initEta = NULL, temp_initBathymetry = NULL;
+  for (unsigned int i = 0; i < events.size(); i++) {
+    if (events[i].streamName.empty()) continue;
+    if (events[i].className == "InitEta" && temp_initEta == NULL) {
+      temp_initEta = op_decl_dat_temp(cells, 1, "float", tmp_elem, "initEta");
+      volna_read_cells_hdf5(file, "initEta", temp_initEta, cellGlobalIndex);
+    } else if (events[i].className == "InitBathymetry" && temp_initBathymetry == NULL) {
+      temp_initBathymetry = op_decl_dat_temp(cells, 1, "float", tmp_elem, "initBathymetry");
+      volna_read_cells_hdf5(file, "initBathymetry", temp_initBathymetry, cellGlobalIndex);
+    }
+  }
+  check_hdf5_error(H5Fclose(file));
+
+  volna_formula_init(argc, argv, &events);
+  init_events(&timers, &events);
+  processEvents(&timers, &events, 1/*firstTime*/, 1/*update timers*/, 0.0/*=dt*/, 2/*init loop, not pre/post*/,
+                cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes, temp_initEta,
+                &temp_initBathymetry, temp_initBathymetry != NULL, bore_params, gaussian_landslide_params, NULL, NULL);
+
+  if (temp_initEta != NULL && op_free_dat_temp(temp_initEta) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", temp_initEta->name);
+  if (temp_initBathymetry != NULL && op_free_dat_temp(temp_initBathymetry) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", temp_initBathymetry->name);
+}
+
+/*
+ * Read the other scenarios of the ensemble and run their Init events,
+ * before the ones of member 0. Does nothing without the ensemble= option.
+ */
+void volna_ensemble_init(int argc, char **argv, std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                         op_set cells, op_set edges, op_dat cellGlobalIndex, op_dat cellVolumes,
+                         op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes, op_map outputLocation_map) {
+  const char *listname = volna_option(argc, argv, "ensemble");
+  if (listname == NULL) return;
+  FILE *fp = fopen(listname, "r");
+  if (fp == NULL) {
+    op_printf("can't open ensemble list %s\n", listname);
+    exit(-1);
+  }
+  std::vector<std::string> files;
+  char filename[1024];
+  while (fscanf(fp, "%1023s", filename) == 1) files.push_back(filename);
+  fclose(fp);
+  if (files.size() + 1 > VOLNA_ENSEMBLE) {
+    op_printf("Ensemble of %d scenarios, at most %d are supported (build with -DVOLNA_ENSEMBLE=N)\n",
+              (int)files.size() + 1, VOLNA_ENSEMBLE);
+    exit(-1);
+  }
+  check_init_events(timers, events, argv[1]);
+
+  Ensemble *e = new Ensemble;
+  ensemble = e;
+  e->size = files.size() + 1;
+  float *tmp_elem = NULL;
+  e->values = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "valuesEns");
+  e->valuesNew = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "valuesNewEns");
+  e->midPointConservative = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "midPointConservativeEns");
+  e->inConservative = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "inConservativeEns");
+  e->outConservative = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "outConservativeEns");
+  e->midPoint = op_decl_dat_temp(cells, VOLNA_ENSEMBLE_DIM, "float", tmp_elem, "midPointEns");
+  e->bathySource = op_decl_dat_temp(edges, 2*VOLNA_ENSEMBLE, "float", tmp_elem, "bathySourceEns");
+  e->edgeFluxes = op_decl_dat_temp(edges, 3*VOLNA_ENSEMBLE, "float", tmp_elem, "edgeFluxesEns");
+  e->maxElevation = op_decl_dat_temp(cells, VOLNA_ENSEMBLE, "float", tmp_elem, "maxElevationEns");
+  e->gauges = NULL;
+  if (outputLocation_map != NULL)
+    e->gauges = op_decl_dat_temp(outputLocation_map->from, VOLNA_ENSEMBLE, "float", tmp_elem, "outputLocationEns");
+
+  op_dat memberValues = op_decl_dat_temp(cells, 4, "float", tmp_elem, "memberValues");
+  for (unsigned int k = 0; k < files.size(); k++) {
+    init_member(argc, argv, files[k].c_str(), cells, memberValues, cellGlobalIndex,
+                cellVolumes, cellCenters, nodeCoords, cellsToNodes);
+    set_member(memberValues, k + 1);
+  }
+  if (op_free_dat_temp(memberValues) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", memberValues->name);
+
+  // The members used the scheduler for their Init events
+  init_events(timers, events);
+  op_printf("Ensemble of %d scenarios (%d lanes)\n", e->size, VOLNA_ENSEMBLE);
+}
+
+/*
+ * Copy member 0 into the ensemble after its Init events; the lanes without
+ * a scenario of their own repeat it
+ */
+void volna_ensemble_start(op_dat values) {
+  if (ensemble == NULL) return;
+  set_member(values, 0);
+  for (int m = ensemble->size; m < VOLNA_ENSEMBLE; m++)
+    set_member(values, m);
+}
+
+int volna_ensemble_size() {
+  return ensemble != NULL ? ensemble->size : 0;
+}
+
+/*
+ * spaceDiscretization (volna_simulation.cpp) for all members
+ */
+static void space_discretization_ens(op_dat data_in, op_dat data_out, float *minTimestep, op_dat maxEdgeEigenvalues,
+                                     op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                                     op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges) {
+  Ensemble *e = ensemble;
+  *minTimestep = INFINITY;
+  op_par_loop_computeFluxes_ens("computeFluxes_ens",edges,
+             op_arg_dat(data_in,0,edgesToCells,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(data_in,1,edgesToCells,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(edgeLength,-1,OP_ID,1,"float",OP_READ),
+             op_arg_dat(edgeNormals,-1,OP_ID,2,"float",OP_READ),
+             op_arg_dat(isBoundary,-1,OP_ID,1,"int",OP_READ),
+             op_arg_dat(e->bathySource,-1,OP_ID,2*VOLNA_ENSEMBLE,"float",OP_WRITE),
+             op_arg_dat(e->edgeFluxes,-1,OP_ID,3*VOLNA_ENSEMBLE,"float",OP_WRITE),
+             op_arg_dat(maxEdgeEigenvalues,-1,OP_ID,1,"float",OP_WRITE));
+
+  op_par_loop_NumericalFluxes_ens("NumericalFluxes_ens",cells,
+             op_arg_dat(maxEdgeEigenvalues,-3,cellsToEdges,1,"float",OP_READ),
+             op_arg_dat(edgeLength,-3,cellsToEdges,1,"float",OP_READ),
+             op_arg_dat(cellVolumes,-1,OP_ID,1,"float",OP_READ),
+             op_arg_dat(data_out,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_WRITE),
+             op_arg_gbl(minTimestep,1,"float",OP_MIN));
+
+  op_par_loop_SpaceDiscretization_ens("SpaceDiscretization_ens",edges,
+             op_arg_dat(data_out,0,edgesToCells,VOLNA_ENSEMBLE_DIM,"float",OP_INC),
+             op_arg_dat(data_out,1,edgesToCells,VOLNA_ENSEMBLE_DIM,"float",OP_INC),
+             op_arg_dat(e->edgeFluxes,-1,OP_ID,3*VOLNA_ENSEMBLE,"float",OP_READ),
+             op_arg_dat(e->bathySource,-1,OP_ID,2*VOLNA_ENSEMBLE,"float",OP_READ),
+             op_arg_dat(edgeNormals,-1,OP_ID,2,"float",OP_READ),
+             op_arg_dat(isBoundary,-1,OP_ID,1,"int",OP_READ),
+             op_arg_dat(cellVolumes,-2,edgesToCells,1,"float",OP_READ));
+}
+
+/*
+ * One RK2 step of every member, returns the time step. values gets the new
+ * values of member 0 for its events.
+ */
+float volna_ensemble_step(op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges,
+                          op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                          op_dat maxEdgeEigenvalues, op_dat values) {
+  Ensemble *e = ensemble;
+  float minTimestep = 0.0;
+  space_discretization_ens(e->values, e->midPointConservative, &minTimestep, maxEdgeEigenvalues,
+                           edgeNormals, edgeLength, cellVolumes, isBoundary,
+                           cells, edges, edgesToCells, cellsToEdges);
+  float dT = CFL * minTimestep;
+
+  op_par_loop_EvolveValuesRK2_1_ens("EvolveValuesRK2_1_ens",cells,
+             op_arg_gbl(&dT,1,"float",OP_READ),
+             op_arg_dat(e->midPointConservative,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_RW),
+             op_arg_dat(e->values,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(e->inConservative,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_WRITE),
+             op_arg_dat(e->midPoint,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_WRITE));
+
+  float dummy = 0.0;
+  space_discretization_ens(e->midPoint, e->outConservative, &dummy, maxEdgeEigenvalues,
+                           edgeNormals, edgeLength, cellVolumes, isBoundary,
+                           cells, edges, edgesToCells, cellsToEdges);
+
+  op_par_loop_EvolveValuesRK2_2_ens("EvolveValuesRK2_2_ens",cells,
+             op_arg_gbl(&dT,1,"float",OP_READ),
+             op_arg_dat(e->outConservative,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_RW),
+             op_arg_dat(e->inConservative,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(e->midPointConservative,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(e->valuesNew,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_WRITE));
+
+  op_par_loop_simulation_1_ens("simulation_1_ens",cells,
+             op_arg_dat(e->values,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_WRITE),
+             op_arg_dat(e->valuesNew,-1,OP_ID,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(values,-1,OP_ID,4,"float",OP_WRITE),
+             op_arg_dat(e->maxElevation,-1,OP_ID,VOLNA_ENSEMBLE,"float",OP_RW));
+  return dT;
+}
+
+/*
+ * H + Zb of every member at the OutputLocation gauges, [gauge][member]
+ */
+op_dat volna_ensemble_gauges(op_map outputLocation_map) {
+  op_par_loop_gatherLocations_ens("gatherLocations_ens",outputLocation_map->from,
+             op_arg_dat(ensemble->values,0,outputLocation_map,VOLNA_ENSEMBLE_DIM,"float",OP_READ),
+             op_arg_dat(ensemble->gauges,-1,OP_ID,VOLNA_ENSEMBLE,"float",OP_WRITE));
+  op_fetch_data(ensemble->gauges);
+  return ensemble->gauges;
+}
+
+/*
+ * Write the maximum elevation of every member, [cell][member] in the order
+ * of the cells in the input file, and free the ensemble
+ */
+void volna_ensemble_close(int argc, char **argv, op_dat cellGlobalIndex) {
+  Ensemble *e = ensemble;
+  if (e == NULL) return;
+  const char *filename = volna_option(argc, argv, "ensembleMaxElevation");
+  if (filename == NULL) filename = "ensembleMaxElevation.h5";
+  int ncell = global_size(e->maxElevation->set);
+  std::vector<float> all;
+  op_fetch_data(e->maxElevation);
+  volna_gather_cells(e->maxElevation, cellGlobalIndex, ncell, &all);
+  int rank = 0;
+  if (volna_comm_size() > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) {
+    std::vector<float> data((size_t)ncell * e->size);
+    for (int i = 0; i < ncell; i++)
+      for (int m = 0; m < e->size; m++)
+        data[(size_t)i * e->size + m] = all[(size_t)i * VOLNA_ENSEMBLE + m];
+    hid_t file = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file < 0) {
+      op_printf("can't open file for write %s\n", filename);
+      exit(-1);
+    }
+    hsize_t dims[2] = {(hsize_t)ncell, (hsize_t)e->size};
+    check_hdf5_error(H5LTmake_dataset_float(file, "maxElevation", 2, dims, &data[0]));
+    check_hdf5_error(H5Fclose(file));
+    op_printf("Write ensemble maximum elevation to file: %s\n", filename);
+  }
+
+  op_dat dats[] = {e->values, e->valuesNew, e->midPointConservative, e->inConservative, e->outConservative,
+                   e->midPoint, e->bathySource, e->edgeFluxes, e->maxElevation, e->gauges};
+  for (unsigned int k = 0; k < sizeof(dats) / sizeof(dats[0]); k++)
+    if (dats[k] != NULL && op_free_dat_temp(dats[k]) < 0)
+      op_printf("Error: temporary op_dat %s cannot be removed\n", dats[k]->name);
+  delete e;
+  ensemble = NULL;
+}
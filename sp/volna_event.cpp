@@ -1,5 +1,11 @@
 #include "volna_common.h"
 #include "op_lib_cpp.h"
+#include "volna_spatial.h"
+#include <limits.h>
+#include <math.h>
+#include <float.h>
+#include <queue>
+#include <algorithm>
 
 void __check_hdf5_error(herr_t err, const char *file, const int line);
 //  if (err < 0) {
@@ -20,6 +26,216 @@ int timer_happens(TimerParams *p) {
   return result;
 }
 
+/*
+ * Event scheduling. The class name of every event is resolved once into an
+ * EventType by init_events. Instead of checking every timer in each of the
+ * three processEvents calls of a step, the events are kept in min-heaps keyed
+ * on the next iteration and the next time at which their timer can fire (one
+ * pair of heaps for the pre-update and one for the post-update events), so
+ * only the events that are due are touched. All timers advance together, so
+ * their iteration and time are kept in a single clock, and the TimerParams
+ * of an event is only brought up to date when the event is due. Only the
+ * localTime of the (few) events with a time step is still accumulated every
+ * step, and compared with their step there, so that they fire at exactly
+ * the same iterations as before; the time heaps only hold the start of
+ * their time window.
+ */
+struct EventEntry {
+  double key;  // iteration or time at which the event can fire
+  int event;
+  int version; // entries older than the event's last scheduling are stale
+};
+
+struct EventEntryLater {
+  bool operator()(const EventEntry &a, const EventEntry &b) const { return a.key > b.key; }
+};
+
+typedef std::priority_queue<EventEntry, std::vector<EventEntry>, EventEntryLater> EventHeap;
+
+struct EventScheduler {
+  unsigned int iter; // clock shared by all timers
+  float t;
+  std::vector<unsigned int> fireIter; // clock when each event last fired
+  std::vector<int> timed;         // events with a time step, their localTime is
+  std::vector<float> localTime;   // accumulated every step as before
+  std::vector<int> version;
+  std::vector<int> finished;
+  EventHeap iterHeap[2], timeHeap[2]; // [post_update]
+  std::vector<int> byType[EVENT_UNKNOWN];
+};
+
+static EventScheduler scheduler;
+
+static const char *event_class_names[EVENT_UNKNOWN] = {
+  "InitEta", "InitU", "InitV", "InitBathymetry", "InitBore",
+  "InitGaussianLandslide", "OutputTime", "OutputConservedQuantities",
+  "OutputLocation", "OutputSimulation", "OutputMaxElevation"
+};
+
+/*
+ * Bring the timer of event i up to date with the clock
+ */
+static void sync_timer(TimerParams *p, int i) {
+  p->iter = scheduler.iter;
+  p->t = scheduler.t;
+  p->localIter = scheduler.iter - scheduler.fireIter[i];
+  p->localTime = scheduler.localTime[i];
+}
+
+static void push_event(EventHeap *heap, double key, int i) {
+  EventEntry e = {key, i, scheduler.version[i]};
+  heap->push(e);
+}
+
+/*
+ * Schedule event i to be checked again at iteration from or later. The
+ * candidates are never later than the first iteration at which
+ * timer_happens can be true, an early one only costs an extra check.
+ */
+static void schedule_event(TimerParams *p, EventParams *e, int i, unsigned int from) {
+  EventScheduler &s = scheduler;
+  s.version[i]++;
+  int phase = e->post_update ? 1 : 0;
+  unsigned int next = UINT_MAX;
+  // localIter == istep
+  unsigned int c = s.fireIter[i] + p->istep;
+  if (c >= from) next = c;
+  // a time step that is already due fires once the iteration window opens
+  if (p->istart >= from) next = MIN(next, p->istart);
+  // localTime >= step, and t >= start. Reaching the step is caught where
+  // localTime is accumulated, in processEvents, with the same float sum as
+  // timer_happens, so only the start of the window is keyed on the clock
+  if (p->step < FLT_MAX && p->start < p->end) {
+    if (p->start > s.t) push_event(&s.timeHeap[phase], p->start, i);
+    else if (s.localTime[i] >= p->step) next = MIN(next, MAX(from, p->istart));
+  }
+  if (next < p->iend) push_event(&s.iterHeap[phase], next, i);
+}
+
+static void pop_due(EventHeap *heap, double now, std::vector<int> *due) {
+  while (!heap->empty() && heap->top().key <= now) {
+    EventEntry e = heap->top();
+    heap->pop();
+    if (e.version == scheduler.version[e.event] && !scheduler.finished[e.event])
+      due->push_back(e.event);
+  }
+}
+
+/*
+ * Resolve the class names of the events and schedule all of them for the
+ * first processEvents call; has to be called once all events are read
+ */
+void init_events(std::vector<TimerParams> *timers, std::vector<EventParams> *events) {
+  EventScheduler &s = scheduler;
+  int n = (*events).size();
+  s.iter = 0;
+  s.t = 0.0f;
+  s.fireIter.assign(n, 0);
+  s.version.assign(n, 0);
+  s.finished.assign(n, 0);
+  s.localTime.assign(n, 0.0f);
+  s.timed.clear();
+  for (int phase = 0; phase < 2; phase++) {
+    s.iterHeap[phase] = EventHeap();
+    s.timeHeap[phase] = EventHeap();
+  }
+  for (int k = 0; k < EVENT_UNKNOWN; k++) s.byType[k].clear();
+  int gauges = 0;
+  for (int i = 0; i < n; i++) {
+    EventParams &e = (*events)[i];
+    e.type = EVENT_UNKNOWN;
+    for (int k = 0; k < EVENT_UNKNOWN; k++)
+      if (strcmp(e.className.c_str(), event_class_names[k]) == 0) e.type = k;
+    e.gaugeId = e.type == EVENT_OUTPUT_LOCATION ? gauges++ : -1;
+    if (e.type == EVENT_UNKNOWN) {
+      op_printf("Unrecognized event %s\n", e.className.c_str());
+      s.finished[i] = 1;
+      continue;
+    }
+    s.byType[e.type].push_back(i);
+    if ((*timers)[i].step < FLT_MAX) s.timed.push_back(i); // FLT_MAX (volna_init INFTY) - no time step
+    // every timer can fire at iteration 0
+    push_event(&s.iterHeap[e.post_update ? 1 : 0], 0, i);
+  }
+}
+
+/*
+ * State of the scheduler for checkpoints (volna_checkpoint.cpp), taken
+ * between two steps
+ */
+void save_events(EventState *state) {
+  EventScheduler &s = scheduler;
+  state->iter = s.iter;
+  state->t = s.t;
+  state->fireIter = s.fireIter;
+  state->localTime = s.localTime;
+  state->finished = s.finished;
+}
+
+/*
+ * Restore the scheduler from a checkpoint, after init_events. The events
+ * have not been checked at the clock of the checkpoint yet.
+ */
+void restore_events(std::vector<TimerParams> *timers, std::vector<EventParams> *events, const EventState *state) {
+  EventScheduler &s = scheduler;
+  s.iter = state->iter;
+  s.t = state->t;
+  s.fireIter = state->fireIter;
+  s.localTime = state->localTime;
+  for (unsigned int i = 0; i < (*events).size(); i++) {
+    s.finished[i] = s.finished[i] || state->finished[i];
+    if (s.finished[i]) continue;
+    sync_timer(&(*timers)[i], i);
+    schedule_event(&(*timers)[i], &(*events)[i], i, s.iter);
+  }
+}
+
+/*
+ * Whether an event of type will happen in the pre-update processEvents of
+ * the next step, after the timers are advanced by timeIncrement at the end
+ * of this one
+ */
+int event_happens_next(std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                       int type, float timeIncrement) {
+  for (unsigned int k = 0; k < scheduler.byType[type].size(); k++) {
+    int i = scheduler.byType[type][k];
+    if ((*events)[i].post_update || scheduler.finished[i]) continue;
+    TimerParams next = (*timers)[i];
+    sync_timer(&next, i);
+    next.t += timeIncrement;
+    next.iter += 1;
+    next.localIter += 1;
+    next.localTime += timeIncrement;
+    if (next.iter >= next.iend || next.t >= next.end) continue; // removed
+    if (timer_happens(&next)) return 1;
+  }
+  return 0;
+}
+
+static int heap_due(const EventHeap *heap, double now) {
+  return !heap->empty() && heap->top().key <= now;
+}
+
+/*
+ * Whether an event may happen in the post-update processEvents of this
+ * step, or in the pre-update one of the next step if this one is
+ * timeIncrement long. Answered from the heaps, so it can be yes for an
+ * event that then turns out not to be due, but never no for a due one.
+ */
+int events_due_next(std::vector<TimerParams> *timers, float timeIncrement) {
+  EventScheduler &s = scheduler;
+  if (heap_due(&s.iterHeap[1], s.iter) || heap_due(&s.timeHeap[1], s.t) ||
+      heap_due(&s.iterHeap[0], s.iter + 1) || heap_due(&s.timeHeap[0], s.t + timeIncrement))
+    return 1;
+  // the timed events that reach their step are queued at the end of the step
+  for (unsigned int k = 0; k < s.timed.size(); k++) {
+    int i = s.timed[k];
+    float step = (*timers)[i].step;
+    if (!s.finished[i] && s.localTime[i] < step && s.localTime[i] + timeIncrement >= step) return 1;
+  }
+  return 0;
+}
+
 void read_events_hdf5(hid_t h5file, int num_events, std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *num_outputLocation) {
   std::vector<float> timer_start(num_events);
   std::vector<float> timer_end(num_events);
@@ -98,88 +314,270 @@ void read_events_hdf5(hid_t h5file, int num_events, std::vector<TimerParams> *ti
     check_hdf5_error(H5LTread_dataset_string(h5file, buffer, &eventBuffer[0]));
     (*events)[i].streamName.assign(&eventBuffer[0], length);
 //    free(eventBuffer);
+
+    // Formula programs, only in files written by newer versions of volna2hdf5
+    sprintf(buffer, "event_program%d",i);
+    if (H5LTfind_dataset(h5file, buffer) > 0) {
+      check_hdf5_error(H5LTget_attribute_int(h5file, buffer, "length", &length));
+      eventBuffer.resize(length);
+      check_hdf5_error(H5LTread_dataset_string(h5file, buffer, &eventBuffer[0]));
+      (*events)[i].program.assign(&eventBuffer[0]);
+    }
+  }
+
+}
+
+/*
+ * Scenario files written by volna2hdf5 refer to a separate mesh file
+ * (relative to the scenario file), older files contain the mesh themselves
+ */
+void read_mesh_filename(hid_t h5file, const char *filename_h5, char *filename_mesh) {
+  strcpy(filename_mesh, filename_h5);
+  if (H5LTfind_dataset(h5file, "meshFile") <= 0) return;
+  int length = 0;
+  check_hdf5_error(H5LTget_attribute_int(h5file, "meshFile", "length", &length));
+  std::vector<char> buffer(length);
+  check_hdf5_error(H5LTread_dataset_string(h5file, "meshFile", &buffer[0]));
+  const char *slash = strrchr(filename_h5, '/');
+  int dirlen = slash == NULL ? 0 : (int)(slash - filename_h5 + 1);
+  sprintf(filename_mesh, "%.*s%s", dirlen, filename_h5, &buffer[0]);
+}
+
+/*
+ * Returns the value of a "key=value" command line argument, or NULL
+ */
+const char *volna_option(int argc, char **argv, const char *key) {
+  size_t len = strlen(key);
+  for (int i = 2; i < argc; i++)
+    if (strncmp(argv[i], key, len) == 0 && argv[i][len] == '=')
+      return argv[i] + len + 1;
+  return NULL;
+}
+
+/*
+ * Read additional OutputLocation gauges from a text file, one per line:
+ *   x y filename [istep]
+ * The gauges are appended to the events read from the HDF5 file, so they
+ * come after the ones already located by volna2hdf5
+ */
+void read_gauges_file(const char *filename, std::vector<TimerParams> *timers, std::vector<EventParams> *events, int *num_gauges) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    op_printf("can't open gauges file %s\n", filename);
+    exit(-1);
+  }
+  char line[1024], stream[768];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    float x, y;
+    int istep = 1;
+    if (line[0] == '#') continue;
+    int n = sscanf(line, "%f %f %767s %d", &x, &y, stream, &istep);
+    if (n <= 0) continue;
+    if (n < 3) {
+      op_printf("Malformed line in gauges file %s: %s", filename, line);
+      exit(-1);
+    }
+    TimerParams t_p;
+    t_p.start = 0.0f;
+    t_p.end = INFINITY;
+    t_p.step = INFINITY;
+    t_p.istart = 0;
+    t_p.iend = INT_MAX;
+    t_p.istep = istep > 0 ? istep : 1;
+    t_p.localTime = 0.0f;
+    t_p.t = 0.0f;
+    t_p.localIter = 0;
+    t_p.iter = 0;
+    EventParams e_p;
+    e_p.location_x = x;
+    e_p.location_y = y;
+    e_p.post_update = 1;
+    e_p.className = "OutputLocation";
+    e_p.streamName = stream;
+    timers->push_back(t_p);
+    events->push_back(e_p);
+    (*num_gauges)++;
+  }
+  fclose(fp);
+  op_printf("Read %d gauges from %s\n", *num_gauges, filename);
+}
+
+/*
+ * Find the cells holding the gauges read by read_gauges_file. The cell
+ * indices are written to output_map[first..first+num_gauges-1]
+ */
+void locate_gauges(std::vector<EventParams> *events, int first, int num_gauges, int *output_map,
+                   op_set cells, op_dat nodeCoords, op_map cellsToNodes) {
+  SpatialIndex index;
+  buildSpatialIndex(&index, (float *)nodeCoords->data, cellsToNodes->map, cells->size);
+  int j = 0;
+  for (unsigned int i = 0; i < events->size(); i++) {
+    if (strcmp((*events)[i].className.c_str(), "OutputLocation")) continue;
+    if (j >= first) {
+      int e = locateCell(&index, (*events)[i].location_x, (*events)[i].location_y);
+      if (e < 0) {
+        e = nearestCell(&index, (*events)[i].location_x, (*events)[i].location_y, cells->size);
+        op_printf("Warning: gauge %s at (%g, %g) is outside the mesh, using nearest cell %d\n",
+            (*events)[i].streamName.c_str(), (*events)[i].location_x, (*events)[i].location_y, e);
+      }
+      output_map[j] = e;
+    }
+    j++;
   }
+}
 
+/*
+ * Writes the gauges of the due OutputLocation events in one pass
+ */
+static void output_locations(std::vector<EventParams *> *gaugeEvents, std::vector<TimerParams *> *gaugeTimers,
+                             op_dat values, op_map outputLocation_map, op_dat outputLocation_dat) {
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  op_timers_core(&cpu_t1, &wall_t1);
+  OutputLocation(gaugeEvents->size(), &(*gaugeEvents)[0], &(*gaugeTimers)[0], values, outputLocation_map, outputLocation_dat);
+  gaugeEvents->clear();
+  gaugeTimers->clear();
+  op_timers_core(&cpu_t2, &wall_t2);
+  volna_report_time(VOLNA_REPORT_OUTPUT, wall_t2 - wall_t1);
+  VOLNA_TRACE_SPAN("OutputLocation", "output", wall_t1, wall_t2);
 }
 
+/*
+ * Run the events of phase initPrePost (0 - pre-update, 1 - post-update,
+ * 2 - both, for the init loop) that are due at the current clock, in the
+ * order in which they are given, then advance the clock by one iteration and
+ * timeIncrement if updateTimers. Events whose timer has finished are dropped
+ * when they come due. Consecutive OutputLocation events are written in one
+ * batch.
+ */
 void processEvents(std::vector<TimerParams> *timers, std::vector<EventParams> *events, int firstTime, int updateTimers,
- 									 float timeIncrement, int removeFinished, int initPrePost, op_set cells, op_dat values, op_dat cellVolumes,
+ 									 float timeIncrement, int initPrePost, op_set cells, op_dat values, op_dat cellVolumes,
 									 op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes, op_dat temp_initEta, op_dat* temp_initBathymetry,
 									 int n_initBathymetry, BoreParams bore_params, GaussianLandslideParams gaussian_landslide_params, op_map outputLocation_map,
 									 op_dat outputLocation_dat) {
-  //op_printf("processEvents()... \n");
-  int size = (*timers).size();
-  int i = 0;
-	int j = 0;
-  while (i < size){
-    if (timer_happens(&(*timers)[i]) && (initPrePost==2 || (*events)[i].post_update==initPrePost)) {
-      if (strcmp((*events)[i].className.c_str(), "InitEta") == 0) {
-        InitEta(cells, cellCenters, values, temp_initEta, temp_initEta!=NULL);
-      } else if (strcmp((*events)[i].className.c_str(), "InitU") == 0) {
-        InitU(cells, cellCenters, values);
-      } else if (strcmp((*events)[i].className.c_str(), "InitV") == 0) {
-        InitV(cells, cellCenters, values);
-      } else if (strcmp((*events)[i].className.c_str(), "InitBathymetry") == 0) {
-        // If initBathymetry is given by a formula (n_initBathymetry is 0), run InitBathymetry for formula
-        if(n_initBathymetry == 0) {
-          InitBathymetry(cells, cellCenters, values, NULL, 0, firstTime);
-        }
-        // If initBathymetry is given by 1 file, run InitBathymetry for that particular file
-        if(n_initBathymetry == 1 ) {
-          InitBathymetry(cells, cellCenters, values, *temp_initBathymetry, 1, firstTime);
-        // Else if initBathymetry is given by multiple files, run InitBathymetry for those files
-        } else if (n_initBathymetry > 1) {
-          int k = ((*timers)[i].iter - (*timers)[i].istart) / (*timers)[i].istep;
-          // Handle the case when InitBathymetry files are out for further bathymetry initalization: remove the event
-          if(strcmp((*events)[i].className.c_str(), "InitBathymetry") == 0 && k<n_initBathymetry) {
-            InitBathymetry(cells, cellCenters, values, temp_initBathymetry[k], 1, firstTime);
+  EventScheduler &s = scheduler;
+  std::vector<int> due;
+  for (int phase = 0; phase < 2; phase++) {
+    if (initPrePost != 2 && initPrePost != phase) continue;
+    pop_due(&s.iterHeap[phase], s.iter, &due);
+    pop_due(&s.timeHeap[phase], s.t, &due);
+  }
+  std::sort(due.begin(), due.end());
+  due.erase(std::unique(due.begin(), due.end()), due.end());
+
+  std::vector<EventParams *> gaugeEvents;
+  std::vector<TimerParams *> gaugeTimers;
+  for (unsigned int k = 0; k < due.size(); k++) {
+    int i = due[k];
+    TimerParams *timer = &(*timers)[i];
+    EventParams *event = &(*events)[i];
+    sync_timer(timer, i);
+    if (timer->iter > 0 && (timer->iter >= timer->iend || timer->t >= timer->end)) {
+      s.finished[i] = 1;
+      continue;
+    }
+    if (!timer_happens(timer)) {
+      schedule_event(timer, event, i, s.iter + 1);
+      continue;
+    }
+    if (event->type != EVENT_OUTPUT_LOCATION && gaugeEvents.size() > 0)
+      output_locations(&gaugeEvents, &gaugeTimers, values, outputLocation_map, outputLocation_dat);
+    double cpu_t1, cpu_t2, wall_t1, wall_t2;
+    op_timers_core(&cpu_t1, &wall_t1);
+    // Formula compiled from the HDF5 file, NULL if the compiled-in one has to be used
+    op_dat formula = NULL;
+    if (event->type <= EVENT_INIT_BATHYMETRY)
+      formula = volna_formula_eval(event, cells, cellCenters);
+    switch (event->type) {
+    case EVENT_INIT_ETA: {
+      op_dat initEta = formula != NULL ? formula : temp_initEta;
+      InitEta(cells, cellCenters, values, initEta, initEta!=NULL);
+      break;
+    }
+    case EVENT_INIT_U:
+      InitU(cells, cellCenters, values, formula, formula!=NULL);
+      break;
+    case EVENT_INIT_V:
+      InitV(cells, cellCenters, values, formula, formula!=NULL);
+      break;
+    case EVENT_INIT_BATHYMETRY:
+      // If initBathymetry is given by a formula (n_initBathymetry is 0), run InitBathymetry for formula
+      if(n_initBathymetry == 0) {
+        InitBathymetry(cells, cellCenters, values, formula, formula!=NULL, firstTime);
+      }
+      // If initBathymetry is given by 1 file, run InitBathymetry for that particular file
+      if(n_initBathymetry == 1 ) {
+        InitBathymetry(cells, cellCenters, values, *temp_initBathymetry, 1, firstTime);
+      // Else if initBathymetry is given by multiple files, run InitBathymetry for those files
+      } else if (n_initBathymetry > 1) {
+        int f = (timer->iter - timer->istart) / timer->istep;
+        // Handle the case when InitBathymetry files are out for further bathymetry initalization
+        if(f<n_initBathymetry) {
+          // Frames are streamed from the HDF5 file, see volna_bathymetry.cpp
+          if (!bathymetry_stream_interpolated()) {
+            InitBathymetry(cells, cellCenters, values, bathymetry_stream_frame(f), 1, firstTime);
+          } else if (firstTime) {
+            // Later frames are interpolated in EvolveValuesRK2_2_bathy at every step
+            float weights[4];
+            InitBathymetryFrames(cells, values, bathymetry_stream_interpolate(timer->iter, weights), weights, firstTime);
           }
         }
-      } else if (strcmp((*events)[i].className.c_str(), "InitBore") == 0) {
-        InitBore(cells, cellCenters, values, bore_params);
-      } else if (strcmp((*events)[i].className.c_str(), "InitGaussianLandslide") == 0) {
-        InitGaussianLandslide(cells, cellCenters, values, gaussian_landslide_params, firstTime);
-      } else if (strcmp((*events)[i].className.c_str(), "OutputTime") == 0) {
-        OutputTime(&(*timers)[i]);
-        //op_printf("Output iter: %d \n", (*timers)[i].iter);
-      } else if (strcmp((*events)[i].className.c_str(), "OutputConservedQuantities") == 0) {
-        OutputConservedQuantities(cells, cellVolumes, values);
-      } else if (strcmp((*events)[i].className.c_str(), "OutputLocation") == 0) {
-        OutputLocation(&(*events)[i], j, &(*timers)[i], cells, nodeCoords, cellsToNodes, values, outputLocation_map, outputLocation_dat);
-				j++;
-      } else if (strcmp((*events)[i].className.c_str(), "OutputSimulation") == 0) {
-        // Remove comment if needed:
-        // 0 - ASCII output
-        // OutputSimulation(0, &(*events)[i], &(*timers)[i], nodeCoords, cellsToNodes, values);
-        // 1 - binary output
-        OutputSimulation(1, &(*events)[i], &(*timers)[i], nodeCoords, cellsToNodes, values);
-      } else if (strcmp((*events)[i].className.c_str(), "OutputMaxElevation") == 0) {
-        OutputMaxElevation(&(*events)[i], &(*timers)[i], nodeCoords, cellsToNodes, values, cells);
-      } else {
-        op_printf("Unrecognized event %s\n", (*events)[i].className.c_str());
-//        exit(-1);
       }
-      //timer.LocalReset();
-      (*timers)[i].localIter = 0;
-      (*timers)[i].localTime = 0;
-    }
-    if (updateTimers) {
-      //op_printf("if(updatesTimers) => true \n");
-      //timer.update()
-      (*timers)[i].t+= timeIncrement;
-      (*timers)[i].iter += 1;
-      (*timers)[i].localIter += 1;
-      (*timers)[i].localTime += timeIncrement;
+      break;
+    case EVENT_INIT_BORE:
+      InitBore(cells, cellCenters, values, bore_params);
+      break;
+    case EVENT_INIT_GAUSSIAN_LANDSLIDE:
+      // Otherwise Zb was set by simulation_1_landslide at the end of the previous step
+      if (firstTime || !gaussian_landslide_params.fused)
+        InitGaussianLandslide(cells, cellCenters, values, gaussian_landslide_params, firstTime);
+      break;
+    case EVENT_OUTPUT_TIME:
+      OutputTime(timer);
+      break;
+    case EVENT_OUTPUT_CONSERVED_QUANTITIES:
+      OutputConservedQuantities(cells, cellVolumes, values);
+      break;
+    case EVENT_OUTPUT_LOCATION:
+      gaugeEvents.push_back(event);
+      gaugeTimers.push_back(timer);
+      break;
+    case EVENT_OUTPUT_SIMULATION:
+      // Remove comment if needed:
+      // 0 - ASCII output
+      // OutputSimulation(0, event, timer, nodeCoords, cellsToNodes, values);
+      // 1 - binary output
+      OutputSimulation(1, event, timer, nodeCoords, cellsToNodes, values);
+      break;
+    case EVENT_OUTPUT_MAX_ELEVATION:
+      OutputMaxElevation(event, timer, nodeCoords, cellsToNodes, values, cells);
+      break;
     }
+    op_timers_core(&cpu_t2, &wall_t2);
+    volna_report_time(event->type >= EVENT_OUTPUT_TIME ? VOLNA_REPORT_OUTPUT : VOLNA_REPORT_EVENTS,
+                      wall_t2 - wall_t1);
+    VOLNA_TRACE_SPAN(event_class_names[event->type], event->type >= EVENT_OUTPUT_TIME ? "output" : "event",
+                     wall_t1, wall_t2);
+    //timer.LocalReset();
+    s.fireIter[i] = s.iter;
+    s.localTime[i] = 0.0f;
+    timer->localIter = 0;
+    timer->localTime = 0;
+    schedule_event(timer, event, i, s.iter + 1);
+  }
+  if (gaugeEvents.size() > 0)
+    output_locations(&gaugeEvents, &gaugeTimers, values, outputLocation_map, outputLocation_dat);
 
-    if (removeFinished) {
-      //op_printf("if(removeFinished) => true \n");
-      //Remove finished events
-      if (((*timers)[i].iter >= (*timers)[i].iend) || ((*timers)[i].t >= (*timers)[i].end)) {
-        (*timers).erase((*timers).begin()+i);
-        (*events).erase((*events).begin()+i);
-        size--;
-      } else i++;
-    } else i++;
+  if (updateTimers) {
+    //timer.update()
+    s.t += timeIncrement;
+    s.iter += 1;
+    for (unsigned int k = 0; k < s.timed.size(); k++) {
+      int i = s.timed[k];
+      int reached = s.localTime[i] >= (*timers)[i].step;
+      s.localTime[i] += timeIncrement;
+      // the step is reached, the event is checked at the new iteration
+      if (!reached && s.localTime[i] >= (*timers)[i].step && !s.finished[i])
+        push_event(&s.iterHeap[(*events)[i].post_update ? 1 : 0], s.iter, i);
+    }
   }
 }
@@ -0,0 +1,257 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <map>
+#include <sstream>
+
+#ifdef VOLNA_CUDA
+void op_upload_dat(op_dat dat);
+#endif
+
+/*
+ * Init formulas evaluated without rebuilding the solver. volna2hdf5 stores
+ * every formula as a postfix program (yac::postfix), which is compiled here
+ * into register bytecode: registers 0-2 hold x, y and t, then come the
+ * constants, then one register per level of the evaluation stack. Cells
+ * are evaluated in batches, every instruction running over the whole batch,
+ * so the dispatch cost is shared by FORMULA_BATCH cells and the loops
+ * vectorise. The result goes into a temporary dat that InitEta, InitU,
+ * InitV and InitBathymetry apply as if it had been read from a file.
+ *
+ * With formulas=compiled, or for files without programs, the formulas
+ * compiled into the solver (init*_formula.h) are used instead.
+ */
+
+#define FORMULA_BATCH 256
+
+enum FormulaOpcode {
+  // unary
+  F_NEG, F_NOT, F_ABS, F_ACOS, F_ASIN, F_ATAN, F_ACOSH, F_ASINH, F_ATANH,
+  F_BESJ0, F_BESJ1, F_BESY0, F_BESY1, F_CEIL, F_COS, F_COSH, F_ERF, F_ERFC,
+  F_EXP, F_FLOOR, F_LOG, F_LOG10, F_SGN, F_SIN, F_SINH, F_SQRT, F_TAN, F_TANH,
+  // binary
+  F_ADD, F_SUB, F_MUL, F_DIV, F_MOD, F_ATAN2, F_EQ, F_NE, F_LT, F_GT, F_LE, F_GE,
+  F_AND, F_BITAND, F_BITOR, F_BITXOR, F_SHL, F_SHR
+};
+
+struct FormulaName {
+  const char *name;
+  int opcode;
+};
+
+// Names of the yac built-in functions
+static const FormulaName formula_names[] = {
+  {"negate", F_NEG}, {"logical_not", F_NOT}, {"abs", F_ABS}, {"acos", F_ACOS},
+  {"asin", F_ASIN}, {"atan", F_ATAN}, {"acosh", F_ACOSH}, {"asinh", F_ASINH},
+  {"atanh", F_ATANH}, {"besj0", F_BESJ0}, {"besj1", F_BESJ1}, {"besy0", F_BESY0},
+  {"besy1", F_BESY1}, {"ceil", F_CEIL}, {"cos", F_COS}, {"cosh", F_COSH},
+  {"erf", F_ERF}, {"erfc", F_ERFC}, {"exp", F_EXP}, {"floor", F_FLOOR},
+  {"log", F_LOG}, {"log10", F_LOG10}, {"sgn", F_SGN}, {"sin", F_SIN},
+  {"sinh", F_SINH}, {"sqrt", F_SQRT}, {"tan", F_TAN}, {"tanh", F_TANH},
+  {"add", F_ADD}, {"subtract", F_SUB}, {"multiply", F_MUL}, {"divide", F_DIV},
+  {"mod", F_MOD}, {"atan2", F_ATAN2}, {"equal", F_EQ}, {"not_equal", F_NE},
+  {"less", F_LT}, {"greater", F_GT}, {"less_equal", F_LE}, {"greater_equal", F_GE},
+  {"logical_and", F_AND}, {"bitwise_and", F_BITAND}, {"bitwise_or", F_BITOR},
+  {"bitwise_xor", F_BITXOR}, {"shift_left", F_SHL}, {"shift_right", F_SHR}
+};
+
+struct FormulaInstr {
+  int opcode, dst, a, b;
+};
+
+struct Formula {
+  std::vector<FormulaInstr> code;
+  std::vector<float> constants; // registers 3 .. 3+constants.size()-1
+  int nregs;
+  int result;
+};
+
+static std::map<std::string, Formula> formulas;
+static int use_programs = 1;
+static op_dat formulaValues = NULL;
+
+static int formula_opcode(const std::string &name) {
+  for (unsigned int i = 0; i < sizeof(formula_names) / sizeof(formula_names[0]); i++)
+    if (name == formula_names[i].name) return formula_names[i].opcode;
+  return -1;
+}
+
+static void formula_error(const std::string &program, const char *msg) {
+  op_printf("Error compiling formula program '%s': %s\n", program.c_str(), msg);
+  exit(-1);
+}
+
+static Formula formula_compile(const std::string &program) {
+  std::vector<std::string> tokens;
+  std::istringstream in(program);
+  std::string token;
+  while (in >> token) tokens.push_back(token);
+
+  // Constants get their own registers, x y t are 0 1 2
+  Formula f;
+  std::map<std::string, int> constant_regs;
+  for (unsigned int i = 0; i < tokens.size(); i++) {
+    char *end;
+    float value = strtof(tokens[i].c_str(), &end);
+    if (*end != '\0' || constant_regs.count(tokens[i])) continue;
+    constant_regs[tokens[i]] = 3 + f.constants.size();
+    f.constants.push_back(value);
+  }
+  int stack_base = 3 + f.constants.size();
+
+  std::vector<int> stack;
+  int depth = 0;
+  for (unsigned int i = 0; i < tokens.size(); i++) {
+    const std::string &tok = tokens[i];
+    if (tok == "x") stack.push_back(0);
+    else if (tok == "y") stack.push_back(1);
+    else if (tok == "t") stack.push_back(2);
+    else if (constant_regs.count(tok)) stack.push_back(constant_regs[tok]);
+    else {
+      int opcode = formula_opcode(tok);
+      if (opcode < 0) formula_error(program, ("unknown function " + tok).c_str());
+      int arity = opcode >= F_ADD ? 2 : 1;
+      if ((int)stack.size() < arity) formula_error(program, "stack underflow");
+      FormulaInstr instr;
+      instr.opcode = opcode;
+      instr.b = arity == 2 ? stack.back() : 0;
+      if (arity == 2) stack.pop_back();
+      instr.a = stack.back();
+      stack.pop_back();
+      // The result replaces the operands at this stack level
+      instr.dst = stack_base + stack.size();
+      stack.push_back(instr.dst);
+      f.code.push_back(instr);
+    }
+    depth = MAX(depth, (int)stack.size());
+  }
+  if (stack.size() != 1) formula_error(program, "does not leave exactly one value");
+  f.result = stack.back();
+  f.nregs = stack_base + depth;
+  return f;
+}
+
+static void formula_run(const Formula &f, float *r, int m) {
+  for (unsigned int k = 0; k < f.code.size(); k++) {
+    const FormulaInstr &in = f.code[k];
+    float *d = r + in.dst * FORMULA_BATCH;
+    const float *a = r + in.a * FORMULA_BATCH;
+    const float *b = r + in.b * FORMULA_BATCH;
+    switch (in.opcode) {
+    case F_NEG:    for (int i = 0; i < m; i++) d[i] = -a[i]; break;
+    case F_NOT:    for (int i = 0; i < m; i++) d[i] = !a[i]; break;
+    case F_ABS:    for (int i = 0; i < m; i++) d[i] = fabsf(a[i]); break;
+    case F_ACOS:   for (int i = 0; i < m; i++) d[i] = acosf(a[i]); break;
+    case F_ASIN:   for (int i = 0; i < m; i++) d[i] = asinf(a[i]); break;
+    case F_ATAN:   for (int i = 0; i < m; i++) d[i] = atanf(a[i]); break;
+    case F_ACOSH:  for (int i = 0; i < m; i++) d[i] = acoshf(a[i]); break;
+    case F_ASINH:  for (int i = 0; i < m; i++) d[i] = asinhf(a[i]); break;
+    case F_ATANH:  for (int i = 0; i < m; i++) d[i] = atanhf(a[i]); break;
+    case F_BESJ0:  for (int i = 0; i < m; i++) d[i] = j0(a[i]); break;
+    case F_BESJ1:  for (int i = 0; i < m; i++) d[i] = j1(a[i]); break;
+    case F_BESY0:  for (int i = 0; i < m; i++) d[i] = y0(a[i]); break;
+    case F_BESY1:  for (int i = 0; i < m; i++) d[i] = y1(a[i]); break;
+    case F_CEIL:   for (int i = 0; i < m; i++) d[i] = ceilf(a[i]); break;
+    case F_COS:    for (int i = 0; i < m; i++) d[i] = cosf(a[i]); break;
+    case F_COSH:   for (int i = 0; i < m; i++) d[i] = coshf(a[i]); break;
+    case F_ERF:    for (int i = 0; i < m; i++) d[i] = erff(a[i]); break;
+    case F_ERFC:   for (int i = 0; i < m; i++) d[i] = erfcf(a[i]); break;
+    case F_EXP:    for (int i = 0; i < m; i++) d[i] = expf(a[i]); break;
+    case F_FLOOR:  for (int i = 0; i < m; i++) d[i] = floorf(a[i]); break;
+    case F_LOG:    for (int i = 0; i < m; i++) d[i] = logf(a[i]); break;
+    case F_LOG10:  for (int i = 0; i < m; i++) d[i] = log10f(a[i]); break;
+    case F_SGN:    for (int i = 0; i < m; i++) d[i] = a[i] >= 0.0f ? 1.0f : -1.0f; break;
+    case F_SIN:    for (int i = 0; i < m; i++) d[i] = sinf(a[i]); break;
+    case F_SINH:   for (int i = 0; i < m; i++) d[i] = sinhf(a[i]); break;
+    case F_SQRT:   for (int i = 0; i < m; i++) d[i] = sqrtf(a[i]); break;
+    case F_TAN:    for (int i = 0; i < m; i++) d[i] = tanf(a[i]); break;
+    case F_TANH:   for (int i = 0; i < m; i++) d[i] = tanhf(a[i]); break;
+    case F_ADD:    for (int i = 0; i < m; i++) d[i] = a[i] + b[i]; break;
+    case F_SUB:    for (int i = 0; i < m; i++) d[i] = a[i] - b[i]; break;
+    case F_MUL:    for (int i = 0; i < m; i++) d[i] = a[i] * b[i]; break;
+    case F_DIV:    for (int i = 0; i < m; i++) d[i] = a[i] / b[i]; break;
+    case F_MOD:    for (int i = 0; i < m; i++) d[i] = (int)a[i] % (int)b[i]; break;
+    case F_ATAN2:  for (int i = 0; i < m; i++) d[i] = atan2f(a[i], b[i]); break;
+    case F_EQ:     for (int i = 0; i < m; i++) d[i] = a[i] == b[i]; break;
+    case F_NE:     for (int i = 0; i < m; i++) d[i] = a[i] != b[i]; break;
+    case F_LT:     for (int i = 0; i < m; i++) d[i] = a[i] < b[i]; break;
+    case F_GT:     for (int i = 0; i < m; i++) d[i] = a[i] > b[i]; break;
+    case F_LE:     for (int i = 0; i < m; i++) d[i] = a[i] <= b[i]; break;
+    case F_GE:     for (int i = 0; i < m; i++) d[i] = a[i] >= b[i]; break;
+    case F_AND:    for (int i = 0; i < m; i++) d[i] = a[i] != 0.0f && b[i] != 0.0f; break;
+    case F_BITAND: for (int i = 0; i < m; i++) d[i] = (int)a[i] & (int)b[i]; break;
+    case F_BITOR:  for (int i = 0; i < m; i++) d[i] = (int)a[i] | (int)b[i]; break;
+    case F_BITXOR: for (int i = 0; i < m; i++) d[i] = (int)a[i] ^ (int)b[i]; break;
+    case F_SHL:    for (int i = 0; i < m; i++) d[i] = (int)a[i] << (int)b[i]; break;
+    case F_SHR:    for (int i = 0; i < m; i++) d[i] = (int)a[i] >> (int)b[i]; break;
+    }
+  }
+}
+
+/*
+ * Evaluate f at the n points centers[2*i], centers[2*i+1] at time t
+ */
+static void formula_eval(const Formula &f, int n, const float *centers, float t, float *out) {
+  int nbatches = (n + FORMULA_BATCH - 1) / FORMULA_BATCH;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    std::vector<float> regs(f.nregs * FORMULA_BATCH);
+    float *r = &regs[0];
+    for (int i = 0; i < FORMULA_BATCH; i++) r[2*FORMULA_BATCH + i] = t;
+    for (unsigned int c = 0; c < f.constants.size(); c++)
+      for (int i = 0; i < FORMULA_BATCH; i++) r[(3+c)*FORMULA_BATCH + i] = f.constants[c];
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int batch = 0; batch < nbatches; batch++) {
+      int start = batch * FORMULA_BATCH;
+      int m = MIN(FORMULA_BATCH, n - start);
+      for (int i = 0; i < m; i++) {
+        r[i] = centers[2*(start+i)];
+        r[FORMULA_BATCH + i] = centers[2*(start+i)+1];
+      }
+      formula_run(f, r, m);
+      memcpy(out + start, r + f.result * FORMULA_BATCH, m * sizeof(float));
+    }
+  }
+}
+
+/*
+ * Compile the formula programs of the events, unless formulas=compiled
+ */
+void volna_formula_init(int argc, char **argv, std::vector<EventParams> *events) {
+  const char *mode = volna_option(argc, argv, "formulas");
+  use_programs = mode == NULL || strcmp(mode, "compiled");
+  for (unsigned int i = 0; i < (*events).size(); i++) {
+    const std::string &program = (*events)[i].program;
+    if (!use_programs || program.empty() || formulas.count(program)) continue;
+    formulas[program] = formula_compile(program);
+    op_printf("Compiled %s formula into %d instructions\n", (*events)[i].className.c_str(),
+              (int)formulas[program].code.size());
+  }
+}
+
+/*
+ * Values of the formula of event on the cells at the current time, or NULL
+ * if the formula compiled into the solver has to be used
+ */
+op_dat volna_formula_eval(EventParams *event, op_set cells, op_dat cellCenters) {
+  if (!use_programs || event->program.empty()) return NULL;
+  if (formulaValues == NULL) {
+    float *tmp_elem = NULL;
+    formulaValues = op_decl_dat_temp(cells, 1, "float", tmp_elem, "formulaValues");
+  }
+  formula_eval(formulas[event->program], cells->size, (float *)cellCenters->data,
+               timestamp, (float *)formulaValues->data);
+#ifdef VOLNA_CUDA
+  op_upload_dat(formulaValues);
+#endif
+  return formulaValues;
+}
+
+void volna_formula_free() {
+  if (formulaValues != NULL && op_free_dat_temp(formulaValues) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", formulaValues->name);
+  formulaValues = NULL;
+}
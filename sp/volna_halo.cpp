@@ -0,0 +1,424 @@
+#include "volna_common.h"
+#include "computeFluxes.h"
+#include "NumericalFluxes.h"
+#include "SpaceDiscretization.h"
+#include "EvolveValuesRK2_1.h"
+#include "EvolveValuesRK2_2.h"
+#include "zeroValues.h"
+#include <mpi.h>
+#include <map>
+#include <algorithm>
+
+/*
+ * Deep halo RK2 step (deepHalo=1). With OP2 every process exchanges the
+ * halo of values before the first computeFluxes and the halo of midPoint
+ * before the second, two latency bound exchanges per step. Here every
+ * process keeps its own cells G0, the cells L1 sharing an edge with them
+ * and the cells L2 sharing an edge with L1, and the edges of G0 and L1,
+ * built from cellsToEdges and edgesToCells of the mesh file. Each step
+ * exchanges the values of L1 and L2 once, then
+ *   stage 1 runs on the edges of G0 and L1 and on the cells G0 and L1,
+ *           minTimestep is reduced over the processes,
+ *   stage 2 runs on the edges of G0 and on the cells G0,
+ * so midPoint is computed redundantly on L1 instead of being exchanged.
+ *
+ * SpaceDiscretization is gathered by cell, every cell applying the edges
+ * it is on in the order of their global index, so the cells are updated in
+ * the same order as a run on one process and the result does not depend on
+ * the partitioning.
+ *
+ * The kernels run on the host arrays, so this is only used with MPI in the
+ * seq and OpenMP builds, and not together with local time stepping,
+ * ensembles, linearDepth, bathyInterp, tiles, replay or dtLag.
+ */
+
+struct DeepHalo {
+  int nowned, nlayer1, ncells;   // cells: G0 [0,nowned), L1 [nowned,nlayer1), L2 [nlayer1,ncells)
+  int nedges0, nedges;           // edges: of G0 [0,nedges0), of L1 only [nedges0,nedges)
+  int *cellEdges;                // 3 edges of the cells of G0 and L1, as in the mesh
+  int *cellEdgesSorted;          // and by global index
+  int *edgeCells;                // left and right cell of every edge
+  float *edgeNormals, *edgeLength, *cellVolumes;
+  int *isBoundary;
+  float *values, *midCons, *inCons, *outCons, *mid;
+  float *bathySource, *edgeFluxes, *maxEdgeEigenvalues;
+  int nsend, nrecv;              // neighbour processes
+  int *sendRanks, *sendOffs, *sendCells;   // own cells sent to sendRanks[k]: sendCells[sendOffs[k] ..]
+  int *recvRanks, *recvOffs, *recvCells;   // halo cells received from recvRanks[k]
+  float *sendBuf, *recvBuf;
+  MPI_Request *requests;
+};
+
+static DeepHalo *halo = NULL;
+
+/*
+ * Owner process and index there of the cells ghosts (sorted global
+ * indices), found through a directory of the global cell index split in
+ * blocks over the processes
+ */
+static void halo_owners(int ncell, int nowned, const int *gidx, const std::vector<int> &ghosts,
+                        std::vector<int> *ownerRank, std::vector<int> *ownerIndex) {
+  int size = volna_comm_size(), rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int block = MAX(ncell / size, 1);
+  int dirStart = MIN(rank * block, ncell);
+  int dirSize = rank == size - 1 ? ncell - dirStart : MIN(block, ncell - dirStart);
+  std::vector<int> sendCounts(size, 0), recvCounts(size), sendDispls(size), recvDispls(size);
+
+  //Register the own cells: global index and local index
+  for (int i = 0; i < nowned; i++) sendCounts[MIN(gidx[i] / block, size - 1)] += 2;
+  MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+  int nsent = 0, nrecvd = 0;
+  for (int r = 0; r < size; r++) {
+    sendDispls[r] = nsent;
+    recvDispls[r] = nrecvd;
+    nsent += sendCounts[r];
+    nrecvd += recvCounts[r];
+  }
+  std::vector<int> sendBuf(nsent + 1), recvBuf(nrecvd + 1), fill(sendDispls);
+  for (int i = 0; i < nowned; i++) {
+    int d = MIN(gidx[i] / block, size - 1);
+    sendBuf[fill[d]++] = gidx[i];
+    sendBuf[fill[d]++] = i;
+  }
+  MPI_Alltoallv(&sendBuf[0], &sendCounts[0], &sendDispls[0], MPI_INT,
+                &recvBuf[0], &recvCounts[0], &recvDispls[0], MPI_INT, MPI_COMM_WORLD);
+  std::vector<int> dirRank(dirSize + 1), dirIndex(dirSize + 1);
+  for (int r = 0; r < size; r++)
+    for (int j = recvDispls[r]; j < recvDispls[r] + recvCounts[r]; j += 2) {
+      dirRank[recvBuf[j] - dirStart] = r;
+      dirIndex[recvBuf[j] - dirStart] = recvBuf[j + 1];
+    }
+
+  //Query the ghosts, they are sorted so the answers come back in their order
+  int nghost = ghosts.size();
+  std::fill(sendCounts.begin(), sendCounts.end(), 0);
+  for (int i = 0; i < nghost; i++) sendCounts[MIN(ghosts[i] / block, size - 1)]++;
+  MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+  nrecvd = 0;
+  for (int r = 0, offset = 0; r < size; r++) {
+    sendDispls[r] = offset;
+    recvDispls[r] = nrecvd;
+    offset += sendCounts[r];
+    nrecvd += recvCounts[r];
+  }
+  std::vector<int> queries(nrecvd + 1), answers(2 * nrecvd + 1), replies(2 * nghost + 1);
+  MPI_Alltoallv(nghost ? &ghosts[0] : NULL, &sendCounts[0], &sendDispls[0], MPI_INT,
+                &queries[0], &recvCounts[0], &recvDispls[0], MPI_INT, MPI_COMM_WORLD);
+  for (int j = 0; j < nrecvd; j++) {
+    answers[2 * j] = dirRank[queries[j] - dirStart];
+    answers[2 * j + 1] = dirIndex[queries[j] - dirStart];
+  }
+  for (int r = 0; r < size; r++) {
+    sendCounts[r] *= 2;
+    sendDispls[r] *= 2;
+    recvCounts[r] *= 2;
+    recvDispls[r] *= 2;
+  }
+  MPI_Alltoallv(&answers[0], &recvCounts[0], &recvDispls[0], MPI_INT,
+                &replies[0], &sendCounts[0], &sendDispls[0], MPI_INT, MPI_COMM_WORLD);
+  ownerRank->resize(nghost);
+  ownerIndex->resize(nghost);
+  for (int i = 0; i < nghost; i++) {
+    (*ownerRank)[i] = replies[2 * i];
+    (*ownerIndex)[i] = replies[2 * i + 1];
+  }
+}
+
+/*
+ * The edges of the cells cellIds[first..] not seen yet are appended to
+ * edgeIds, and the cells on them not seen yet to cellIds
+ */
+static void halo_grow(hid_t meshfile, std::vector<int> *cellIds, int first, std::vector<int> *edgeIds,
+                      std::map<int, int> *cellLocal, std::map<int, int> *edgeLocal) {
+  int n = cellIds->size() - first;
+  std::vector<int> c2e(3 * n + 1);
+  volna_read_rows_hdf5(meshfile, "cellsToEdges", H5T_NATIVE_INT, n, &(*cellIds)[0] + first, 3, &c2e[0]);
+  std::vector<int> newEdges;
+  for (int i = 0; i < 3 * n; i++)
+    if (edgeLocal->find(c2e[i]) == edgeLocal->end()) {
+      (*edgeLocal)[c2e[i]] = 0;
+      newEdges.push_back(c2e[i]);
+    }
+  std::sort(newEdges.begin(), newEdges.end());
+  std::vector<int> e2c(2 * newEdges.size() + 1);
+  volna_read_rows_hdf5(meshfile, "edgesToCells", H5T_NATIVE_INT, newEdges.size(),
+                       newEdges.empty() ? NULL : &newEdges[0], 2, &e2c[0]);
+  std::vector<int> newCells;
+  for (size_t i = 0; i < 2 * newEdges.size(); i++)
+    if (cellLocal->find(e2c[i]) == cellLocal->end()) {
+      (*cellLocal)[e2c[i]] = 0;
+      newCells.push_back(e2c[i]);
+    }
+  std::sort(newCells.begin(), newCells.end());
+  edgeIds->insert(edgeIds->end(), newEdges.begin(), newEdges.end());
+  cellIds->insert(cellIds->end(), newCells.begin(), newCells.end());
+}
+
+void volna_halo_init(int argc, char **argv, const char *filename_mesh, op_set cells, op_dat cellGlobalIndex,
+                     int supported) {
+  if (volna_option(argc, argv, "deepHalo") == NULL) return;
+#ifdef VOLNA_CUDA
+  supported = 0;
+#endif
+  if (volna_comm_size() == 1) return; // nothing to exchange
+  if (!supported) {
+    op_printf("deepHalo is ignored in the CUDA build and with lts, ensembles, linearDepth, bathyInterp, tiles and replay\n");
+    return;
+  }
+  halo = new DeepHalo;
+  DeepHalo *h = halo;
+  int *gidx = (int *)cellGlobalIndex->data;
+  h->nowned = cells->size;
+
+  //G0, then L1 and the edges of G0, then L2 and the edges of L1
+  volna_hdf5_lock();
+  hid_t meshfile = volna_open_hdf5(filename_mesh);
+  std::vector<int> cellIds(gidx, gidx + h->nowned), edgeIds;
+  std::map<int, int> cellLocal, edgeLocal;
+  for (int i = 0; i < h->nowned; i++) cellLocal[gidx[i]] = 0;
+  halo_grow(meshfile, &cellIds, 0, &edgeIds, &cellLocal, &edgeLocal);
+  h->nlayer1 = cellIds.size();
+  h->nedges0 = edgeIds.size();
+  halo_grow(meshfile, &cellIds, h->nowned, &edgeIds, &cellLocal, &edgeLocal);
+  h->ncells = cellIds.size();
+  h->nedges = edgeIds.size();
+  for (int i = 0; i < h->ncells; i++) cellLocal[cellIds[i]] = i;
+  for (int i = 0; i < h->nedges; i++) edgeLocal[edgeIds[i]] = i;
+
+  //The mesh of the local cells and edges
+  h->cellEdges = (int *)malloc(3 * h->nlayer1 * sizeof(int));
+  h->cellEdgesSorted = (int *)malloc(3 * h->nlayer1 * sizeof(int));
+  h->edgeCells = (int *)malloc(2 * h->nedges * sizeof(int));
+  h->edgeNormals = (float *)malloc(2 * h->nedges * sizeof(float));
+  h->edgeLength = (float *)malloc(h->nedges * sizeof(float));
+  h->isBoundary = (int *)malloc(h->nedges * sizeof(int));
+  h->cellVolumes = (float *)malloc(h->ncells * sizeof(float));
+  volna_read_rows_hdf5(meshfile, "cellsToEdges", H5T_NATIVE_INT, h->nlayer1, &cellIds[0], 3, h->cellEdges);
+  volna_read_rows_hdf5(meshfile, "edgesToCells", H5T_NATIVE_INT, h->nedges, &edgeIds[0], 2, h->edgeCells);
+  volna_read_rows_hdf5(meshfile, "edgeNormals", H5T_NATIVE_FLOAT, h->nedges, &edgeIds[0], 2, h->edgeNormals);
+  volna_read_rows_hdf5(meshfile, "edgeLength", H5T_NATIVE_FLOAT, h->nedges, &edgeIds[0], 1, h->edgeLength);
+  volna_read_rows_hdf5(meshfile, "isBoundary", H5T_NATIVE_INT, h->nedges, &edgeIds[0], 1, h->isBoundary);
+  volna_read_rows_hdf5(meshfile, "cellVolumes", H5T_NATIVE_FLOAT, h->ncells, &cellIds[0], 1, h->cellVolumes);
+  int ncell = 0;
+  check_hdf5_error(H5LTread_dataset_int(meshfile, "cells", &ncell));
+  check_hdf5_error(H5Fclose(meshfile));
+  volna_hdf5_unlock();
+  for (int i = 0; i < 3 * h->nlayer1; i += 3) {
+    std::copy(h->cellEdges + i, h->cellEdges + i + 3, h->cellEdgesSorted + i);
+    std::sort(h->cellEdgesSorted + i, h->cellEdgesSorted + i + 3);
+    for (int j = i; j < i + 3; j++) {
+      h->cellEdges[j] = edgeLocal[h->cellEdges[j]];
+      h->cellEdgesSorted[j] = edgeLocal[h->cellEdgesSorted[j]];
+    }
+  }
+  for (int i = 0; i < 2 * h->nedges; i++) h->edgeCells[i] = cellLocal[h->edgeCells[i]];
+
+  //Who sends the values of L1 and L2
+  std::vector<std::pair<int, int> > ghosts(h->ncells - h->nowned);
+  for (int i = h->nowned; i < h->ncells; i++) ghosts[i - h->nowned] = std::make_pair(cellIds[i], i);
+  std::sort(ghosts.begin(), ghosts.end());
+  std::vector<int> ghostIds(ghosts.size()), ownerRank, ownerIndex;
+  for (size_t i = 0; i < ghosts.size(); i++) ghostIds[i] = ghosts[i].first;
+  halo_owners(ncell, h->nowned, gidx, ghostIds, &ownerRank, &ownerIndex);
+
+  int size = volna_comm_size();
+  std::vector<std::vector<int> > recvCells(size), recvIndex(size);
+  for (size_t i = 0; i < ghosts.size(); i++) {
+    recvCells[ownerRank[i]].push_back(ghosts[i].second);
+    recvIndex[ownerRank[i]].push_back(ownerIndex[i]);
+  }
+  std::vector<int> sendCounts(size), recvCounts(size), sendDispls(size), recvDispls(size);
+  for (int r = 0; r < size; r++) recvCounts[r] = recvCells[r].size();
+  MPI_Alltoall(&recvCounts[0], 1, MPI_INT, &sendCounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+  h->nsend = h->nrecv = 0;
+  int nsent = 0;
+  for (int r = 0; r < size; r++) {
+    sendDispls[r] = nsent;
+    nsent += sendCounts[r];
+    h->nsend += sendCounts[r] > 0;
+    h->nrecv += recvCounts[r] > 0;
+  }
+  std::vector<int> requested(h->ncells - h->nowned + 1);
+  for (int r = 0, offset = 0; r < size; r++) {
+    recvDispls[r] = offset;
+    std::copy(recvIndex[r].begin(), recvIndex[r].end(), requested.begin() + offset);
+    offset += recvCounts[r];
+  }
+  h->sendCells = (int *)malloc((nsent + 1) * sizeof(int));
+  MPI_Alltoallv(&requested[0], &recvCounts[0], &recvDispls[0], MPI_INT,
+                h->sendCells, &sendCounts[0], &sendDispls[0], MPI_INT, MPI_COMM_WORLD);
+  h->sendRanks = (int *)malloc((h->nsend + 1) * sizeof(int));
+  h->sendOffs = (int *)malloc((h->nsend + 1) * sizeof(int));
+  h->recvRanks = (int *)malloc((h->nrecv + 1) * sizeof(int));
+  h->recvOffs = (int *)malloc((h->nrecv + 1) * sizeof(int));
+  h->recvCells = (int *)malloc((h->ncells - h->nowned + 1) * sizeof(int));
+  h->nsend = h->nrecv = 0;
+  h->sendOffs[0] = h->recvOffs[0] = 0;
+  for (int r = 0; r < size; r++) {
+    if (sendCounts[r] > 0) {
+      h->sendRanks[h->nsend] = r;
+      h->sendOffs[h->nsend + 1] = sendDispls[r] + sendCounts[r];
+      h->nsend++;
+    }
+    if (recvCounts[r] > 0) {
+      h->recvRanks[h->nrecv] = r;
+      std::copy(recvCells[r].begin(), recvCells[r].end(), h->recvCells + h->recvOffs[h->nrecv]);
+      h->recvOffs[h->nrecv + 1] = h->recvOffs[h->nrecv] + recvCounts[r];
+      h->nrecv++;
+    }
+  }
+  h->sendBuf = (float *)malloc((4 * nsent + 1) * sizeof(float));
+  h->recvBuf = (float *)malloc((4 * (h->ncells - h->nowned) + 1) * sizeof(float));
+  h->requests = (MPI_Request *)malloc((h->nsend + h->nrecv) * sizeof(MPI_Request));
+
+  //Work arrays of the step
+  h->values = (float *)malloc(4 * h->ncells * sizeof(float));
+  h->midCons = (float *)malloc(4 * h->nlayer1 * sizeof(float));
+  h->inCons = (float *)malloc(4 * h->nlayer1 * sizeof(float));
+  h->outCons = (float *)malloc(4 * h->nowned * sizeof(float));
+  h->mid = (float *)malloc(4 * h->ncells * sizeof(float));
+  h->bathySource = (float *)malloc(2 * h->nedges * sizeof(float));
+  h->edgeFluxes = (float *)malloc(3 * h->nedges * sizeof(float));
+  h->maxEdgeEigenvalues = (float *)malloc(h->nedges * sizeof(float));
+
+  int counts[3] = {h->nlayer1 - h->nowned, h->ncells - h->nlayer1, h->nrecv}, maxCounts[3];
+  MPI_Allreduce(counts, maxCounts, 3, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  op_printf("Deep halo: at most %d + %d halo cells from %d processes per process, one exchange per step\n",
+            maxCounts[0], maxCounts[1], maxCounts[2]);
+}
+
+int volna_halo_enabled() {
+  return halo != NULL;
+}
+
+/*
+ * Values of L1 and L2 from their owners, the own ones copied from values
+ */
+static void halo_exchange(float *values) {
+  DeepHalo *h = halo;
+  VOLNA_TRACE_BEGIN(exchange_t1);
+  for (int k = 0; k < h->nrecv; k++)
+    MPI_Irecv(h->recvBuf + 4 * h->recvOffs[k], 4 * (h->recvOffs[k + 1] - h->recvOffs[k]), MPI_FLOAT,
+              h->recvRanks[k], 0, MPI_COMM_WORLD, &h->requests[k]);
+  for (int k = 0; k < h->nsend; k++) {
+    for (int i = h->sendOffs[k]; i < h->sendOffs[k + 1]; i++)
+      memcpy(h->sendBuf + 4 * i, values + 4 * h->sendCells[i], 4 * sizeof(float));
+    MPI_Isend(h->sendBuf + 4 * h->sendOffs[k], 4 * (h->sendOffs[k + 1] - h->sendOffs[k]), MPI_FLOAT,
+              h->sendRanks[k], 0, MPI_COMM_WORLD, &h->requests[h->nrecv + k]);
+  }
+  memcpy(h->values, values, 4 * h->nowned * sizeof(float));
+  MPI_Waitall(h->nsend + h->nrecv, h->requests, MPI_STATUSES_IGNORE);
+  for (int i = 0; i < h->ncells - h->nowned; i++)
+    memcpy(h->values + 4 * h->recvCells[i], h->recvBuf + 4 * i, 4 * sizeof(float));
+  VOLNA_TRACE_END(exchange_t1, "deepHalo exchange", "mpi wait");
+}
+
+/*
+ * computeFluxes on the edges [0,nedges)
+ */
+static void halo_fluxes(float *in, int nedges) {
+  DeepHalo *h = halo;
+  int *e2c = h->edgeCells;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int e = 0; e < nedges; e++)
+    computeFluxes(in + 4 * e2c[2 * e], in + 4 * e2c[2 * e + 1], h->edgeLength + e, h->edgeNormals + 2 * e,
+                  h->isBoundary + e, h->bathySource + 2 * e, h->edgeFluxes + 3 * e, h->maxEdgeEigenvalues + e);
+}
+
+/*
+ * NumericalFluxes (zeroValues for the second stage) and SpaceDiscretization
+ * on the cells [0,ncells), every cell applying its edges by global index.
+ * Returns the smallest step
+ */
+static float halo_space_discretization(float *out, int ncells, int most) {
+  DeepHalo *h = halo;
+  int *c2e = h->cellEdges, *e2c = h->edgeCells;
+  float *eig = h->maxEdgeEigenvalues, *len = h->edgeLength;
+  float minTimestep = INFINITY;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(min:minTimestep)
+#endif
+  for (int c = 0; c < ncells; c++) {
+    float *eigenvalues[3] = {eig + c2e[3 * c], eig + c2e[3 * c + 1], eig + c2e[3 * c + 2]};
+    float *lengths[3] = {len + c2e[3 * c], len + c2e[3 * c + 1], len + c2e[3 * c + 2]};
+    if (most == 0) NumericalFluxes(eigenvalues, lengths, h->cellVolumes + c, out + 4 * c, &minTimestep);
+    else zeroValues(out + 4 * c);
+    for (int j = 0; j < 3; j++) {
+      int e = h->cellEdgesSorted[3 * c + j];
+      float other[4]; // the update of the cell on the other side, dropped
+      float *volumes[2] = {h->cellVolumes + e2c[2 * e], h->cellVolumes + e2c[2 * e + 1]};
+      if (e2c[2 * e] == c)
+        SpaceDiscretization(out + 4 * c, other, h->edgeFluxes + 3 * e, h->bathySource + 2 * e,
+                            h->edgeNormals + 2 * e, h->isBoundary + e, volumes);
+      else
+        SpaceDiscretization(other, out + 4 * c, h->edgeFluxes + 3 * e, h->bathySource + 2 * e,
+                            h->edgeNormals + 2 * e, h->isBoundary + e, volumes);
+    }
+  }
+  return minTimestep;
+}
+
+/*
+ * One RK2 step with a single halo exchange, the new values of the own
+ * cells are left in values_new like the generated step. Returns dT
+ */
+float volna_halo_step(op_dat values, op_dat values_new) {
+  DeepHalo *h = halo;
+  halo_exchange((float *)values->data);
+
+  //Stage 1 on G0 and L1
+  halo_fluxes(h->values, h->nedges);
+  float localTimestep = halo_space_discretization(h->midCons, h->nlayer1, 0), minTimestep;
+  MPI_Allreduce(&localTimestep, &minTimestep, 1, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+  float dT = CFL * minTimestep;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int c = 0; c < h->nlayer1; c++)
+    EvolveValuesRK2_1(&dT, h->midCons + 4 * c, h->values + 4 * c, h->inCons + 4 * c, h->mid + 4 * c);
+
+  //Stage 2 on G0
+  halo_fluxes(h->mid, h->nedges0);
+  halo_space_discretization(h->outCons, h->nowned, 1);
+  float *out = (float *)values_new->data;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (int c = 0; c < h->nowned; c++)
+    EvolveValuesRK2_2(&dT, h->outCons + 4 * c, h->inCons + 4 * c, h->midCons + 4 * c, out + 4 * c);
+  return dT;
+}
+
+void volna_halo_close() {
+  if (halo == NULL) return;
+  DeepHalo *h = halo;
+  free(h->cellEdges);
+  free(h->cellEdgesSorted);
+  free(h->edgeCells);
+  free(h->edgeNormals);
+  free(h->edgeLength);
+  free(h->isBoundary);
+  free(h->cellVolumes);
+  free(h->values);
+  free(h->midCons);
+  free(h->inCons);
+  free(h->outCons);
+  free(h->mid);
+  free(h->bathySource);
+  free(h->edgeFluxes);
+  free(h->maxEdgeEigenvalues);
+  free(h->sendRanks);
+  free(h->sendOffs);
+  free(h->sendCells);
+  free(h->recvRanks);
+  free(h->recvOffs);
+  free(h->recvCells);
+  free(h->sendBuf);
+  free(h->recvBuf);
+  free(h->requests);
+  delete h;
+  halo = NULL;
+}
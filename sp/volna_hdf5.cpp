@@ -0,0 +1,238 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#include <pthread.h>
+#include <algorithm>
+
+#ifdef VOLNA_CUDA
+void op_upload_dat(op_dat dat);
+#endif
+
+/*
+ * Loading of the mesh and scenario data. Every file is opened once, and
+ * with MPI each process reads only its own contiguous block of every
+ * dataset (a hyperslab), with collective parallel HDF5 I/O when HDF5 is
+ * built with MPI support. The blocks are split like op_decl_*_hdf5 does,
+ * n/nprocs elements per process and the remainder on the last one, so
+ * ParMETIS/EXTERNAL partitioning works as before.
+ */
+
+static int parallel_hdf5 = 0;
+
+// HDF5 is not necessarily built thread-safe, all HDF5 calls made while a
+// background thread (bathymetry prefetch) may be reading have to hold this
+static pthread_mutex_t hdf5_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void volna_hdf5_lock() {
+  pthread_mutex_lock(&hdf5_mutex);
+}
+
+void volna_hdf5_unlock() {
+  pthread_mutex_unlock(&hdf5_mutex);
+}
+
+hid_t volna_open_hdf5(const char *filename) {
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+#ifdef H5_HAVE_PARALLEL
+  if (volna_comm_size() > 1) {
+    H5Pset_fapl_mpio(fapl, MPI_COMM_WORLD, MPI_INFO_NULL);
+    parallel_hdf5 = 1;
+  }
+#endif
+  hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, fapl);
+  H5Pclose(fapl);
+  if (file < 0) {
+    op_printf("can't open HDF5 file %s\n", filename);
+    exit(-1);
+  }
+  return file;
+}
+
+/*
+ * Number of elements of a set of global size n held by this process, and
+ * the global index of the first one
+ */
+static void local_block(int n, int *local_size, int *offset) {
+  int size = volna_comm_size(), rank = 0;
+  if (size > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  *offset = rank * (n / size);
+  *local_size = rank == size - 1 ? n - *offset : n / size;
+}
+
+/*
+ * Read rows [offset, offset+count) of a dataset with dim values per row
+ */
+static void read_block(hid_t file, const char *name, hid_t type, int offset, int count, int dim, void *data) {
+  hid_t dset = H5Dopen(file, name, H5P_DEFAULT);
+  if (dset < 0) {
+    op_printf("dataset %s not found\n", name);
+    exit(-1);
+  }
+  hid_t fspace = H5Dget_space(dset);
+  hsize_t start[2] = {(hsize_t)offset, 0};
+  hsize_t block[2] = {(hsize_t)count, (hsize_t)dim};
+  int rank = H5Sget_simple_extent_ndims(fspace);
+  if (rank == 1) { // stored flat
+    start[0] *= dim;
+    block[0] *= dim;
+  }
+  if (count > 0)
+    check_hdf5_error(H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, block, NULL));
+  else
+    check_hdf5_error(H5Sselect_none(fspace)); // still has to take part in collective reads
+  hid_t mspace = H5Screate_simple(rank, block, NULL);
+  hid_t xfer = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+  if (parallel_hdf5) H5Pset_dxpl_mpio(xfer, H5FD_MPIO_COLLECTIVE);
+#endif
+  check_hdf5_error(H5Dread(dset, type, mspace, fspace, xfer, data));
+  H5Pclose(xfer);
+  H5Sclose(mspace);
+  H5Sclose(fspace);
+  H5Dclose(dset);
+}
+
+/*
+ * Global index of the first element of set held by this process
+ */
+static int set_offset(op_set set) {
+  int offset = 0;
+  if (volna_comm_size() > 1) {
+    MPI_Exscan(&set->size, &offset, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) offset = 0;
+  }
+  return offset;
+}
+
+op_set volna_decl_set_hdf5(hid_t file, const char *name) {
+  int size = 0, local_size, offset;
+  check_hdf5_error(H5LTread_dataset_int(file, name, &size));
+  local_block(size, &local_size, &offset);
+  return op_decl_set(local_size, name);
+}
+
+op_map volna_decl_map_hdf5(op_set from, op_set to, int dim, hid_t file, const char *name) {
+  int *map = (int *)malloc((size_t)from->size * dim * sizeof(int));
+  read_block(file, name, H5T_NATIVE_INT, set_offset(from), from->size, dim, map);
+  return op_decl_map(from, to, dim, map, name);
+}
+
+op_dat volna_decl_dat_hdf5(op_set set, int dim, const char *type, hid_t file, const char *name) {
+  int offset = set_offset(set);
+  if (!strcmp(type, "int")) {
+    int *data = (int *)malloc((size_t)set->size * dim * sizeof(int));
+    read_block(file, name, H5T_NATIVE_INT, offset, set->size, dim, data);
+    return op_decl_dat(set, dim, type, data, name);
+  } else if (!strcmp(type, "double")) {
+    double *data = (double *)malloc((size_t)set->size * dim * sizeof(double));
+    read_block(file, name, H5T_NATIVE_DOUBLE, offset, set->size, dim, data);
+    return op_decl_dat(set, dim, type, data, name);
+  }
+  float *data = (float *)malloc((size_t)set->size * dim * sizeof(float));
+  read_block(file, name, H5T_NATIVE_FLOAT, offset, set->size, dim, data);
+  return op_decl_dat(set, dim, type, data, name);
+}
+
+/*
+ * Global index of every element of set, declared before op_partition so
+ * that it follows the elements when they are migrated
+ */
+op_dat volna_decl_global_index(op_set set, const char *name) {
+  int offset = set_offset(set);
+  int *data = (int *)malloc(set->size * sizeof(int));
+  for (int i = 0; i < set->size; i++) data[i] = offset + i;
+  return op_decl_dat(set, 1, "int", data, name);
+}
+
+/*
+ * Gather a dim-wide cell dat on rank 0, in the order of the global cell
+ * index. out is only filled on rank 0.
+ */
+void volna_gather_cells(op_dat dat, op_dat cellGlobalIndex, int ncell, std::vector<float> *out) {
+  int dim = dat->dim;
+  int n = dat->set->size;
+  float *data = (float *)dat->data;
+  int *gidx = (int *)cellGlobalIndex->data;
+  int size = volna_comm_size(), rank = 0;
+  if (size > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) out->resize((size_t)ncell * dim);
+  if (size == 1) {
+    for (int i = 0; i < n; i++)
+      memcpy(&(*out)[(size_t)gidx[i] * dim], data + (size_t)i * dim, dim * sizeof(float));
+    return;
+  }
+  std::vector<int> counts(size), displs(size);
+  MPI_Gather(&n, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+  std::vector<int> allIdx(rank == 0 ? ncell : 0);
+  std::vector<float> allData(rank == 0 ? (size_t)ncell * dim : 0);
+  for (int r = 0, offset = 0; r < size; r++) {
+    displs[r] = offset;
+    offset += counts[r];
+  }
+  MPI_Gatherv(gidx, n, MPI_INT, rank == 0 ? &allIdx[0] : NULL, &counts[0], &displs[0], MPI_INT, 0, MPI_COMM_WORLD);
+  for (int r = 0; r < size; r++) {
+    counts[r] *= dim;
+    displs[r] *= dim;
+  }
+  MPI_Gatherv(data, n * dim, MPI_FLOAT, rank == 0 ? &allData[0] : NULL, &counts[0], &displs[0], MPI_FLOAT, 0, MPI_COMM_WORLD);
+  if (rank != 0) return;
+  for (int i = 0; i < ncell; i++)
+    memcpy(&(*out)[(size_t)allIdx[i] * dim], &allData[(size_t)i * dim], dim * sizeof(float));
+}
+
+/*
+ * Read the rows gidx[0..n-1] (distinct) of a [nrow][dim] dataset into
+ * data, row i going to data[i*dim]. The rows are sorted and every run of
+ * consecutive ones is selected as one hyperslab, the rows come back in file
+ * order and are then put in place.
+ */
+void volna_read_rows_hdf5(hid_t file, const char *name, hid_t type, int n, const int *gidx, int dim, void *data) {
+  hid_t dset = H5Dopen(file, name, H5P_DEFAULT);
+  if (dset < 0) {
+    op_printf("dataset %s not found\n", name);
+    exit(-1);
+  }
+  hid_t fspace = H5Dget_space(dset);
+  int flat = H5Sget_simple_extent_ndims(fspace) == 1; // [nrow] for dim 1
+  std::vector<std::pair<int, int> > order(n);
+  for (int i = 0; i < n; i++) order[i] = std::make_pair(gidx[i], i);
+  std::sort(order.begin(), order.end());
+  check_hdf5_error(H5Sselect_none(fspace));
+  for (int i = 0; i < n;) {
+    int first = i;
+    while (i + 1 < n && order[i + 1].first == order[i].first + 1) i++;
+    i++;
+    hsize_t start[2] = {(hsize_t)order[first].first, 0};
+    hsize_t block[2] = {(hsize_t)(i - first), (hsize_t)dim};
+    if (flat) {
+      start[0] *= dim;
+      block[0] *= dim;
+    }
+    check_hdf5_error(H5Sselect_hyperslab(fspace, H5S_SELECT_OR, start, NULL, block, NULL));
+  }
+  size_t row = H5Tget_size(type) * dim;
+  hsize_t count = (hsize_t)n * dim;
+  std::vector<char> rows(n * row);
+  hid_t mspace = H5Screate_simple(1, &count, NULL);
+  check_hdf5_error(H5Dread(dset, type, mspace, fspace, H5P_DEFAULT, n > 0 ? &rows[0] : NULL));
+  for (int i = 0; i < n; i++)
+    memcpy((char *)data + order[i].second * row, &rows[i * row], row);
+  H5Sclose(mspace);
+  H5Sclose(fspace);
+  H5Dclose(dset);
+}
+
+/*
+ * Read the rows of a [ncell][dim] float dataset given by the global index
+ * of the cells held by this process
+ */
+void volna_read_cells_hdf5(hid_t file, const char *name, op_dat dat, op_dat cellGlobalIndex) {
+  volna_read_rows_hdf5(file, name, H5T_NATIVE_FLOAT, dat->set->size, (int *)cellGlobalIndex->data, dat->dim,
+                       dat->data);
+  dat->dirtybit = 1; // the halos are exchanged before the next loop reading them
+#ifdef VOLNA_CUDA
+  op_upload_dat(dat);
+#endif
+}
@@ -7,6 +7,7 @@
 #include "incConst.h"
 #include "initBathymetry_formula.h"
 #include "initBathymetry_update.h"
+#include "initBathymetry_interp.h"
 #include "initBore_select.h"
 #include "initEta_formula.h"
 #include "initGaussianLandslide.h"
@@ -63,6 +64,11 @@ void op_par_loop_initBathymetry_update(char const *, op_set,
   op_arg,
   op_arg );
 
+void op_par_loop_initBathymetry_interp(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg );
+
 void op_par_loop_initBore_select(char const *, op_set,
   op_arg,
   op_arg,
@@ -109,31 +115,49 @@ void InitEta(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues,
 #endif
 }
 
-void InitU(op_set cells, op_dat cellCenters, op_dat values) {
+void InitU(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile) {
   //TODO: document the fact that this actually adds to the value of U
   // i.e. user should only access values[1]
 #ifdef DEBUG
   op_printf("InitU...");
 #endif
-  op_par_loop_initU_formula("initU_formula",cells,
-             op_arg_dat(cellCenters,-1,OP_ID,2,"float",OP_READ),
-             op_arg_dat(values,-1,OP_ID,4,"float",OP_INC),
-             op_arg_gbl(&timestamp,1,"float",OP_READ));
+  if (fromFile) {
+    //add the values stored in initValues to values.U
+    int variable = 2; //bitmask 1 - H, 2 - U, 4 - V, 8 - Zb
+    op_par_loop_incConst("incConst",cells,
+               op_arg_dat(initValues,-1,OP_ID,1,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+               op_arg_gbl(&variable,1,"int",OP_READ));
+  } else {
+    op_par_loop_initU_formula("initU_formula",cells,
+               op_arg_dat(cellCenters,-1,OP_ID,2,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_INC),
+               op_arg_gbl(&timestamp,1,"float",OP_READ));
+  }
 #ifdef DEBUG
   op_printf("done\n");
 #endif
 }
 
-void InitV(op_set cells, op_dat cellCenters, op_dat values) {
+void InitV(op_set cells, op_dat cellCenters, op_dat values, op_dat initValues, int fromFile) {
   //TODO: document the fact that this actually adds to the value of V
   // i.e. user should only access values[2]
 #ifdef DEBUG
   op_printf("InitV...");
 #endif
-  op_par_loop_initV_formula("initV_formula",cells,
-             op_arg_dat(cellCenters,-1,OP_ID,2,"float",OP_READ),
-             op_arg_dat(values,-1,OP_ID,4,"float",OP_INC),
-             op_arg_gbl(&timestamp,1,"float",OP_READ));
+  if (fromFile) {
+    //add the values stored in initValues to values.V
+    int variable = 4; //bitmask 1 - H, 2 - U, 4 - V, 8 - Zb
+    op_par_loop_incConst("incConst",cells,
+               op_arg_dat(initValues,-1,OP_ID,1,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+               op_arg_gbl(&variable,1,"int",OP_READ));
+  } else {
+    op_par_loop_initV_formula("initV_formula",cells,
+               op_arg_dat(cellCenters,-1,OP_ID,2,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_INC),
+               op_arg_gbl(&timestamp,1,"float",OP_READ));
+  }
 #ifdef DEBUG
   op_printf("done\n");
 #endif
@@ -181,6 +205,32 @@ void InitBathymetry(op_set cells, op_dat cellCenters, op_dat values, op_dat init
 #endif
 }
 
+/*
+ * InitBathymetry from the streamed bathymetry frames when they are
+ * interpolated in time: Zb is the weighted sum of the frames
+ */
+void InitBathymetryFrames(op_set cells, op_dat values, op_dat frames, float *weights, int firstTime) {
+  if (firstTime) {
+    int result = 0;
+    int leftOperand = 0;
+    int rightOperand = 3;
+    int operation = 0; //0 +, 1 -, 2 *, 3 /
+    op_par_loop_values_operation2("values_operation2",cells,
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+               op_arg_gbl(&result,1,"int",OP_READ),
+               op_arg_gbl(&leftOperand,1,"int",OP_READ),
+               op_arg_gbl(&rightOperand,1,"int",OP_READ),
+               op_arg_gbl(&operation,1,"int",OP_READ));
+  }
+  op_par_loop_initBathymetry_interp("initBathymetry_interp",cells,
+             op_arg_dat(frames,-1,OP_ID,4,"float",OP_READ),
+             op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+             op_arg_gbl(weights,4,"float",OP_READ));
+  op_par_loop_initBathymetry_update("initBathymetry_update",cells,
+             op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+             op_arg_gbl(&firstTime,1,"int",OP_READ));
+}
+
 void InitBore(op_set cells, op_dat cellCenters, op_dat values, BoreParams params) {
 #ifdef DEBUG
   op_printf("InitBore...");
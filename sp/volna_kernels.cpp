@@ -5,6 +5,11 @@
 // header
 
 #include "op_lib_cpp.h"
+#include "volna_ensemble.h"
+#include "volna_lts.h"
+#include "volna_native.h"
+#include "volna_tune.h"
+#include "volna_trace.h"
 
 // global constants
 
@@ -12,11 +17,17 @@ extern float CFL;
 extern float EPS;
 extern float g;
 
+#ifdef VOLNA_NATIVE_OMP
+int volna_native_omp = 1;
+#endif
+
 // user kernel files
 
 #include "EvolveValuesRK2_1_kernel.cpp"
 #include "EvolveValuesRK2_2_kernel.cpp"
+#include "EvolveValuesRK2_2_bathy_kernel.cpp"
 #include "simulation_1_kernel.cpp"
+#include "simulation_1_landslide_kernel.cpp"
 #include "incConst_kernel.cpp"
 #include "initEta_formula_kernel.cpp"
 #include "initU_formula_kernel.cpp"
@@ -25,6 +36,7 @@ extern float g;
 #include "applyConst_kernel.cpp"
 #include "initBathymetry_formula_kernel.cpp"
 #include "initBathymetry_update_kernel.cpp"
+#include "initBathymetry_interp_kernel.cpp"
 #include "initBore_select_kernel.cpp"
 #include "initGaussianLandslide_kernel.cpp"
 #include "getTotalVol_kernel.cpp"
@@ -33,3 +45,22 @@ extern float g;
 #include "computeFluxes_kernel.cpp"
 #include "NumericalFluxes_kernel.cpp"
 #include "SpaceDiscretization_kernel.cpp"
+#include "computeFluxes_ens_kernel.cpp"
+#include "NumericalFluxes_ens_kernel.cpp"
+#include "SpaceDiscretization_ens_kernel.cpp"
+#include "EvolveValuesRK2_1_ens_kernel.cpp"
+#include "EvolveValuesRK2_2_ens_kernel.cpp"
+#include "simulation_1_ens_kernel.cpp"
+#include "initMember_ens_kernel.cpp"
+#include "gatherLocations_ens_kernel.cpp"
+#include "computeFluxes_linear_kernel.cpp"
+#include "initLinearEdges_kernel.cpp"
+#include "ltsFluxes_kernel.cpp"
+#include "ltsSpaceDiscretization_kernel.cpp"
+#include "ltsLocalStep_kernel.cpp"
+#include "ltsClass_kernel.cpp"
+#include "ltsEdgeClass_kernel.cpp"
+#include "ltsStage_kernel.cpp"
+#include "ltsUpdate_kernel.cpp"
+#include "NumericalFluxes_lagged_kernel.cpp"
+#include "zeroValues_kernel.cpp"
@@ -5,6 +5,9 @@
 // header
 
 #include "op_lib_cpp.h"
+#include "volna_ensemble.h"
+#include "volna_lts.h"
+#include "volna_trace.h"
 
 #include "op_cuda_rt_support.h"
 #include "op_cuda_reduction.h"
@@ -27,7 +30,9 @@ void op_decl_const_char(int dim, char const *type,
 
 #include "EvolveValuesRK2_1_kernel.cu"
 #include "EvolveValuesRK2_2_kernel.cu"
+#include "EvolveValuesRK2_2_bathy_kernel.cu"
 #include "simulation_1_kernel.cu"
+#include "simulation_1_landslide_kernel.cu"
 #include "incConst_kernel.cu"
 #include "initEta_formula_kernel.cu"
 #include "initU_formula_kernel.cu"
@@ -36,6 +41,7 @@ void op_decl_const_char(int dim, char const *type,
 #include "applyConst_kernel.cu"
 #include "initBathymetry_formula_kernel.cu"
 #include "initBathymetry_update_kernel.cu"
+#include "initBathymetry_interp_kernel.cu"
 #include "initBore_select_kernel.cu"
 #include "initGaussianLandslide_kernel.cu"
 #include "getTotalVol_kernel.cu"
@@ -44,3 +50,22 @@ void op_decl_const_char(int dim, char const *type,
 #include "computeFluxes_kernel.cu"
 #include "NumericalFluxes_kernel.cu"
 #include "SpaceDiscretization_kernel.cu"
+#include "computeFluxes_ens_kernel.cu"
+#include "NumericalFluxes_ens_kernel.cu"
+#include "SpaceDiscretization_ens_kernel.cu"
+#include "EvolveValuesRK2_1_ens_kernel.cu"
+#include "EvolveValuesRK2_2_ens_kernel.cu"
+#include "simulation_1_ens_kernel.cu"
+#include "initMember_ens_kernel.cu"
+#include "gatherLocations_ens_kernel.cu"
+#include "computeFluxes_linear_kernel.cu"
+#include "initLinearEdges_kernel.cu"
+#include "ltsFluxes_kernel.cu"
+#include "ltsSpaceDiscretization_kernel.cu"
+#include "ltsLocalStep_kernel.cu"
+#include "ltsClass_kernel.cu"
+#include "ltsEdgeClass_kernel.cu"
+#include "ltsStage_kernel.cu"
+#include "ltsUpdate_kernel.cu"
+#include "NumericalFluxes_lagged_kernel.cu"
+#include "zeroValues_kernel.cu"
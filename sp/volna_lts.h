@@ -0,0 +1,8 @@
+#ifndef VOLNA_LTS_H
+#define VOLNA_LTS_H
+
+// Largest number of rate classes of local time stepping (lts=), the kernels
+// receive the step of every class as one global array of this size
+#define VOLNA_LTS_CLASSES 8
+
+#endif
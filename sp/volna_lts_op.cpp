@@ -0,0 +1,263 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+#include "volna_common.h"
+#include "computeFluxes.h"
+#include "ltsFluxes.h"
+#include "ltsSpaceDiscretization.h"
+#include "ltsLocalStep.h"
+#include "ltsClass.h"
+#include "ltsEdgeClass.h"
+#include "ltsStage.h"
+#include "ltsUpdate.h"
+
+#include "op_lib_cpp.h"
+//int op2_stride = 1;
+//#define OP2_STRIDE(arr, idx) arr[op2_stride*(idx)]
+
+//
+// op_par_loop declarations
+//
+
+void op_par_loop_ltsFluxes(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsSpaceDiscretization(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsLocalStep(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsClass(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsEdgeClass(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsStage(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+void op_par_loop_ltsUpdate(char const *, op_set,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg,
+  op_arg );
+
+/*
+ * Local time stepping (lts=classes). A cell of class c steps with 2^c dt0,
+ * where dt0 is the CFL step of the smallest cells, so the large deep water
+ * cells no longer advance with the step of the small coastal ones. An edge
+ * steps with the faster of its two cells. One iteration of the main loop
+ * is a macro step of 2^(classes-1) substeps of dt0; at every substep the
+ * edges and cells whose step starts then do a Heun step, and the edge
+ * contributions are accumulated until the step of the cell ends, so the
+ * scheme stays conservative. The slower neighbours of a cell are frozen
+ * during its step, which is first order at the class interfaces.
+ *
+ * The classes come from the local stable steps of the cells and are
+ * recomputed every ltsEvery iterations (10 by default). OP2 has no dynamic
+ * subsets, so the loops run over the whole mesh and skip the idle elements.
+ */
+
+struct Lts {
+  int maxClasses;              // lts=, at most VOLNA_LTS_CLASSES
+  int classes;                 // classes in use, the largest is classes-1
+  int every;                   // ltsEvery=
+  int reclassify;              // classes have to be computed at the next step
+  op_dat cellClass, edgeClass;
+  op_dat localDt;              // local stable step of the cells
+  op_dat R1, R2;               // increments of both Heun stages at a substep
+  op_dat acc;                  // increments since the step of the cell started
+  op_dat stage;                // predictor of the cells stepping at a substep
+};
+
+static Lts *lts = NULL;
+
+void volna_lts_init(int argc, char **argv, op_set cells, op_set edges) {
+  const char *classes = volna_option(argc, argv, "lts");
+  if (classes == NULL) return;
+  lts = new Lts;
+  lts->maxClasses = atoi(classes);
+  if (lts->maxClasses < 1 || lts->maxClasses > VOLNA_LTS_CLASSES) {
+    op_printf("lts=%s: the number of classes has to be between 1 and %d\n", classes, VOLNA_LTS_CLASSES);
+    exit(-1);
+  }
+  const char *every = volna_option(argc, argv, "ltsEvery");
+  lts->every = every == NULL ? 10 : atoi(every);
+  if (lts->every < 1) lts->every = 1;
+  lts->classes = lts->maxClasses;
+  lts->reclassify = 1;
+
+  int *tmp_int = NULL;
+  float *tmp_elem = NULL;
+  lts->cellClass = op_decl_dat_temp(cells, 1, "int", tmp_int, "cellClass");
+  lts->edgeClass = op_decl_dat_temp(edges, 1, "int", tmp_int, "edgeClass");
+  lts->localDt = op_decl_dat_temp(cells, 1, "float", tmp_elem, "localDt");
+  lts->R1 = op_decl_dat_temp(cells, 4, "float", tmp_elem, "ltsR1");
+  lts->R2 = op_decl_dat_temp(cells, 4, "float", tmp_elem, "ltsR2");
+  lts->acc = op_decl_dat_temp(cells, 4, "float", tmp_elem, "ltsAcc");
+  lts->stage = op_decl_dat_temp(cells, 4, "float", tmp_elem, "ltsStage");
+  op_printf("Local time stepping with up to %d classes, reclassified every %d steps\n",
+            lts->maxClasses, lts->every);
+}
+
+int volna_lts_enabled() {
+  return lts != NULL;
+}
+
+static void lts_fluxes(op_set edges, op_map edgesToCells, op_dat in, op_dat edgeNormals, op_dat edgeLength,
+                       op_dat isBoundary, op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
+                       float *weights) {
+  op_par_loop_ltsFluxes("ltsFluxes",edges,
+             op_arg_dat(in,0,edgesToCells,4,"float",OP_READ),
+             op_arg_dat(in,1,edgesToCells,4,"float",OP_READ),
+             op_arg_dat(edgeLength,-1,OP_ID,1,"float",OP_READ),
+             op_arg_dat(edgeNormals,-1,OP_ID,2,"float",OP_READ),
+             op_arg_dat(isBoundary,-1,OP_ID,1,"int",OP_READ),
+             op_arg_dat(bathySource,-1,OP_ID,2,"float",OP_WRITE),
+             op_arg_dat(edgeFluxes,-1,OP_ID,3,"float",OP_WRITE),
+             op_arg_dat(maxEdgeEigenvalues,-1,OP_ID,1,"float",OP_WRITE),
+             op_arg_dat(lts->edgeClass,-1,OP_ID,1,"int",OP_READ),
+             op_arg_gbl(weights,VOLNA_LTS_CLASSES,"float",OP_READ));
+}
+
+static void lts_space_discretization(op_set edges, op_map edgesToCells, op_dat out, op_dat edgeNormals,
+                                     op_dat cellVolumes, op_dat isBoundary, op_dat bathySource,
+                                     op_dat edgeFluxes, float *weights) {
+  op_par_loop_ltsSpaceDiscretization("ltsSpaceDiscretization",edges,
+             op_arg_dat(out,0,edgesToCells,4,"float",OP_INC),
+             op_arg_dat(out,1,edgesToCells,4,"float",OP_INC),
+             op_arg_dat(edgeFluxes,-1,OP_ID,3,"float",OP_READ),
+             op_arg_dat(bathySource,-1,OP_ID,2,"float",OP_READ),
+             op_arg_dat(edgeNormals,-1,OP_ID,2,"float",OP_READ),
+             op_arg_dat(isBoundary,-1,OP_ID,1,"int",OP_READ),
+             op_arg_dat(cellVolumes,-2,edgesToCells,1,"float",OP_READ),
+             op_arg_dat(lts->edgeClass,-1,OP_ID,1,"int",OP_READ),
+             op_arg_gbl(weights,VOLNA_LTS_CLASSES,"float",OP_READ));
+}
+
+/*
+ * Advance the values by one macro step, returns its length
+ */
+float volna_lts_step(op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges,
+                     op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                     op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
+                     op_dat values, float dtmax) {
+  float weights[VOLNA_LTS_CLASSES], ending[VOLNA_LTS_CLASSES];
+
+  //Every edge starts a step with the macro step, and their wave speeds give the local steps
+  for (int c = 0; c < VOLNA_LTS_CLASSES; c++) weights[c] = 1.0f;
+  lts_fluxes(edges, edgesToCells, values, edgeNormals, edgeLength, isBoundary,
+             bathySource, edgeFluxes, maxEdgeEigenvalues, weights);
+
+  //{min localDt/2^class, min localDt, -max localDt}
+  float minTimestep[3] = {INFINITY, INFINITY, INFINITY};
+  op_par_loop_ltsLocalStep("ltsLocalStep",cells,
+             op_arg_dat(maxEdgeEigenvalues,-3,cellsToEdges,1,"float",OP_READ),
+             op_arg_dat(edgeLength,-3,cellsToEdges,1,"float",OP_READ),
+             op_arg_dat(cellVolumes,-1,OP_ID,1,"float",OP_READ),
+             op_arg_dat(lts->cellClass,-1,OP_ID,1,"int",OP_READ),
+             op_arg_dat(lts->localDt,-1,OP_ID,1,"float",OP_WRITE),
+             op_arg_gbl(minTimestep,3,"float",OP_MIN));
+
+  if (lts->reclassify || itercount % lts->every == 0) {
+    lts->classes = 1;
+    float ratio = -minTimestep[2] / minTimestep[1];
+    while (lts->classes < lts->maxClasses && ratio >= 2.0f) {
+      ratio *= 0.5f;
+      lts->classes++;
+    }
+    float params[2] = {minTimestep[1], (float)(lts->classes - 1)};
+    op_par_loop_ltsClass("ltsClass",cells,
+               op_arg_gbl(params,2,"float",OP_READ),
+               op_arg_dat(lts->localDt,-1,OP_ID,1,"float",OP_READ),
+               op_arg_dat(lts->cellClass,-1,OP_ID,1,"int",OP_WRITE));
+    op_par_loop_ltsEdgeClass("ltsEdgeClass",edges,
+               op_arg_dat(lts->cellClass,0,edgesToCells,1,"int",OP_READ),
+               op_arg_dat(lts->cellClass,1,edgesToCells,1,"int",OP_READ),
+               op_arg_dat(isBoundary,-1,OP_ID,1,"int",OP_READ),
+               op_arg_dat(lts->edgeClass,-1,OP_ID,1,"int",OP_WRITE));
+    //every cell of class c has localDt >= 2^c min localDt
+    minTimestep[0] = minTimestep[1];
+    lts->reclassify = 0;
+  }
+
+  int substeps = 1 << (lts->classes - 1);
+  float dt0 = CFL * minTimestep[0];
+  if (dt0 * substeps > dtmax) dt0 = dtmax / substeps;
+
+  for (int s = 0; s < substeps; s++) {
+    for (int c = 0; c < VOLNA_LTS_CLASSES; c++) {
+      weights[c] = s % (1 << c) == 0 ? dt0 * (1 << c) : 0.0f;
+      ending[c] = (s + 1) % (1 << c) == 0 ? 1.0f : 0.0f;
+    }
+    if (s > 0)
+      lts_fluxes(edges, edgesToCells, values, edgeNormals, edgeLength, isBoundary,
+                 bathySource, edgeFluxes, maxEdgeEigenvalues, weights);
+    lts_space_discretization(edges, edgesToCells, lts->R1, edgeNormals, cellVolumes, isBoundary,
+                             bathySource, edgeFluxes, weights);
+    op_par_loop_ltsStage("ltsStage",cells,
+               op_arg_gbl(weights,VOLNA_LTS_CLASSES,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_READ),
+               op_arg_dat(lts->R1,-1,OP_ID,4,"float",OP_READ),
+               op_arg_dat(lts->cellClass,-1,OP_ID,1,"int",OP_READ),
+               op_arg_dat(lts->stage,-1,OP_ID,4,"float",OP_WRITE));
+    lts_fluxes(edges, edgesToCells, lts->stage, edgeNormals, edgeLength, isBoundary,
+               bathySource, edgeFluxes, maxEdgeEigenvalues, weights);
+    lts_space_discretization(edges, edgesToCells, lts->R2, edgeNormals, cellVolumes, isBoundary,
+                             bathySource, edgeFluxes, weights);
+    op_par_loop_ltsUpdate("ltsUpdate",cells,
+               op_arg_gbl(ending,VOLNA_LTS_CLASSES,"float",OP_READ),
+               op_arg_dat(values,-1,OP_ID,4,"float",OP_RW),
+               op_arg_dat(lts->R1,-1,OP_ID,4,"float",OP_RW),
+               op_arg_dat(lts->R2,-1,OP_ID,4,"float",OP_RW),
+               op_arg_dat(lts->acc,-1,OP_ID,4,"float",OP_RW),
+               op_arg_dat(lts->cellClass,-1,OP_ID,1,"int",OP_READ));
+  }
+
+  return dt0 * substeps;
+}
+
+void volna_lts_close() {
+  if (lts == NULL) return;
+  op_dat dats[7] = {lts->cellClass, lts->edgeClass, lts->localDt, lts->R1, lts->R2, lts->acc, lts->stage};
+  for (int i = 0; i < 7; i++)
+    if (op_free_dat_temp(dats[i]) < 0)
+      op_printf("Error: temporary op_dat %s cannot be removed\n", dats[i]->name);
+  delete lts;
+  lts = NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef VOLNA_NATIVE_H
+#define VOLNA_NATIVE_H
+
+// The OpenMP stubs of computeFluxes, NumericalFluxes and SpaceDiscretization
+// built with -DVOLNA_NATIVE_OMP can index the global arrays through the maps
+// instead of staging the indirect data of each block, selected at run time
+// (ompNative=0|1)
+#ifdef VOLNA_NATIVE_OMP
+extern int volna_native_omp;
+#endif
+
+#endif
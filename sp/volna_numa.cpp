@@ -0,0 +1,175 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <sched.h>
+#include <sys/mman.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * NUMA placement (numa=1), for the OpenMP builds. The OpenMP threads are
+ * pinned compactly, in the order of the cores the process may run on,
+ * then the mesh maps and the dats of the RK2 step are moved to memory
+ * aligned to 2 MB and advised for transparent huge pages, and first
+ * touched by the thread that gets the same elements in the direct loops of
+ * OP2 (a contiguous chunk of 1/nthreads of the set), so that each socket
+ * mostly streams its own memory. The indirect loops hand their blocks to
+ * the threads color by color, so they are only local on average.
+ *
+ * The bandwidth of a triad run by the threads of each socket alone, then
+ * by all threads, is printed. With MPI the processes have to be bound to
+ * disjoint sets of cores by mpirun.
+ */
+
+#ifdef _OPENMP
+#define NUMA_PAGE (2 << 20)
+#define NUMA_TRIAD (1 << 19) // doubles per array and thread
+
+static int cpu_socket(int cpu) {
+  char name[128];
+  sprintf(name, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+  FILE *f = fopen(name, "r");
+  int socket = 0;
+  if (f == NULL) return 0;
+  if (fscanf(f, "%d", &socket) != 1) socket = 0;
+  fclose(f);
+  return socket;
+}
+
+/*
+ * Pin thread i to the i-th core of the affinity mask of the process,
+ * returns the socket of every thread
+ */
+static std::vector<int> pin_threads() {
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  sched_getaffinity(0, sizeof(mask), &mask);
+  std::vector<int> cpus;
+  for (int c = 0; c < CPU_SETSIZE; c++)
+    if (CPU_ISSET(c, &mask)) cpus.push_back(c);
+  std::vector<int> sockets(omp_get_max_threads());
+  #pragma omp parallel
+  {
+    int thr = omp_get_thread_num();
+    int cpu = cpus[thr % cpus.size()];
+    cpu_set_t own;
+    CPU_ZERO(&own);
+    CPU_SET(cpu, &own);
+    sched_setaffinity(0, sizeof(own), &own);
+    sockets[thr] = cpu_socket(cpu);
+  }
+  return sockets;
+}
+
+static char *numa_alloc(size_t bytes) {
+  void *p = NULL;
+  size_t rounded = (bytes + NUMA_PAGE - 1) / NUMA_PAGE * NUMA_PAGE;
+  if (rounded == 0) rounded = NUMA_PAGE;
+  if (posix_memalign(&p, NUMA_PAGE, rounded)) {
+    op_printf("numa: can't allocate %lu bytes\n", (unsigned long)rounded);
+    exit(-1);
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+  return (char *)p;
+}
+
+/*
+ * Copy of data (n elements of size bytes, the first owned of them owned by
+ * this process) first touched by the threads of the direct loops
+ */
+static char *numa_place(char *data, int owned, int n, size_t size) {
+  char *placed = numa_alloc((size_t)n * size);
+  int nthreads = omp_get_max_threads();
+  #pragma omp parallel for
+  for (int thr = 0; thr < nthreads; thr++) {
+    size_t start  = ((size_t)owned* thr   )/nthreads;
+    size_t finish = ((size_t)owned*(thr+1))/nthreads;
+    memcpy(placed + start * size, data + start * size, (finish - start) * size);
+  }
+  if (n > owned)
+    memcpy(placed + (size_t)owned * size, data + (size_t)owned * size, (size_t)(n - owned) * size);
+  free(data);
+  return placed;
+}
+
+/*
+ * Triad bandwidth of the threads of socket s, or of all threads if s < 0
+ */
+static double triad_bandwidth(std::vector<double *> &a, std::vector<double *> &b, std::vector<double *> &c,
+                              const std::vector<int> &sockets, int s) {
+  int reps = 10, active = 0;
+  for (unsigned int t = 0; t < sockets.size(); t++) active += s < 0 || sockets[t] == s;
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  op_timers(&cpu_t1, &wall_t1);
+  #pragma omp parallel
+  {
+    int thr = omp_get_thread_num();
+    if (s < 0 || sockets[thr] == s) {
+      double *x = a[thr], *y = b[thr], *z = c[thr];
+      for (int r = 0; r < reps; r++)
+        for (int i = 0; i < NUMA_TRIAD; i++)
+          x[i] = y[i] + 3.0 * z[i];
+    }
+  }
+  op_timers(&cpu_t2, &wall_t2);
+  return 3.0 * sizeof(double) * NUMA_TRIAD * reps * active / (wall_t2 - wall_t1) / 1e9;
+}
+
+static void numa_report(const std::vector<int> &sockets) {
+  int nthreads = sockets.size(), nsockets = 0;
+  for (int t = 0; t < nthreads; t++) nsockets = MAX(nsockets, sockets[t] + 1);
+  std::vector<double *> a(nthreads), b(nthreads), c(nthreads);
+  #pragma omp parallel
+  {
+    int thr = omp_get_thread_num();
+    a[thr] = (double *)numa_alloc(NUMA_TRIAD * sizeof(double));
+    b[thr] = (double *)numa_alloc(NUMA_TRIAD * sizeof(double));
+    c[thr] = (double *)numa_alloc(NUMA_TRIAD * sizeof(double));
+    for (int i = 0; i < NUMA_TRIAD; i++) {
+      a[thr][i] = 0.0;
+      b[thr][i] = 1.0;
+      c[thr][i] = 2.0;
+    }
+  }
+  for (int s = 0; s < nsockets; s++) {
+    int n = 0;
+    for (int t = 0; t < nthreads; t++) n += sockets[t] == s;
+    if (n > 0)
+      op_printf("numa: socket %d, %d threads, triad %.1f GB/s\n", s, n, triad_bandwidth(a, b, c, sockets, s));
+  }
+  op_printf("numa: all %d threads, triad %.1f GB/s\n", nthreads, triad_bandwidth(a, b, c, sockets, -1));
+  for (int t = 0; t < nthreads; t++) {
+    free(a[t]);
+    free(b[t]);
+    free(c[t]);
+  }
+}
+#endif
+
+void volna_numa_init(int argc, char **argv, int ndats, op_dat *dats, int nmaps, op_map *maps) {
+  if (volna_option(argc, argv, "numa") == NULL) return;
+#ifdef _OPENMP
+  std::vector<int> sockets = pin_threads();
+  size_t bytes = 0;
+  for (int i = 0; i < ndats; i++) {
+    op_set set = dats[i]->set;
+    int n = set->size + set->exec_size + set->nonexec_size;
+    dats[i]->data = numa_place(dats[i]->data, set->size, n, dats[i]->size);
+    bytes += (size_t)n * dats[i]->size;
+  }
+  for (int i = 0; i < nmaps; i++) {
+    op_set from = maps[i]->from;
+    int n = from->size + from->exec_size;
+    size_t size = maps[i]->dim * sizeof(int);
+    maps[i]->map = (int *)numa_place((char *)maps[i]->map, from->size, n, size);
+    bytes += (size_t)n * size;
+  }
+  op_printf("numa: %d threads pinned, %.1f MB moved to huge pages\n", (int)sockets.size(), bytes / 1048576.0);
+  numa_report(sockets);
+#else
+  op_printf("numa is ignored without OpenMP\n");
+#endif
+}
@@ -29,7 +29,6 @@ void op_par_loop_gatherLocations(char const *, op_set,
   op_arg );
 
 
-int outputLocation_lastupdate = -1;
 /*
  * Utility function for binary output: swaps byte endianneses
  */
@@ -390,44 +389,52 @@ void OutputMaxElevation(EventParams *event, TimerParams* timer, op_dat nodeCoord
 }
 
 /*
- * Write H + Zb on the given location (x,y) to ASCII file
+ * Write H + Zb at the locations (x,y) of a batch of OutputLocation events
+ * due at the same time, each to its own ASCII file
  */
-void OutputLocation(EventParams *event, int eventid, TimerParams* timer, op_set cells, op_dat nodeCoords, op_map cellsToNodes, op_dat values, op_map outputLocation_map, op_dat outputLocation_dat) {
-  op_fetch_data(values);
-
-  char filename[255];
-  strcpy(filename, event->streamName.c_str());
-  //op_printf("Write OutputLocation to file: %s \n", filename);
-
-  FILE* fp;
-
-  // The first time this event happens, erase the file if it already
-  // exists
-  if ( (timer->istart == 0 || timer->start == 0) && timer->iter == 0 ) {
-    fp = fopen(filename, "w");
-  } else {
-    fp = fopen(filename, "a");
-  }
-
-  if(fp == NULL) {
-    op_printf("can't open file for write %s\n",filename);
-    exit(-1);
-  }
-
-	if (outputLocation_lastupdate == -1 || timer->iter != (unsigned int)outputLocation_lastupdate) {
-		op_par_loop_gatherLocations("gatherLocations",outputLocation_map->from,
+void OutputLocation(int n, EventParams **events, TimerParams **timers, op_dat values, op_map outputLocation_map, op_dat outputLocation_dat) {
+  // The values at all gauges are gathered once for the whole batch
+  op_par_loop_gatherLocations("gatherLocations",outputLocation_map->from,
              op_arg_dat(values,0,outputLocation_map,4,"float",OP_READ),
              op_arg_dat(outputLocation_dat,-1,OP_ID,1,"float",OP_WRITE));
-		op_fetch_data(outputLocation_dat);
-		outputLocation_lastupdate = timer->iter;
-	}
-	float val = ((float*)(outputLocation_dat->data))[eventid];
+  op_fetch_data(outputLocation_dat);
+  // In ensemble mode the other members follow in further columns
+  int members = volna_ensemble_size();
+  float *ensembleGauges = members > 1 ? (float *)volna_ensemble_gauges(outputLocation_map)->data : NULL;
+
+  for (int k = 0; k < n; k++) {
+    EventParams *event = events[k];
+    TimerParams *timer = timers[k];
+    char filename[255];
+    strcpy(filename, event->streamName.c_str());
+    //op_printf("Write OutputLocation to file: %s \n", filename);
+
+    FILE* fp;
+
+    // The first time this event happens, erase the file if it already
+    // exists
+    if ( (timer->istart == 0 || timer->start == 0) && timer->iter == 0 ) {
+      fp = fopen(filename, "w");
+    } else {
+      fp = fopen(filename, "a");
+    }
+
+    if(fp == NULL) {
+      op_printf("can't open file for write %s\n",filename);
+      exit(-1);
+    }
 
-  fprintf(fp, "%lf %10.20g\n", timer->t, val);
+    float val = ((float*)(outputLocation_dat->data))[event->gaugeId];
 
-  if(fclose(fp)) {
-    op_printf("can't close file %s\n",filename);
-    exit(-1);
+    fprintf(fp, "%lf %10.20g", timer->t, val);
+    for (int m = 1; m < members; m++)
+      fprintf(fp, " %10.20g", ensembleGauges[event->gaugeId * VOLNA_ENSEMBLE + m]);
+    fprintf(fp, "\n");
+
+    if(fclose(fp)) {
+      op_printf("can't close file %s\n",filename);
+      exit(-1);
+    }
   }
 }
 
@@ -0,0 +1,185 @@
+#include "volna_common.h"
+#include "volna_partition.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+
+/*
+ * Number of MPI processes, 1 for the builds without MPI
+ */
+int volna_comm_size() {
+  int initialized = 0, size = 1;
+  MPI_Initialized(&initialized);
+  if (initialized) MPI_Comm_size(MPI_COMM_WORLD, &size);
+  return size;
+}
+
+/*
+ * Returns the partitioning of the cells that volna2hdf5 stored in the mesh
+ * file for the current number of MPI processes, or NULL if there is none
+ */
+op_dat read_partition_hdf5(hid_t meshfile, op_set cells) {
+  int nparts = volna_comm_size();
+  char name[32];
+  sprintf(name, "partition%d", nparts);
+  if (H5LTfind_dataset(meshfile, name) <= 0) return NULL;
+  op_printf("Using partitioning precomputed for %d processes\n", nparts);
+  return volna_decl_dat_hdf5(cells, 1, "int", meshfile, name);
+}
+
+/*
+ * Parallel Hilbert curve partitioning of the cells, before op_partition:
+ * every process holds a block of cellCenters. The curve is cut at the keys
+ * where the cumulative weight reaches k/nparts of the total, found by a
+ * bisection over the key space that is done on all processes at once.
+ */
+op_dat hsfc_partition(op_set cells, op_dat cellCenters, op_dat weights) {
+  int nparts = volna_comm_size();
+  int n = cells->size;
+  float *centers = (float *)cellCenters->data;
+  float *w = weights ? (float *)weights->data : NULL;
+
+  float bbox[4] = {INFINITY, -INFINITY, INFINITY, -INFINITY};
+  for (int i = 0; i < n; i++) {
+    bbox[0] = MIN(bbox[0], centers[2*i]);   bbox[1] = MAX(bbox[1], centers[2*i]);
+    bbox[2] = MIN(bbox[2], centers[2*i+1]); bbox[3] = MAX(bbox[3], centers[2*i+1]);
+  }
+  float lmin[2] = {bbox[0], bbox[2]}, lmax[2] = {bbox[1], bbox[3]}, gmin[2], gmax[2];
+  MPI_Allreduce(lmin, gmin, 2, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(lmax, gmax, 2, MPI_FLOAT, MPI_MAX, MPI_COMM_WORLD);
+  bbox[0] = gmin[0]; bbox[1] = gmax[0]; bbox[2] = gmin[1]; bbox[3] = gmax[1];
+
+  // Local keys in curve order, with the prefix sums of their weights
+  std::vector<unsigned long long> keys(n);
+  std::vector<std::pair<unsigned long long, double> > sorted(n);
+  for (int i = 0; i < n; i++) {
+    keys[i] = hilbertKey(centers[2*i], centers[2*i+1], bbox);
+    sorted[i] = std::make_pair(keys[i], w ? (double)w[i] : 1.0);
+  }
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<unsigned long long> sortedKeys(n);
+  std::vector<double> prefix(n+1, 0.0);
+  for (int i = 0; i < n; i++) {
+    sortedKeys[i] = sorted[i].first;
+    prefix[i+1] = prefix[i] + sorted[i].second;
+  }
+  double total = 0.0;
+  MPI_Allreduce(&prefix[n], &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  // Splitter k is the smallest key with at least k/nparts of the weight below it
+  int nsplit = nparts - 1;
+  std::vector<unsigned long long> lo(nsplit, 0), hi(nsplit, 1ULL << (2*HSFC_ORDER));
+  std::vector<double> below(nsplit), gbelow(nsplit);
+  std::vector<unsigned long long> mid(nsplit);
+  for (int iter = 0; iter <= 2*HSFC_ORDER; iter++) {
+    for (int k = 0; k < nsplit; k++) {
+      mid[k] = lo[k] + (hi[k] - lo[k]) / 2;
+      below[k] = prefix[std::lower_bound(sortedKeys.begin(), sortedKeys.end(), mid[k]) - sortedKeys.begin()];
+    }
+    MPI_Allreduce(&below[0], &gbelow[0], nsplit, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    for (int k = 0; k < nsplit; k++) {
+      if (gbelow[k] < total * (k+1) / nparts) lo[k] = mid[k] + 1;
+      else hi[k] = mid[k];
+    }
+  }
+
+  int *part = (int *)malloc(n * sizeof(int));
+  for (int i = 0; i < n; i++)
+    part[i] = std::upper_bound(lo.begin(), lo.end(), keys[i]) - lo.begin();
+  return op_decl_dat(cells, 1, "int", part, "hsfc_partition");
+}
+
+/*
+ * Report the quality of the partitioning: number of edges between cells
+ * on different processes and the imbalance of the (weighted) cell counts
+ */
+void partition_report(op_set cells, op_set edges, op_map edgesToCells, op_dat weights) {
+  int cut = 0, gcut = 0;
+  for (int i = 0; i < edges->size; i++)
+    if (edgesToCells->map[2*i] >= cells->size || edgesToCells->map[2*i+1] >= cells->size)
+      cut++;
+  double load = 0.0, maxload = 0.0, sumload = 0.0;
+  for (int i = 0; i < cells->size; i++)
+    load += weights ? ((float *)weights->data)[i] : 1.0;
+  MPI_Allreduce(&cut, &gcut, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(&load, &maxload, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(&load, &sumload, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  op_printf("Partitioning quality: edge-cut %d, load imbalance %g\n", gcut,
+      maxload / (sumload / volna_comm_size()));
+}
+
+#ifdef HAVE_PARMETIS
+static const char *partitioners[] = {"HSFC", "PARMETIS", "PRECOMPUTED"};
+#else
+static const char *partitioners[] = {"HSFC", "PRECOMPUTED"};
+#endif
+#define N_PARTITIONERS (int)(sizeof(partitioners) / sizeof(partitioners[0]))
+
+/*
+ * Partition the mesh for MPI runs. The partitioner is chosen with
+ * partitioner=HSFC|PARMETIS|PRECOMPUTED; by default the partitioning stored
+ * by volna2hdf5 is used if there is one, then ParMETIS if Volna was built
+ * with it, then the Hilbert curve partitioner. Optional cell weights are
+ * read from the scenario file with partitionWeights=<dataset>, or from
+ * the checkpoint given by restart= when the load monitor stored them
+ * there; the latter are used with the Hilbert curve partitioner by default.
+ */
+void volna_partition(int argc, char **argv, hid_t file, hid_t meshfile,
+                     op_set cells, op_set edges, op_map edgesToCells, op_dat cellCenters) {
+  const char *partitioner = volna_option(argc, argv, "partitioner");
+  if (partitioner != NULL) {
+    int known = 0;
+    for (int i = 0; i < N_PARTITIONERS; i++) known |= !strcmp(partitioner, partitioners[i]);
+    if (!known) {
+      op_printf("Unknown partitioner=%s, this build accepts", partitioner);
+      for (int i = 0; i < N_PARTITIONERS; i++) op_printf(" %s", partitioners[i]);
+      op_printf("\n");
+      exit(-1);
+    }
+  }
+  if (volna_comm_size() == 1) {
+    op_partition("PARMETIS", "GEOM", NULL, NULL, cellCenters);
+    return;
+  }
+  const char *weights_name = volna_option(argc, argv, "partitionWeights");
+  op_dat weights = NULL;
+  if (weights_name != NULL)
+    weights = volna_decl_dat_hdf5(cells, 1, "float", file, weights_name);
+  const char *restart_file = volna_option(argc, argv, "restart");
+  int rebalance = 0;
+  if (weights == NULL && restart_file != NULL) {
+    hid_t restart = volna_open_hdf5(restart_file);
+    if (H5LTfind_dataset(restart, "partitionWeights") > 0) {
+      op_printf("Rebalancing with the cell loads stored in %s\n", restart_file);
+      weights = volna_decl_dat_hdf5(cells, 1, "float", restart, "partitionWeights");
+      rebalance = 1;
+    }
+    check_hdf5_error(H5Fclose(restart));
+  }
+
+  double cpu_t1, cpu_t2, wall_t1, wall_t2;
+  op_timers(&cpu_t1, &wall_t1);
+  op_dat partition = NULL;
+  if ((partitioner == NULL && !rebalance) || (partitioner != NULL && !strcmp(partitioner, "PRECOMPUTED"))) {
+    partition = read_partition_hdf5(meshfile, cells);
+    if (partition == NULL && partitioner != NULL) {
+      op_printf("No partitioning precomputed for %d processes\n", volna_comm_size());
+      exit(-1);
+    }
+  }
+#ifdef HAVE_PARMETIS
+  int hsfc = (partitioner == NULL && rebalance) || (partitioner != NULL && !strcmp(partitioner, "HSFC"));
+#else
+  int hsfc = partitioner == NULL || !strcmp(partitioner, "HSFC");
+#endif
+  if (partition == NULL && hsfc) {
+    op_printf("Partitioning with the Hilbert curve partitioner\n");
+    partition = hsfc_partition(cells, cellCenters, weights);
+  }
+  if (partition != NULL)
+    op_partition("EXTERNAL", "", cells, NULL, partition);
+  else
+    op_partition("PARMETIS", "GEOM", NULL, NULL, cellCenters);
+  op_timers(&cpu_t2, &wall_t2);
+  op_printf("Partitioning took %g s\n", wall_t2 - wall_t1);
+  partition_report(cells, edges, edgesToCells, weights);
+}
@@ -0,0 +1,74 @@
+#ifndef VOLNA_PARTITION_H
+#define VOLNA_PARTITION_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+/*
+ * Hilbert space-filling curve partitioning: cells are ordered along the
+ * curve through their centres and the curve is cut into pieces of equal
+ * weight. Shared by volna2hdf5 (serial, used when METIS is not available)
+ * and the solver (parallel version in volna_partition.cpp).
+ */
+
+#define HSFC_ORDER 31 // bits per coordinate, the keys use 2*HSFC_ORDER bits
+
+/*
+ * Position of (x,y) along the Hilbert curve covering the box
+ * bbox = {xmin, xmax, ymin, ymax}
+ */
+inline unsigned long long hilbertKey(float x, float y, const float *bbox) {
+  const unsigned long long n = 1ULL << HSFC_ORDER;
+  double sx = (bbox[1] > bbox[0]) ? (x - bbox[0]) / (double)(bbox[1] - bbox[0]) : 0.0;
+  double sy = (bbox[3] > bbox[2]) ? (y - bbox[2]) / (double)(bbox[3] - bbox[2]) : 0.0;
+  unsigned long long ix = (unsigned long long)(MIN(MAX(sx, 0.0), 1.0) * (n - 1));
+  unsigned long long iy = (unsigned long long)(MIN(MAX(sy, 0.0), 1.0) * (n - 1));
+  unsigned long long d = 0;
+  for (unsigned long long s = n / 2; s > 0; s /= 2) {
+    unsigned long long rx = (ix & s) > 0;
+    unsigned long long ry = (iy & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant
+    if (ry == 0) {
+      if (rx == 1) {
+        ix = n - 1 - ix;
+        iy = n - 1 - iy;
+      }
+      unsigned long long t = ix;
+      ix = iy;
+      iy = t;
+    }
+  }
+  return d;
+}
+
+/*
+ * Serial partitioning of n cells with centres coords[2*i], coords[2*i+1]
+ * into nparts parts of (roughly) equal weight. weights may be NULL.
+ */
+inline void hsfcPartition(int n, const float *coords, const float *weights, int nparts, int *part) {
+  float bbox[4] = {INFINITY, -INFINITY, INFINITY, -INFINITY};
+  for (int i = 0; i < n; i++) {
+    bbox[0] = MIN(bbox[0], coords[2*i]);   bbox[1] = MAX(bbox[1], coords[2*i]);
+    bbox[2] = MIN(bbox[2], coords[2*i+1]); bbox[3] = MAX(bbox[3], coords[2*i+1]);
+  }
+  std::vector<std::pair<unsigned long long, int> > order(n);
+  double total = 0.0;
+  for (int i = 0; i < n; i++) {
+    order[i] = std::make_pair(hilbertKey(coords[2*i], coords[2*i+1], bbox), i);
+    total += weights ? weights[i] : 1.0;
+  }
+  std::sort(order.begin(), order.end());
+  double below = 0.0;
+  for (int k = 0; k < n; k++) {
+    int i = order[k].second;
+    double w = weights ? weights[i] : 1.0;
+    // Assign by the middle of the cell's interval along the curve
+    int p = (int)((below + 0.5 * w) * nparts / total);
+    part[i] = MIN(MAX(p, 0), nparts - 1);
+    below += w;
+  }
+}
+
+#endif // VOLNA_PARTITION_H
@@ -0,0 +1,105 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+
+/*
+ * Load monitor (rebalance=threshold). Every rebalanceEvery=N iterations
+ * (100 by default) the load of each process is measured as its number of
+ * wet cells plus rebalanceDryCost= (0.2 by default) times its number of
+ * dry cells, and printed with the spread of the time spent in the OP2
+ * loops, which includes the halo waits and so only shows the imbalance
+ * partly.
+ *
+ * This is checkpoint-assisted repartitioning, not migration: OP2 can't
+ * move the mesh and the dats once op_partition has run, so when the
+ * largest load goes above threshold times the mean one, the load of every
+ * cell is stored in a checkpoint as partitionWeights and the solver stops
+ * with exit status VOLNA_REBALANCE_EXIT. A restart from that checkpoint
+ * partitions the cells with these weights. volna_rebalance.sh does the
+ * restarts, within the allocation of the job.
+ */
+
+struct Rebalance {
+  float threshold;
+  int every;
+  float dryCost;
+  double loopTime;   // OP2 loop time at the last check
+  op_dat weights;    // load of the cells handed over to the checkpoint
+};
+
+static Rebalance *rebalance = NULL;
+static int rebalanced = 0;
+
+void volna_rebalance_init(int argc, char **argv, op_set cells) {
+  const char *threshold = volna_option(argc, argv, "rebalance");
+  if (threshold == NULL) return;
+  if (volna_comm_size() == 1) {
+    op_printf("rebalance is ignored without MPI\n");
+    return;
+  }
+  if (!volna_checkpoint_enabled()) {
+    op_printf("rebalance needs checkpoint=filename to restart from\n");
+    exit(-1);
+  }
+  rebalance = new Rebalance;
+  rebalance->threshold = atof(threshold);
+  if (rebalance->threshold < 1.0f) rebalance->threshold = 1.0f;
+  const char *every = volna_option(argc, argv, "rebalanceEvery");
+  rebalance->every = every == NULL ? 100 : atoi(every);
+  if (rebalance->every < 1) rebalance->every = 1;
+  const char *dryCost = volna_option(argc, argv, "rebalanceDryCost");
+  rebalance->dryCost = dryCost == NULL ? 0.2f : atof(dryCost);
+  rebalance->loopTime = 0.0;
+  float *tmp_elem = NULL;
+  rebalance->weights = op_decl_dat_temp(cells, 1, "float", tmp_elem, "partitionWeights");
+  op_printf("Rebalancing when the load imbalance goes above %g, checked every %d iterations\n",
+            rebalance->threshold, rebalance->every);
+}
+
+static double loop_time() {
+  double t = 0.0;
+  for (int i = 0; i < OP_kern_max; i++) t += OP_kernels[i].time;
+  return t;
+}
+
+/*
+ * Called between two steps, before volna_checkpoint_step
+ */
+void volna_rebalance_step(op_dat values) {
+  if (rebalance == NULL || rebalanced || itercount % rebalance->every != 0 || volna_lagged_pending()) return;
+  op_fetch_data(values);
+  float *v = (float *)values->data;
+  float *w = (float *)rebalance->weights->data;
+  int n = values->set->size, wet = 0;
+  for (int i = 0; i < n; i++) {
+    w[i] = v[4*i] > EPS ? 1.0f : rebalance->dryCost;
+    wet += v[4*i] > EPS;
+  }
+  double t = loop_time();
+  double load[2] = {wet + rebalance->dryCost * (n - wet), t - rebalance->loopTime};
+  rebalance->loopTime = t;
+  double maxload[2], sumload[2];
+  MPI_Allreduce(load, maxload, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(load, sumload, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  double imbalance = maxload[0] / (sumload[0] / volna_comm_size());
+  op_printf("Load at iteration %d: imbalance %g, loop time imbalance %g\n", itercount, imbalance,
+            sumload[1] > 0.0 ? maxload[1] / (sumload[1] / volna_comm_size()) : 1.0);
+  if (imbalance <= rebalance->threshold) return;
+  rebalanced = 1;
+  volna_checkpoint_rebalance(rebalance->weights);
+}
+
+/*
+ * Exit status of the solver
+ */
+int volna_rebalance_status() {
+  return rebalanced ? VOLNA_REBALANCE_EXIT : 0;
+}
+
+void volna_rebalance_close() {
+  if (rebalance == NULL) return;
+  if (op_free_dat_temp(rebalance->weights) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", rebalance->weights->name);
+  delete rebalance;
+  rebalance = NULL;
+}
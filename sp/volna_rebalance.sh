@@ -0,0 +1,44 @@
+#! /bin/bash
+#
+# Checkpoint-assisted repartitioning (rebalance=threshold). Runs the solver
+# and, while it stops with exit status 3 because the load imbalance went
+# above the threshold, restarts it from the checkpoint it wrote with the load
+# of every cell, so that the restart partitions the cells with these loads.
+# The restarts stay within the allocation of the job.
+#
+# usage: volna_rebalance.sh "mpirun -np 256" ./volna_mpi run.h5 checkpoint=run.chk rebalance=1.3 [options]
+#
+# At most REBALANCE_MAX restarts are made (10 by default).
+
+if [ $# -lt 3 ]; then
+	echo "usage: $0 launcher solver file.h5 checkpoint=filename rebalance=threshold [options]"
+	exit 1
+fi
+launcher=$1
+shift
+
+# The restarts read the checkpoint instead of a restart= given to the first run
+checkpoint=
+args=()
+for a in "$@"; do
+	case ${a} in
+		checkpoint=*) checkpoint=${a#checkpoint=}; args+=("${a}") ;;
+		restart=*) ;;
+		*) args+=("${a}") ;;
+	esac
+done
+if [ -z "${checkpoint}" ]; then
+	echo "$0: checkpoint=filename is needed to restart from"
+	exit 1
+fi
+
+${launcher} "$@"
+status=$?
+restarts=0
+while [ ${status} -eq 3 ] && [ ${restarts} -lt ${REBALANCE_MAX:-10} ]; do
+	restarts=$((restarts+1))
+	echo "Repartitioning with the cell loads, restart ${restarts} from ${checkpoint}"
+	${launcher} "${args[@]}" restart=${checkpoint}
+	status=$?
+done
+exit ${status}
@@ -0,0 +1,221 @@
+#include "volna_common.h"
+#include "computeFluxes.h"
+#include "NumericalFluxes.h"
+#include "SpaceDiscretization.h"
+#include "EvolveValuesRK2_1.h"
+#include "EvolveValuesRK2_2.h"
+
+/*
+ * Captured RK2 step (replay=1). The step always runs the same eight loops:
+ *   computeFluxes, NumericalFluxes, SpaceDiscretization, EvolveValuesRK2_1,
+ *   computeFluxes, NumericalFluxes, SpaceDiscretization, EvolveValuesRK2_2
+ * so their execution schedule is built once: the edges are cut into blocks
+ * of replayBlock= consecutive edges (256 by default), colored so that the
+ * blocks of a color share no cell, and the arrays of the dats are captured
+ * on the first step. Every step then replays the loops as worksharing
+ * loops of a single OpenMP parallel region, with the minTimestep reduction
+ * in between, instead of ten op_par_loop calls that each pack their
+ * arguments, look their plan up by name, time themselves and fork and join
+ * the threads. This is for the small meshes, where that overhead is a
+ * large part of the step.
+ *
+ * Like sparse tiling, the replay calls the kernels on the host arrays, so
+ * it is only used on one process in the seq and OpenMP builds (the seq
+ * build runs the region on the calling thread only), and not
+ * together with local time stepping, ensembles, linearDepth, bathyInterp,
+ * tiles or dtLag.
+ */
+
+struct Replay {
+  int ncells, nedges;
+  op_map edgesToCells, cellsToEdges;  // volna_numa_init may still move their arrays
+  int ncolors;
+  int *colorOffs;              // blocks of color k: blocks[colorOffs[k] .. colorOffs[k+1]-1]
+  int *blocks;                 // first edge of every block, in color order
+  int blockSize;
+  int captured;
+  float *values, *valuesNew, *midCons, *inCons, *outCons, *mid;
+  float *bathySource, *edgeFluxes, *maxEdgeEigenvalues, *edgeNormals, *edgeLength, *cellVolumes;
+  int *isBoundary;
+};
+
+static Replay *replay = NULL;
+
+void volna_replay_init(int argc, char **argv, op_set cells, op_set edges, op_map edgesToCells,
+                       op_map cellsToEdges, int supported) {
+  if (volna_option(argc, argv, "replay") == NULL) return;
+#ifdef VOLNA_CUDA
+  supported = 0;
+#endif
+  if (!supported || volna_comm_size() > 1) {
+    op_printf("replay is ignored with MPI, CUDA, lts, ensembles, linearDepth, bathyInterp, tiles and dtLag\n");
+    return;
+  }
+  replay = new Replay;
+  replay->ncells = cells->size;
+  replay->nedges = edges->size;
+  replay->edgesToCells = edgesToCells;
+  replay->cellsToEdges = cellsToEdges;
+  replay->captured = 0;
+  const char *size = volna_option(argc, argv, "replayBlock");
+  replay->blockSize = size != NULL && atoi(size) > 0 ? atoi(size) : 256;
+
+  //Greedy coloring of the blocks, a color is a bit of the mask of the cells
+  int nblocks = (replay->nedges + replay->blockSize - 1) / replay->blockSize;
+  int *e2c = edgesToCells->map;
+  int *cellColors = (int *)calloc(replay->ncells, sizeof(int));
+  int *blockColor = (int *)malloc(nblocks * sizeof(int));
+  replay->ncolors = 0;
+  for (int b = 0; b < nblocks; b++) {
+    int first = b * replay->blockSize, last = MIN(first + replay->blockSize, replay->nedges);
+    int used = 0;
+    for (int e = first; e < last; e++)
+      used |= cellColors[e2c[2 * e]] | cellColors[e2c[2 * e + 1]];
+    int color = 0;
+    while (color < 32 && (used & (1 << color))) color++;
+    if (color == 32) {
+      op_printf("replay: more than 32 colors needed, use a smaller replayBlock\n");
+      exit(-1);
+    }
+    for (int e = first; e < last; e++) {
+      cellColors[e2c[2 * e]] |= 1 << color;
+      cellColors[e2c[2 * e + 1]] |= 1 << color;
+    }
+    blockColor[b] = color;
+    replay->ncolors = MAX(replay->ncolors, color + 1);
+  }
+  replay->colorOffs = (int *)calloc(replay->ncolors + 1, sizeof(int));
+  for (int b = 0; b < nblocks; b++) replay->colorOffs[blockColor[b] + 1]++;
+  for (int k = 0; k < replay->ncolors; k++) replay->colorOffs[k + 1] += replay->colorOffs[k];
+  replay->blocks = (int *)malloc(nblocks * sizeof(int));
+  int *fill = (int *)malloc(replay->ncolors * sizeof(int));
+  memcpy(fill, replay->colorOffs, replay->ncolors * sizeof(int));
+  for (int b = 0; b < nblocks; b++) replay->blocks[fill[blockColor[b]]++] = b * replay->blockSize;
+  free(fill);
+  free(blockColor);
+  free(cellColors);
+  op_printf("Captured RK2 step: 8 loops, %d edge blocks of %d in %d colors\n",
+            nblocks, replay->blockSize, replay->ncolors);
+}
+
+int volna_replay_enabled() {
+  return replay != NULL;
+}
+
+/*
+ * SpaceDiscretization by colors of edge blocks, called by all threads
+ */
+static void replay_space_discretization(float *out) {
+  int *e2c = replay->edgesToCells->map;
+  for (int k = 0; k < replay->ncolors; k++) {
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int i = replay->colorOffs[k]; i < replay->colorOffs[k + 1]; i++) {
+      int first = replay->blocks[i], last = MIN(first + replay->blockSize, replay->nedges);
+      for (int e = first; e < last; e++) {
+        float *volumes[2] = {replay->cellVolumes + e2c[2 * e], replay->cellVolumes + e2c[2 * e + 1]};
+        SpaceDiscretization(out + 4 * e2c[2 * e], out + 4 * e2c[2 * e + 1], replay->edgeFluxes + 3 * e,
+                            replay->bathySource + 2 * e, replay->edgeNormals + 2 * e, replay->isBoundary + e,
+                            volumes);
+      }
+    }
+  }
+}
+
+static void replay_fluxes(float *in) {
+  int *e2c = replay->edgesToCells->map;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+  for (int e = 0; e < replay->nedges; e++)
+    computeFluxes(in + 4 * e2c[2 * e], in + 4 * e2c[2 * e + 1], replay->edgeLength + e,
+                  replay->edgeNormals + 2 * e, replay->isBoundary + e, replay->bathySource + 2 * e,
+                  replay->edgeFluxes + 3 * e, replay->maxEdgeEigenvalues + e);
+}
+
+/*
+ * NumericalFluxes, the smallest step of the cells of this thread goes to *minTimestep
+ */
+static void replay_numerical_fluxes(float *out, float *minTimestep) {
+  int *c2e = replay->cellsToEdges->map;
+  float *eig = replay->maxEdgeEigenvalues, *len = replay->edgeLength;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+  for (int c = 0; c < replay->ncells; c++) {
+    float *eigenvalues[3] = {eig + c2e[3 * c], eig + c2e[3 * c + 1], eig + c2e[3 * c + 2]};
+    float *lengths[3] = {len + c2e[3 * c], len + c2e[3 * c + 1], len + c2e[3 * c + 2]};
+    NumericalFluxes(eigenvalues, lengths, replay->cellVolumes + c, out + 4 * c, minTimestep);
+  }
+}
+
+/*
+ * One RK2 step replayed, the new values are left in values_new like the
+ * generated step. Returns dT
+ */
+float volna_replay_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary) {
+  Replay *r = replay;
+  if (!r->captured) {
+    r->values = (float *)values->data;
+    r->valuesNew = (float *)values_new->data;
+    r->midCons = (float *)midPointConservative->data;
+    r->inCons = (float *)inConservative->data;
+    r->outCons = (float *)outConservative->data;
+    r->mid = (float *)midPoint->data;
+    r->bathySource = (float *)bathySource->data;
+    r->edgeFluxes = (float *)edgeFluxes->data;
+    r->maxEdgeEigenvalues = (float *)maxEdgeEigenvalues->data;
+    r->edgeNormals = (float *)edgeNormals->data;
+    r->edgeLength = (float *)edgeLength->data;
+    r->cellVolumes = (float *)cellVolumes->data;
+    r->isBoundary = (int *)isBoundary->data;
+    r->captured = 1;
+  }
+
+  float minTimestep = INFINITY, dT = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    float local = INFINITY, dummy = INFINITY;
+    replay_fluxes(r->values);
+    replay_numerical_fluxes(r->midCons, &local);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    minTimestep = MIN(minTimestep, local);
+    replay_space_discretization(r->midCons);
+#ifdef _OPENMP
+#pragma omp single
+#endif
+    dT = CFL * minTimestep;
+    float step = dT;
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int c = 0; c < r->ncells; c++)
+      EvolveValuesRK2_1(&step, r->midCons + 4 * c, r->values + 4 * c, r->inCons + 4 * c, r->mid + 4 * c);
+    replay_fluxes(r->mid);
+    replay_numerical_fluxes(r->outCons, &dummy);
+    replay_space_discretization(r->outCons);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int c = 0; c < r->ncells; c++)
+      EvolveValuesRK2_2(&step, r->outCons + 4 * c, r->inCons + 4 * c, r->midCons + 4 * c, r->valuesNew + 4 * c);
+  }
+  return dT;
+}
+
+void volna_replay_close() {
+  if (replay == NULL) return;
+  free(replay->colorOffs);
+  free(replay->blocks);
+  delete replay;
+  replay = NULL;
+}
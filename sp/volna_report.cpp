@@ -0,0 +1,257 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Performance report (report=filename). At the end of the run the OP2
+ * loop timings are turned into a table of the bytes moved, the bandwidth,
+ * the estimated FLOP rate and the arithmetic intensity of every loop,
+ * printed and written to filename as JSON. The bytes are the transfer
+ * estimate of the generated stubs, so the sequential build, which has no
+ * stubs, only gets the phase times.
+ *
+ * The bandwidth is compared to a STREAM triad run by all the processes
+ * and threads at the end of the run, or to reportBandwidth=GB/s if given
+ * (the CUDA build has no triad of the device memory). The FLOPs of a loop
+ * are counted by hand from its kernel, a square root or a division
+ * counting as one. With the peak of the machine (reportPeak=GFLOP/s) a
+ * loop is placed on the roofline as memory or compute bound, otherwise
+ * only its distance to the bandwidth roof is given.
+ *
+ * The wall time is split into the solver steps, the events that change
+ * the state (Init events), the output events and the rest (setup,
+ * checkpoints, ...). With MPI the times are the largest over the
+ * processes and the bytes the sum.
+ */
+
+#define REPORT_TRIAD (1 << 22)
+
+struct ReportLoop {
+  const char *name;   // name given to op_par_loop
+  int onEdges;        // otherwise on the cells
+  float flops;        // per element
+};
+
+//Loops of the time step, the others are reported without FLOPs
+static const ReportLoop reportLoops[] = {
+  {"EvolveValuesRK2_1",       0, 12.0f},
+  {"EvolveValuesRK2_2",       0, 16.0f},
+  {"simulation_1",            0, 0.0f},
+  {"computeFluxes",           1, 140.0f},
+  {"NumericalFluxes",         0, 9.0f},
+  {"SpaceDiscretization",     1, 22.0f},
+  {"EvolveValuesRK2_2_bathy", 0, 23.0f},
+  {"simulation_1_landslide",  0, 20.0f},
+  {"NumericalFluxes_lagged",  0, 8.0f},
+  {"zeroValues",              0, 0.0f}
+};
+#define REPORT_LOOPS (int)(sizeof(reportLoops) / sizeof(reportLoops[0]))
+
+struct Report {
+  std::string filename;
+  double bandwidth;   // GB/s, 0 if unknown
+  double peak;        // GFLOP/s, 0 if unknown
+  double ncells, nedges;
+  int steps;
+  double time[VOLNA_REPORT_PHASES];
+};
+
+static Report *report = NULL;
+
+void volna_report_init(int argc, char **argv, op_set cells, op_set edges) {
+  const char *filename = volna_option(argc, argv, "report");
+  if (filename == NULL) return;
+  report = new Report;
+  report->filename = filename;
+  const char *bandwidth = volna_option(argc, argv, "reportBandwidth");
+  report->bandwidth = bandwidth == NULL ? 0.0 : atof(bandwidth);
+  const char *peak = volna_option(argc, argv, "reportPeak");
+  report->peak = peak == NULL ? 0.0 : atof(peak);
+  double n[2] = {(double)cells->size, (double)edges->size};
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, n, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  report->ncells = n[0];
+  report->nedges = n[1];
+  report->steps = 0;
+  for (int p = 0; p < VOLNA_REPORT_PHASES; p++) report->time[p] = 0.0;
+}
+
+/*
+ * Adds seconds to a phase of the wall time, every solver phase is a step
+ */
+void volna_report_time(int phase, double seconds) {
+  if (report == NULL) return;
+  report->time[phase] += seconds;
+  report->steps += phase == VOLNA_REPORT_SOLVER;
+}
+
+#ifndef VOLNA_CUDA
+/*
+ * Triad bandwidth of all threads of all processes, best of 5
+ */
+static double triad_bandwidth() {
+  double *a = (double *)malloc(3 * REPORT_TRIAD * sizeof(double));
+  double *b = a + REPORT_TRIAD, *c = b + REPORT_TRIAD;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < REPORT_TRIAD; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+  double best = 0.0;
+  for (int r = 0; r < 5; r++) {
+    if (volna_comm_size() > 1) MPI_Barrier(MPI_COMM_WORLD);
+    double cpu_t1, cpu_t2, wall_t1, wall_t2;
+    op_timers(&cpu_t1, &wall_t1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < REPORT_TRIAD; i++)
+      a[i] = b[i] + 3.0 * c[i];
+    op_timers(&cpu_t2, &wall_t2);
+    double bw = 3.0 * sizeof(double) * REPORT_TRIAD / (wall_t2 - wall_t1) / 1e9;
+    best = MAX(best, bw);
+  }
+  free(a);
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &best, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return best;
+}
+#endif
+
+static void json_number(FILE *f, const char *key, double value, int known, const char *sep) {
+  if (known) fprintf(f, "\"%s\": %.6g%s", key, value, sep);
+  else fprintf(f, "\"%s\": null%s", key, sep);
+}
+
+/*
+ * Prints and writes the report, wall is the run time measured by main
+ */
+void volna_report_write(double wall) {
+  if (report == NULL) return;
+#ifndef VOLNA_CUDA
+  if (report->bandwidth == 0.0) report->bandwidth = triad_bandwidth();
+#endif
+
+  int nkern = OP_kern_max;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &nkern, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  //calls, time, bytes of every loop
+  std::vector<double> maxs(2 * nkern, 0.0), bytes(nkern, 0.0);
+  for (int i = 0; i < OP_kern_max; i++) {
+    maxs[2*i] = OP_kernels[i].count;
+    maxs[2*i+1] = OP_kernels[i].time;
+    bytes[i] = OP_kernels[i].transfer;
+  }
+  double times[VOLNA_REPORT_PHASES + 1];
+  for (int p = 0; p < VOLNA_REPORT_PHASES; p++) times[p] = report->time[p];
+  times[VOLNA_REPORT_PHASES] = wall;
+  if (volna_comm_size() > 1) {
+    MPI_Allreduce(MPI_IN_PLACE, &maxs[0], 2 * nkern, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &bytes[0], nkern, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, times, VOLNA_REPORT_PHASES + 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  }
+  double solver = times[VOLNA_REPORT_SOLVER];
+  double output = times[VOLNA_REPORT_OUTPUT];
+  double events = times[VOLNA_REPORT_EVENTS];
+  double other = MAX(0.0, times[VOLNA_REPORT_PHASES] - solver - events - output);
+  double updates = solver > 0.0 ? report->ncells * report->steps / solver : 0.0;
+
+  int rank = 0;
+  if (volna_comm_size() > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  FILE *f = NULL;
+  if (rank == 0) {
+    f = fopen(report->filename.c_str(), "w");
+    if (f == NULL) printf("report: cannot write %s\n", report->filename.c_str());
+  }
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  if (f != NULL) {
+    fprintf(f, "{\n  \"processes\": %d, \"threads\": %d, \"cells\": %.0f, \"edges\": %.0f, \"steps\": %d,\n",
+            volna_comm_size(), threads, report->ncells, report->nedges, report->steps);
+    fprintf(f, "  \"wallTime\": %.6g,\n", times[VOLNA_REPORT_PHASES]);
+    fprintf(f, "  \"phases\": {\"solver\": %.6g, \"events\": %.6g, \"output\": %.6g, \"other\": %.6g},\n",
+            solver, events, output, other);
+    fprintf(f, "  \"cellUpdatesPerSecond\": %.6g,\n  ", updates);
+    json_number(f, "streamBandwidth", report->bandwidth, report->bandwidth > 0.0, ",\n  ");
+    json_number(f, "peakGflops", report->peak, report->peak > 0.0, ",\n");
+    fprintf(f, "  \"loops\": [");
+  }
+
+  op_printf("\nPerformance report: %d steps of %.0f cells, %.3g cell updates/s\n",
+            report->steps, report->ncells, updates);
+  op_printf("Wall time %.4g s: solver %.4g s, events %.4g s, output %.4g s, other %.4g s\n",
+            times[VOLNA_REPORT_PHASES], solver, events, output, other);
+  if (report->bandwidth > 0.0)
+    op_printf("STREAM triad %.1f GB/s%s\n", report->bandwidth, report->peak > 0.0 ? "" : ", no reportPeak=");
+  op_printf("%-24s %8s %10s %10s %8s %7s %8s %6s %8s %s\n", "loop", "calls", "time (s)", "GB", "GB/s",
+            "%STREAM", "GFLOP/s", "FLOP/B", "%roof", "bound");
+
+  int written = 0;
+  for (int i = 0; i < nkern; i++) {
+    int calls = (int)maxs[2*i];
+    double time = maxs[2*i+1];
+    if (calls == 0) continue;
+    const char *name = i < OP_kern_max ? OP_kernels[i].name : NULL;
+    if (name == NULL) name = "unknown";
+    const ReportLoop *loop = NULL;
+    for (int l = 0; l < REPORT_LOOPS; l++)
+      if (!strcmp(reportLoops[l].name, name)) loop = &reportLoops[l];
+
+    int hasBytes = bytes[i] > 0.0 && time > 0.0;
+    int hasFlops = loop != NULL && time > 0.0;
+    double gbs = hasBytes ? bytes[i] / time / 1e9 : 0.0;
+    double flops = hasFlops ? loop->flops * calls * (loop->onEdges ? report->nedges : report->ncells) : 0.0;
+    double gflops = hasFlops ? flops / time / 1e9 : 0.0;
+    int hasIntensity = hasBytes && hasFlops;
+    double intensity = hasIntensity ? flops / bytes[i] : 0.0;
+    //attainable GFLOP/s on the roofline
+    int hasRoof = hasIntensity && report->bandwidth > 0.0 && flops > 0.0;
+    double roof = hasRoof ? intensity * report->bandwidth : 0.0;
+    if (hasRoof && report->peak > 0.0) roof = MIN(roof, report->peak);
+    const char *bound = !hasRoof || report->peak == 0.0 ? NULL :
+                        intensity * report->bandwidth < report->peak ? "memory" : "compute";
+
+    char cgb[16] = "-", cgbs[16] = "-", cstream[16] = "-", cgflops[16] = "-", cai[16] = "-", croof[16] = "-";
+    if (hasBytes) {
+      sprintf(cgb, "%.4g", bytes[i] / 1e9);
+      sprintf(cgbs, "%.2f", gbs);
+      if (report->bandwidth > 0.0) sprintf(cstream, "%.1f", 100.0 * gbs / report->bandwidth);
+    }
+    if (hasFlops) sprintf(cgflops, "%.2f", gflops);
+    if (hasIntensity) sprintf(cai, "%.3f", intensity);
+    if (hasRoof) sprintf(croof, "%.1f", 100.0 * gflops / roof);
+    op_printf("%-24s %8d %10.4f %10s %8s %7s %8s %6s %8s %s\n", name, calls, time, cgb, cgbs, cstream,
+              cgflops, cai, croof, bound != NULL ? bound : "-");
+
+    if (f != NULL) {
+      fprintf(f, "%s\n    {\"name\": \"%s\", \"kernel\": %d, \"calls\": %d, \"time\": %.6g, ",
+              written++ ? "," : "", name, i, calls, time);
+      json_number(f, "bytes", bytes[i], hasBytes, ", ");
+      json_number(f, "bandwidth", gbs, hasBytes, ", ");
+      json_number(f, "streamFraction", gbs / report->bandwidth, hasBytes && report->bandwidth > 0.0, ", ");
+      json_number(f, "flops", flops, hasFlops, ", ");
+      json_number(f, "gflops", gflops, hasFlops, ", ");
+      json_number(f, "intensity", intensity, hasIntensity, ", ");
+      json_number(f, "roofGflops", roof, hasRoof, ", ");
+      if (bound != NULL) fprintf(f, "\"bound\": \"%s\"}", bound);
+      else fprintf(f, "\"bound\": null}");
+    }
+  }
+  if (written == 0)
+    op_printf("No loop timings in this build\n");
+  if (f != NULL) {
+    fprintf(f, "%s]\n}\n", written ? "\n  " : "");
+    fclose(f);
+    op_printf("Performance report written to %s\n", report->filename.c_str());
+  }
+  delete report;
+  report = NULL;
+}
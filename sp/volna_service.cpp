@@ -0,0 +1,311 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+
+/*
+ * Service mode (spool=directory). The solver stays resident after the
+ * scenario given on the command line, with the mesh, the partitioning, the
+ * OP2 plans and the temporary dats of the time stepping kept, and runs the
+ * scenario files (generated by volna2hdf5 on the same mesh) that appear in
+ * the spool directory, one after the other, in the order of their names.
+ * A job has to be written under another name and renamed to *.h5 when
+ * complete; it is renamed to *.h5.done when it has been run, or to
+ * *.h5.failed when it does not fit the resident mesh. A file named "stop"
+ * in the spool directory stops the service.
+ *
+ * Between jobs the values, Init data, events, timers and the maximum
+ * elevation are reset. The jobs have to use the CFL and g of the service
+ * and the same OutputLocation gauges, and can't stream InitBathymetry
+ * files (%i).
+ */
+
+struct Service {
+  std::string spool;
+  std::string job;      // job being run, empty for the command line scenario
+  int pollUs;           // time between two scans of the spool directory
+  double start;         // wall time of the arrival of the job
+  op_dat initEta, initBathymetry; // Init data of the jobs, when the command line scenario has none
+};
+
+static Service *service = NULL;
+
+static double wall_time() {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+static int comm_rank() {
+  int rank = 0;
+  if (volna_comm_size() > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  return rank;
+}
+
+static int ends_with(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+void volna_service_init(int argc, char **argv) {
+  const char *spool = volna_option(argc, argv, "spool");
+  if (spool == NULL) return;
+  Service *s = new Service;
+  s->spool = spool;
+  const char *poll = volna_option(argc, argv, "spoolPoll");
+  s->pollUs = (int)(1000.0 * (poll ? atof(poll) : 5.0));
+  s->initEta = NULL;
+  s->initBathymetry = NULL;
+  s->start = wall_time();
+  service = s;
+  op_printf("Service mode, taking jobs from %s\n", s->spool.c_str());
+}
+
+int volna_service_enabled() {
+  return service != NULL;
+}
+
+/*
+ * Wait until a job or the stop file appears in the spool directory. Rank 0
+ * scans the directory and hands the name to the other processes; returns
+ * an empty name to stop.
+ */
+static std::string wait_job(Service *s) {
+  char name[1024] = "";
+  if (comm_rank() == 0) {
+    for (;;) {
+      DIR *dir = opendir(s->spool.c_str());
+      if (dir == NULL) {
+        op_printf("can't open spool directory %s\n", s->spool.c_str());
+        exit(-1);
+      }
+      std::vector<std::string> jobs;
+      int stop = 0;
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != NULL) {
+        std::string file = entry->d_name;
+        if (file == "stop") stop = 1;
+        else if (ends_with(file, ".h5")) jobs.push_back(file);
+      }
+      closedir(dir);
+      if (jobs.size() > 0) {
+        std::string path = s->spool + "/" + *std::min_element(jobs.begin(), jobs.end());
+        strncpy(name, path.c_str(), sizeof(name) - 1);
+        break;
+      }
+      if (stop) break;
+      usleep(s->pollUs);
+    }
+  }
+  if (volna_comm_size() > 1)
+    MPI_Bcast(name, sizeof(name), MPI_CHAR, 0, MPI_COMM_WORLD);
+  return name;
+}
+
+static void finish_job(Service *s, const char *suffix) {
+  if (s->job.empty()) return;
+  if (comm_rank() == 0) {
+    std::string done = s->job + suffix;
+    if (rename(s->job.c_str(), done.c_str()))
+      op_printf("Warning: can't rename job %s\n", s->job.c_str());
+  }
+  s->job.clear();
+}
+
+static int count_gauges(std::vector<EventParams> *events) {
+  int n = 0;
+  for (unsigned int i = 0; i < (*events).size(); i++)
+    if ((*events)[i].className == "OutputLocation") n++;
+  return n;
+}
+
+/*
+ * Check that the job in file can run on the resident mesh, with the
+ * constants and gauges of the service
+ */
+static int check_job(const char *filename, hid_t file, op_set cells,
+                     std::vector<EventParams> *events, std::vector<EventParams> *jobEvents) {
+  hsize_t dims[2];
+  check_hdf5_error(H5LTget_dataset_info(file, "values", dims, NULL, NULL));
+  int ncell = cells->size;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &ncell, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if ((int)dims[0] != ncell) {
+    op_printf("%s has %d cells, the mesh of the service has %d\n", filename, (int)dims[0], ncell);
+    return 0;
+  }
+  float cfl, gravity;
+  check_hdf5_error(H5LTread_dataset_float(file, "CFL", &cfl));
+  check_hdf5_error(H5LTread_dataset_float(file, "g", &gravity));
+  if (cfl != CFL || gravity != g) {
+    op_printf("%s has CFL = %g and g = %g, the service uses %g and %g\n", filename, cfl, gravity, CFL, g);
+    return 0;
+  }
+  for (unsigned int i = 0; i < (*jobEvents).size(); i++) {
+    if (strstr((*jobEvents)[i].streamName.c_str(), "%i") != NULL &&
+        (*jobEvents)[i].className == "InitBathymetry") {
+      op_printf("%s streams InitBathymetry files, which is not supported in service mode\n", filename);
+      return 0;
+    }
+  }
+  // The gauges are located on the mesh once, by the scenario on the command line
+  int n = count_gauges(events);
+  if (count_gauges(jobEvents) != n) {
+    op_printf("%s has %d OutputLocation gauges, the service has %d\n", filename, count_gauges(jobEvents), n);
+    return 0;
+  }
+  std::vector<EventParams *> gauges;
+  for (unsigned int i = 0; i < (*events).size(); i++)
+    if ((*events)[i].className == "OutputLocation") gauges.push_back(&(*events)[i]);
+  int k = 0;
+  for (unsigned int i = 0; i < (*jobEvents).size(); i++) {
+    EventParams &e = (*jobEvents)[i];
+    if (e.className != "OutputLocation") continue;
+    if (e.location_x != gauges[k]->location_x || e.location_y != gauges[k]->location_y) {
+      op_printf("%s has a gauge at (%g, %g), the service has it at (%g, %g)\n", filename,
+                e.location_x, e.location_y, gauges[k]->location_x, gauges[k]->location_y);
+      return 0;
+    }
+    k++;
+  }
+  return 1;
+}
+
+/*
+ * Load the job in filename into the state of the simulation and run its
+ * Init events. Returns 0, with the state untouched, if it does not fit.
+ */
+static int load_job(int argc, char **argv, Service *s, const char *filename,
+                    std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                    float *ftime, float *dtmax, BoreParams *bore_params,
+                    GaussianLandslideParams *gaussian_landslide_params,
+                    op_set cells, op_dat values, op_dat cellGlobalIndex, op_dat cellVolumes,
+                    op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes,
+                    op_dat *temp_initEta, op_dat **temp_initBathymetry, int *n_initBathymetry,
+                    op_map outputLocation_map, op_dat outputLocation_dat) {
+  hid_t file = volna_open_hdf5(filename);
+  int num_events = 0, num_outputLocation = 0;
+  check_hdf5_error(H5LTread_dataset_int(file, "numEvents", &num_events));
+  std::vector<TimerParams> jobTimers(num_events);
+  std::vector<EventParams> jobEvents(num_events);
+  read_events_hdf5(file, num_events, &jobTimers, &jobEvents, &num_outputLocation);
+  const char *gauges_file = volna_option(argc, argv, "gauges");
+  if (gauges_file != NULL) {
+    int num_gauges = 0;
+    read_gauges_file(gauges_file, &jobTimers, &jobEvents, &num_gauges);
+  }
+  if (!check_job(filename, file, cells, events, &jobEvents)) {
+    check_hdf5_error(H5Fclose(file));
+    return 0;
+  }
+
+  // Streamed bathymetry and the maximum elevation of the previous scenario
+  bathymetry_stream_close();
+  if (currentMaxElevation != NULL && op_free_dat_temp(currentMaxElevation) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", currentMaxElevation->name);
+  currentMaxElevation = NULL;
+
+  volna_read_cells_hdf5(file, "values", values, cellGlobalIndex);
+  check_hdf5_error(H5LTread_dataset_float(file, "ftime", ftime));
+  check_hdf5_error(H5LTread_dataset_float(file, "dtmax", dtmax));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsx0", &bore_params->x0));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsHl", &bore_params->Hl));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsul", &bore_params->ul));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsvl", &bore_params->vl));
+  check_hdf5_error(H5LTread_dataset_float(file, "BoreParamsS", &bore_params->S));
+  check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamsA", &gaussian_landslide_params->A));
+  check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamsv", &gaussian_landslide_params->v));
+  check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamslx", &gaussian_landslide_params->lx));
+  check_hdf5_error(H5LTread_dataset_float(file, "GaussianLandslideParamsly", &gaussian_landslide_params->ly));
+  gaussian_landslide_params->fused = 0;
+
+  // The Init data go into the dats of the command line scenario when it has them
+  float *tmp_elem = NULL;
+  int initBathymetry = 0;
+  for (unsigned int i = 0; i < jobEvents.size(); i++) {
+    if (jobEvents[i].streamName.empty()) continue;
+    if (jobEvents[i].className == "InitEta") {
+      if (*temp_initEta == NULL) {
+        if (s->initEta == NULL)
+          s->initEta = op_decl_dat_temp(cells, 1, "float", tmp_elem, "initEtaJob");
+        *temp_initEta = s->initEta;
+      }
+      volna_read_cells_hdf5(file, "initEta", *temp_initEta, cellGlobalIndex);
+    } else if (jobEvents[i].className == "InitBathymetry") {
+      initBathymetry = 1;
+    }
+  }
+  if (initBathymetry) {
+    if (*n_initBathymetry != 1) {
+      if (s->initBathymetry == NULL)
+        s->initBathymetry = op_decl_dat_temp(cells, 1, "float", tmp_elem, "initBathymetryJob");
+      *temp_initBathymetry = &s->initBathymetry;
+    }
+    volna_read_cells_hdf5(file, "initBathymetry", (*temp_initBathymetry)[0], cellGlobalIndex);
+  }
+  *n_initBathymetry = initBathymetry;
+  check_hdf5_error(H5Fclose(file));
+
+  *timers = jobTimers;
+  *events = jobEvents;
+  volna_formula_init(argc, argv, events);
+  init_events(timers, events);
+  timestamp = 0.0;
+  itercount = 0;
+  processEvents(timers, events, 1/*firstTime*/, 1/*update timers*/, 0.0/*=dt*/, 2/*init loop, not pre/post*/,
+                cells, values, cellVolumes, cellCenters, nodeCoords, cellsToNodes, *temp_initEta,
+                *temp_initBathymetry, *n_initBathymetry, *bore_params, *gaussian_landslide_params,
+                outputLocation_map, outputLocation_dat);
+  // The deep water edges depend on the bathymetry of the job
+  volna_linear_update(values);
+  return 1;
+}
+
+/*
+ * Called when a scenario has finished. Waits for the next job of the
+ * spool directory and loads it; returns 0 when there is none to run
+ * (no spool= option, or the stop file).
+ */
+int volna_service_next(int argc, char **argv, std::vector<TimerParams> *timers, std::vector<EventParams> *events,
+                       float *ftime, float *dtmax, BoreParams *bore_params,
+                       GaussianLandslideParams *gaussian_landslide_params,
+                       op_set cells, op_dat values, op_dat cellGlobalIndex, op_dat cellVolumes,
+                       op_dat cellCenters, op_dat nodeCoords, op_map cellsToNodes,
+                       op_dat *temp_initEta, op_dat **temp_initBathymetry, int *n_initBathymetry,
+                       op_map outputLocation_map, op_dat outputLocation_dat) {
+  Service *s = service;
+  if (s == NULL) return 0;
+  op_printf("Finished %s in %lf s\n", s->job.empty() ? argv[1] : s->job.c_str(), wall_time() - s->start);
+  finish_job(s, ".done");
+  for (;;) {
+    std::string job = wait_job(s);
+    if (job.empty()) {
+      op_printf("Stopping the service\n");
+      return 0;
+    }
+    s->start = wall_time();
+    s->job = job;
+    if (load_job(argc, argv, s, job.c_str(), timers, events, ftime, dtmax, bore_params,
+                 gaussian_landslide_params, cells, values, cellGlobalIndex, cellVolumes,
+                 cellCenters, nodeCoords, cellsToNodes, temp_initEta, temp_initBathymetry,
+                 n_initBathymetry, outputLocation_map, outputLocation_dat)) {
+      op_printf("Running %s, loaded in %.1f ms\n", job.c_str(), 1000.0 * (wall_time() - s->start));
+      return 1;
+    }
+    finish_job(s, ".failed");
+  }
+}
+
+void volna_service_close() {
+  Service *s = service;
+  if (s == NULL) return;
+  if (s->initEta != NULL && op_free_dat_temp(s->initEta) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", s->initEta->name);
+  if (s->initBathymetry != NULL && op_free_dat_temp(s->initBathymetry) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", s->initBathymetry->name);
+  delete s;
+  service = NULL;
+}
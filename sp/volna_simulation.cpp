@@ -2,41 +2,122 @@
 #include "computeFluxes.h"
 #include "NumericalFluxes.h"
 #include "SpaceDiscretization.h"
+#include "computeFluxes_linear.h"
+#include "initLinearEdges.h"
+#include "NumericalFluxes_lagged.h"
+#include "zeroValues.h"
+#include "EvolveValuesRK2_1.h"
+#include "EvolveValuesRK2_2.h"
+#include "EvolveValuesRK2_2_bathy.h"
+#include "simulation_1.h"
+#include <mpi.h>
 
 #include "op_seq.h"
 
+/*
+ * Hybrid deep water mode (linearDepth=h). The edges between two cells that
+ * are deeper than h use the cheap flux of computeFluxes_linear, with the
+ * wave speed of the edge computed once from the bathymetry after the Init
+ * events; the HLL flux with the wet/dry treatment is kept near the coast.
+ * The threshold should be well below the depths at which the sea floor
+ * moves during the simulation.
+ */
+static op_dat edgeSpeed = NULL;
+static float linearDepth;
+static op_map linearEdgesToCells;
+static op_dat linearIsBoundary;
+
+/*
+ * Lagged time step (dtLag=k). The global reduction of the stable step is
+ * only done every k steps, with a non-blocking MPI_Iallreduce that is
+ * waited for at the end of the step, and the other steps use the last
+ * result times a safety factor (dtSafety=, 0.9 by default). Each step still
+ * keeps the local stable steps of the cells; the smallest ratio between the
+ * stable step and the step taken on a process is reduced with the next
+ * check. A check step that violates the CFL condition is recomputed with
+ * the new step, the values are untouched until it is accepted.
+ *
+ * The values, the clock and the event timers are saved at the start of the
+ * first step after an accepted check. When a check finds that one of the
+ * steps before it violated the CFL condition, they are restored and the
+ * steps are redone from there, the first one with the reduced stable step
+ * and the next ones with a lowered safety factor. The steps after which an
+ * event is due and the last step are checks, so events, checkpoints and
+ * the end of the run only see accepted states.
+ */
+struct LaggedDt {
+  int every;        // dtLag=
+  float safety;     // dtSafety=
+  float dT;         // step of the steps until the next check, 0 before the first one
+  float worst;      // smallest CFL stable step / step taken since the last check
+  op_dat localDt;   // stable step of the cells
+  int validated;    // the last step was accepted by a check
+  op_dat snapshot;  // values at the start of the first step after it
+  int snapshotIter;
+  float snapshotTime;
+  EventState snapshotEvents;
+};
+
+static LaggedDt *lagged = NULL;
+
 void spaceDiscretization(op_dat data_in, op_dat data_out, float *minTimestep,
                          op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
                          op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
                          op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges, int most) {
   {
-    *minTimestep = INFINITY;
+    if (minTimestep != NULL) *minTimestep = INFINITY;
     { //Following loops merged:
       //FacetsValuesFromCellValues
       //FacetsValuesFromCellValues
       //spaceDiscretisation_1
       //NumericalFluxes_1
       //SpaceDiscretization
-      op_par_loop(computeFluxes, "computeFluxes", edges,
-                  op_arg_dat(data_in, 0, edgesToCells, 4, "float", OP_READ),
-                  op_arg_dat(data_in, 1, edgesToCells, 4, "float", OP_READ),
-                  op_arg_dat(edgeLength, -1, OP_ID, 1, "float", OP_READ),
-                  op_arg_dat(edgeNormals, -1, OP_ID, 2, "float", OP_READ),
-                  op_arg_dat(isBoundary, -1, OP_ID, 1, "int", OP_READ),
-                  op_arg_dat(bathySource, -1, OP_ID, 2, "float", OP_WRITE),
-                  op_arg_dat(edgeFluxes, -1, OP_ID, 3, "float", OP_WRITE),
-                  op_arg_dat(maxEdgeEigenvalues, -1, OP_ID, 1, "float", OP_WRITE));
-
+      if (edgeSpeed == NULL) {
+        op_par_loop(computeFluxes, "computeFluxes", edges,
+                    op_arg_dat(data_in, 0, edgesToCells, 4, "float", OP_READ),
+                    op_arg_dat(data_in, 1, edgesToCells, 4, "float", OP_READ),
+                    op_arg_dat(edgeLength, -1, OP_ID, 1, "float", OP_READ),
+                    op_arg_dat(edgeNormals, -1, OP_ID, 2, "float", OP_READ),
+                    op_arg_dat(isBoundary, -1, OP_ID, 1, "int", OP_READ),
+                    op_arg_dat(bathySource, -1, OP_ID, 2, "float", OP_WRITE),
+                    op_arg_dat(edgeFluxes, -1, OP_ID, 3, "float", OP_WRITE),
+                    op_arg_dat(maxEdgeEigenvalues, -1, OP_ID, 1, "float", OP_WRITE));
+      } else {
+        op_par_loop(computeFluxes_linear, "computeFluxes_linear", edges,
+                    op_arg_dat(data_in, 0, edgesToCells, 4, "float", OP_READ),
+                    op_arg_dat(data_in, 1, edgesToCells, 4, "float", OP_READ),
+                    op_arg_dat(edgeLength, -1, OP_ID, 1, "float", OP_READ),
+                    op_arg_dat(edgeNormals, -1, OP_ID, 2, "float", OP_READ),
+                    op_arg_dat(isBoundary, -1, OP_ID, 1, "int", OP_READ),
+                    op_arg_dat(bathySource, -1, OP_ID, 2, "float", OP_WRITE),
+                    op_arg_dat(edgeFluxes, -1, OP_ID, 3, "float", OP_WRITE),
+                    op_arg_dat(maxEdgeEigenvalues, -1, OP_ID, 1, "float", OP_WRITE),
+                    op_arg_dat(edgeSpeed, -1, OP_ID, 1, "float", OP_READ));
+      }
     }
 #ifdef DEBUG
     printf("maxFacetEigenvalues %g edgeLen %g cellVol %g\n", normcomp(maxEdgeEigenvalues, 0), normcomp(edgeLength, 0), normcomp(cellVolumes, 0));
 #endif
-    op_par_loop(NumericalFluxes, "NumericalFluxes", cells,
-                op_arg_dat(maxEdgeEigenvalues, -3, cellsToEdges, 1, "float", OP_READ),
-                op_arg_dat(edgeLength, -3, cellsToEdges, 1, "float", OP_READ),
-                op_arg_dat(cellVolumes, -1, OP_ID, 1, "float", OP_READ),
-                op_arg_dat(data_out, -1, OP_ID, 4, "float", OP_WRITE),
-                op_arg_gbl(minTimestep,1,"float", OP_MIN));
+    if (minTimestep != NULL) {
+      op_par_loop(NumericalFluxes, "NumericalFluxes", cells,
+                  op_arg_dat(maxEdgeEigenvalues, -3, cellsToEdges, 1, "float", OP_READ),
+                  op_arg_dat(edgeLength, -3, cellsToEdges, 1, "float", OP_READ),
+                  op_arg_dat(cellVolumes, -1, OP_ID, 1, "float", OP_READ),
+                  op_arg_dat(data_out, -1, OP_ID, 4, "float", OP_WRITE),
+                  op_arg_gbl(minTimestep,1,"float", OP_MIN));
+    } else if (most == 0) {
+      //Lagged time step: the stable steps of the cells are kept instead of reduced
+      op_par_loop(NumericalFluxes_lagged, "NumericalFluxes_lagged", cells,
+                  op_arg_dat(maxEdgeEigenvalues, -3, cellsToEdges, 1, "float", OP_READ),
+                  op_arg_dat(edgeLength, -3, cellsToEdges, 1, "float", OP_READ),
+                  op_arg_dat(cellVolumes, -1, OP_ID, 1, "float", OP_READ),
+                  op_arg_dat(data_out, -1, OP_ID, 4, "float", OP_WRITE),
+                  op_arg_dat(lagged->localDt, -1, OP_ID, 1, "float", OP_WRITE));
+    } else {
+      //and the second stage needs no time step at all
+      op_par_loop(zeroValues, "zeroValues", cells,
+                  op_arg_dat(data_out, -1, OP_ID, 4, "float", OP_WRITE));
+    }
 
     //end NumericalFluxes
     op_par_loop(SpaceDiscretization, "SpaceDiscretization", edges,
@@ -49,3 +130,258 @@ void spaceDiscretization(op_dat data_in, op_dat data_out, float *minTimestep,
                 op_arg_dat(cellVolumes, -2, edgesToCells, 1, "float", OP_READ));
   } //end SpaceDiscretization
 }
+
+/*
+ * Flag the deep water edges when the linearDepth= option is given. Has to
+ * be called once the Init events have set the bathymetry.
+ */
+void volna_linear_init(int argc, char **argv, op_set edges, op_map edgesToCells, op_dat isBoundary, op_dat values) {
+  const char *depth = volna_option(argc, argv, "linearDepth");
+  if (depth == NULL) return;
+  if (volna_ensemble_size()) {
+    op_printf("linearDepth is ignored in ensemble mode\n");
+    return;
+  }
+  if (volna_lts_enabled()) {
+    op_printf("linearDepth is ignored with local time stepping\n");
+    return;
+  }
+  linearDepth = atof(depth);
+  linearEdgesToCells = edgesToCells;
+  linearIsBoundary = isBoundary;
+  float *tmp_elem = NULL;
+  edgeSpeed = op_decl_dat_temp(edges, 1, "float", tmp_elem, "edgeSpeed");
+  volna_linear_update(values);
+  op_printf("Deep water flux on the edges deeper than %g\n", linearDepth);
+}
+
+/*
+ * Recompute the deep water edges after the bathymetry has been set again
+ */
+void volna_linear_update(op_dat values) {
+  if (edgeSpeed == NULL) return;
+  op_par_loop(initLinearEdges, "initLinearEdges", edgeSpeed->set,
+              op_arg_dat(values, 0, linearEdgesToCells, 4, "float", OP_READ),
+              op_arg_dat(values, 1, linearEdgesToCells, 4, "float", OP_READ),
+              op_arg_dat(linearIsBoundary, -1, OP_ID, 1, "int", OP_READ),
+              op_arg_gbl(&linearDepth, 1, "float", OP_READ),
+              op_arg_dat(edgeSpeed, -1, OP_ID, 1, "float", OP_WRITE));
+}
+
+int volna_linear_enabled() {
+  return edgeSpeed != NULL;
+}
+
+void volna_linear_close() {
+  if (edgeSpeed != NULL && op_free_dat_temp(edgeSpeed) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", edgeSpeed->name);
+  edgeSpeed = NULL;
+}
+
+void volna_lagged_init(int argc, char **argv, op_set cells, int supported) {
+  const char *every = volna_option(argc, argv, "dtLag");
+  if (every == NULL) return;
+#ifdef VOLNA_CUDA
+  supported = 0;
+#endif
+  if (!supported) {
+    op_printf("dtLag is ignored with CUDA, lts, ensembles, tiles, replay and deepHalo\n");
+    return;
+  }
+  lagged = new LaggedDt;
+  lagged->every = atoi(every);
+  if (lagged->every < 1) lagged->every = 1;
+  const char *safety = volna_option(argc, argv, "dtSafety");
+  lagged->safety = safety == NULL ? 0.9f : atof(safety);
+  if (lagged->safety <= 0.0f || lagged->safety > 1.0f) {
+    op_printf("dtSafety=%s: the safety factor has to be in (0,1]\n", safety);
+    exit(-1);
+  }
+  lagged->dT = 0.0f;
+  lagged->worst = INFINITY;
+  float *tmp_elem = NULL;
+  lagged->localDt = op_decl_dat_temp(cells, 1, "float", tmp_elem, "localDt");
+  lagged->validated = 1;
+  lagged->snapshot = op_decl_dat_temp(cells, 4, "float", tmp_elem, "laggedSnapshot");
+  op_printf("Lagged time step, reduced every %d steps with a safety factor of %g\n",
+            lagged->every, lagged->safety);
+}
+
+int volna_lagged_enabled() {
+  return lagged != NULL;
+}
+
+/*
+ * Whether the last step may still be rolled back by the next check, in
+ * which case it must not be checkpointed
+ */
+int volna_lagged_pending() {
+  return lagged != NULL && !lagged->validated;
+}
+
+/*
+ * Smallest stable step of the cells owned by this process
+ */
+static float lagged_local_min() {
+  float *localDt = (float *)lagged->localDt->data;
+  int n = lagged->localDt->set->size;
+  float local = INFINITY;
+#ifdef _OPENMP
+  #pragma omp parallel for reduction(min:local)
+#endif
+  for (int i = 0; i < n; i++)
+    local = localDt[i] < local ? localDt[i] : local;
+  return local;
+}
+
+/*
+ * EvolveValuesRK2 with the lagged step, the new values are left in
+ * values_new. Returns the step taken.
+ */
+float volna_lagged_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary, op_set cells, op_set edges,
+                        op_map edgesToCells, op_map cellsToEdges, float dtmax, float ftime,
+                        std::vector<TimerParams> *timers, std::vector<EventParams> *events) {
+  if (lagged->validated) {
+    op_par_loop(simulation_1, "simulation_1", cells,
+        op_arg_dat(lagged->snapshot, -1, OP_ID, 4, "float", OP_WRITE),
+        op_arg_dat(values, -1, OP_ID, 4, "float", OP_READ));
+    lagged->snapshotIter = itercount;
+    lagged->snapshotTime = timestamp;
+    save_events(&lagged->snapshotEvents);
+    lagged->validated = 0;
+  }
+  float dT = lagged->dT;
+  int check = dT <= 0.0f || itercount % lagged->every == 0 || timestamp + dT >= ftime ||
+              events_due_next(timers, dT);
+  int redone = 0;   // a check step recomputed with the reduced step
+  //{smallest stable step, smallest ratio to the step in the steps before the check}
+  float send[2], recv[2];
+  MPI_Request request = MPI_REQUEST_NULL;
+
+  for (;;) {
+    spaceDiscretization(values, midPointConservative, NULL,
+        bathySource, edgeFluxes, maxEdgeEigenvalues,
+        edgeNormals, edgeLength, cellVolumes, isBoundary,
+        cells, edges, edgesToCells, cellsToEdges, 0);
+    float local = lagged_local_min();
+
+    if (check) {
+      send[0] = local;
+      send[1] = lagged->worst;
+      if (volna_comm_size() == 1) {
+        recv[0] = send[0];
+        recv[1] = send[1];
+      } else {
+#if MPI_VERSION >= 3
+        //overlapped with the rest of the step, unless it gives the first step
+        MPI_Iallreduce(send, recv, 2, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD, &request);
+        if (dT <= 0.0f) MPI_Wait(&request, MPI_STATUS_IGNORE);
+#else
+        MPI_Allreduce(send, recv, 2, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+#endif
+      }
+      if (dT <= 0.0f) {
+        dT = CFL * recv[0];
+        dT = dT < dtmax ? dT : dtmax;
+      }
+    } else if (CFL * local / dT < lagged->worst) {
+      lagged->worst = CFL * local / dT;
+    }
+
+    op_par_loop(EvolveValuesRK2_1, "EvolveValuesRK2_1", cells,
+        op_arg_gbl(&dT,1,"float", OP_READ),
+        op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_RW),
+        op_arg_dat(values, -1, OP_ID, 4, "float", OP_READ),
+        op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_WRITE),
+        op_arg_dat(midPoint, -1, OP_ID, 4, "float", OP_WRITE));
+
+    spaceDiscretization(midPoint, outConservative, NULL,
+        bathySource, edgeFluxes, maxEdgeEigenvalues,
+        edgeNormals, edgeLength, cellVolumes, isBoundary,
+        cells, edges, edgesToCells, cellsToEdges, 1);
+
+    float bathyWeights[4];
+    op_dat bathyFrames = bathymetry_stream_interpolate(itercount + 2, bathyWeights);
+    if (bathyFrames == NULL) {
+      op_par_loop(EvolveValuesRK2_2, "EvolveValuesRK2_2", cells,
+          op_arg_gbl(&dT,1,"float", OP_READ),
+          op_arg_dat(outConservative, -1, OP_ID, 4, "float", OP_RW),
+          op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_WRITE));
+    } else {
+      op_par_loop(EvolveValuesRK2_2_bathy, "EvolveValuesRK2_2_bathy", cells,
+          op_arg_gbl(&dT,1,"float", OP_READ),
+          op_arg_dat(outConservative, -1, OP_ID, 4, "float", OP_RW),
+          op_arg_dat(inConservative, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_dat(midPointConservative, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_dat(values_new, -1, OP_ID, 4, "float", OP_WRITE),
+          op_arg_dat(bathyFrames, -1, OP_ID, 4, "float", OP_READ),
+          op_arg_gbl(bathyWeights,4,"float", OP_READ));
+    }
+
+    if (!check) {
+      lagged->validated = redone;
+      return dT;
+    }
+    if (request != MPI_REQUEST_NULL) {
+      VOLNA_TRACE_BEGIN(wait_t1);
+      MPI_Wait(&request, MPI_STATUS_IGNORE);
+      VOLNA_TRACE_END(wait_t1, "dtLag reduction", "mpi wait");
+    }
+
+    lagged->worst = INFINITY;
+    if (recv[1] < 1.0f) {
+      lagged->safety *= recv[1];
+      op_printf("Lagged time step: CFL condition violated by a factor %g before step %d, "
+                "redone from step %d with a safety factor of %g\n",
+                1.0f / recv[1], itercount, lagged->snapshotIter, lagged->safety);
+      //Back to the first step after the last accepted check, which is redone
+      //as a check with the stable step reduced on its values
+      op_par_loop(simulation_1, "simulation_1", cells,
+          op_arg_dat(values, -1, OP_ID, 4, "float", OP_WRITE),
+          op_arg_dat(lagged->snapshot, -1, OP_ID, 4, "float", OP_READ));
+      itercount = lagged->snapshotIter;
+      timestamp = lagged->snapshotTime;
+      restore_events(timers, events, &lagged->snapshotEvents);
+      dT = 0.0f;
+      continue;
+    }
+    float stable = CFL * recv[0];
+    lagged->dT = lagged->safety * stable;
+    lagged->dT = lagged->dT < dtmax ? lagged->dT : dtmax;
+    if (dT <= stable) {
+      lagged->validated = 1;
+      return dT;
+    }
+
+    //The step is too large, redone with the new one, which is stable
+    dT = lagged->dT;
+    check = 0;
+    redone = 1;
+  }
+}
+
+void volna_lagged_close() {
+  if (lagged == NULL) return;
+  if (op_free_dat_temp(lagged->localDt) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", lagged->localDt->name);
+  if (op_free_dat_temp(lagged->snapshot) < 0)
+    op_printf("Error: temporary op_dat %s cannot be removed\n", lagged->snapshot->name);
+  delete lagged;
+  lagged = NULL;
+}
+
+/*
+ * The native OpenMP loops only exist in the OpenMP build
+ */
+void volna_native_init(int argc, char **argv, op_dat values, op_dat out,
+                       op_dat bathySource, op_dat edgeFluxes, op_dat maxEdgeEigenvalues,
+                       op_dat edgeNormals, op_dat edgeLength, op_dat cellVolumes, op_dat isBoundary,
+                       op_set cells, op_set edges, op_map edgesToCells, op_map cellsToEdges) {
+  if (volna_option(argc, argv, "ompNative") != NULL || volna_option(argc, argv, "ompBenchmark") != NULL)
+    op_printf("ompNative and ompBenchmark need the OpenMP build with -DVOLNA_NATIVE_OMP\n");
+}
@@ -0,0 +1,154 @@
+#ifndef VOLNA_SPATIAL_H
+#define VOLNA_SPATIAL_H
+
+#include <math.h>
+#include <vector>
+
+/*
+ * Uniform grid over the bounding boxes of the triangular cells. Each bin
+ * stores the cells whose bounding box overlaps it, so locating the cell
+ * that contains a point only has to test the few cells of a single bin.
+ * Shared by volna2hdf5 and the solver (OutputLocation gauges).
+ */
+struct SpatialIndex {
+  float xmin, ymin;
+  float dx, dy;
+  int nx, ny;
+  std::vector<int> binStart; // CSR offsets into binCells, size nx*ny+1
+  std::vector<int> binCells;
+  const float *nodeCoords;
+  const int *cellsToNodes;
+};
+
+/*
+ * Returns 1 if (x,y) lies strictly inside the triangle ABC
+ */
+inline int pointInTriangle(float x, float y, const float *A, const float *B, const float *C) {
+  // First, check if the point is in the bounding box of the triangle
+  // vertices (else, the algorithm is not nearly robust enough)
+  float xmin = MIN(MIN(A[0], B[0]), C[0]);
+  float xmax = MAX(MAX(A[0], B[0]), C[0]);
+  float ymin = MIN(MIN(A[1], B[1]), C[1]);
+  float ymax = MAX(MAX(A[1], B[1]), C[1]);
+  if ( ( x < xmin ) || ( x > xmax ) || ( y < ymin ) || ( y > ymax ) )
+    return 0;
+
+  float insider = 1.0f;
+  float p[2] = {x, y};
+#define ORIENT2D(pA, pB, pC) ((pA[0] - pC[0]) * (pB[1] - pC[1]) - (pA[1] - pC[1]) * (pB[0] - pC[0]))
+  if ( ORIENT2D(A, B, C) > 0 ) {  // counter clockwise
+    insider =  ORIENT2D( A, p, C);
+    insider *= ORIENT2D( A, B, p);
+    insider *= ORIENT2D( B, C, p);
+  }
+  else {      // clockwise
+    insider =  ORIENT2D( A, p, B);
+    insider *= ORIENT2D( A, C, p);
+    insider *= ORIENT2D( C, B, p);
+  }
+#undef ORIENT2D
+  return insider > 0.0f;
+}
+
+inline void spatialIndexBin(const SpatialIndex *index, float x, float y, int *ix, int *iy) {
+  int i = (int)((x - index->xmin) / index->dx);
+  int j = (int)((y - index->ymin) / index->dy);
+  *ix = i < 0 ? 0 : (i >= index->nx ? index->nx-1 : i);
+  *iy = j < 0 ? 0 : (j >= index->ny ? index->ny-1 : j);
+}
+
+/*
+ * Build the index over ncell triangles. The grid has roughly one bin per
+ * cell, so every lookup tests O(1) cells on average.
+ */
+inline void buildSpatialIndex(SpatialIndex *index, const float *nodeCoords, const int *cellsToNodes, int ncell) {
+  index->nodeCoords = nodeCoords;
+  index->cellsToNodes = cellsToNodes;
+
+  float xmin = INFINITY, xmax = -INFINITY, ymin = INFINITY, ymax = -INFINITY;
+  for (int e = 0; e < ncell; e++) {
+    for (int k = 0; k < 3; k++) {
+      const float *p = &nodeCoords[2*cellsToNodes[3*e+k]];
+      xmin = MIN(xmin, p[0]); xmax = MAX(xmax, p[0]);
+      ymin = MIN(ymin, p[1]); ymax = MAX(ymax, p[1]);
+    }
+  }
+  float width  = MAX(xmax - xmin, 1e-6f);
+  float height = MAX(ymax - ymin, 1e-6f);
+  int nbins = MAX(ncell, 1);
+  index->nx = MAX(1, (int)sqrt((double)nbins * width / height));
+  index->ny = MAX(1, nbins / index->nx);
+  index->xmin = xmin;
+  index->ymin = ymin;
+  index->dx = width / index->nx;
+  index->dy = height / index->ny;
+
+  // Two passes: count the cells overlapping every bin, then fill
+  index->binStart.assign(index->nx*index->ny+1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    std::vector<int> fill;
+    if (pass == 1) {
+      for (int b = 0; b < index->nx*index->ny; b++)
+        index->binStart[b+1] += index->binStart[b];
+      index->binCells.resize(index->binStart[index->nx*index->ny]);
+      fill.assign(index->binStart.begin(), index->binStart.end()-1);
+    }
+    for (int e = 0; e < ncell; e++) {
+      const float *A = &nodeCoords[2*cellsToNodes[3*e  ]];
+      const float *B = &nodeCoords[2*cellsToNodes[3*e+1]];
+      const float *C = &nodeCoords[2*cellsToNodes[3*e+2]];
+      int i0, j0, i1, j1;
+      spatialIndexBin(index, MIN(MIN(A[0], B[0]), C[0]), MIN(MIN(A[1], B[1]), C[1]), &i0, &j0);
+      spatialIndexBin(index, MAX(MAX(A[0], B[0]), C[0]), MAX(MAX(A[1], B[1]), C[1]), &i1, &j1);
+      for (int j = j0; j <= j1; j++)
+        for (int i = i0; i <= i1; i++) {
+          if (pass == 0) index->binStart[j*index->nx+i+1]++;
+          else index->binCells[fill[j*index->nx+i]++] = e;
+        }
+    }
+  }
+}
+
+/*
+ * Returns the index of the cell containing (x,y), or -1 if the point is
+ * outside the mesh
+ */
+inline int locateCell(const SpatialIndex *index, float x, float y) {
+  if (x < index->xmin || y < index->ymin ||
+      x > index->xmin + index->nx*index->dx || y > index->ymin + index->ny*index->dy)
+    return -1;
+  int i, j;
+  spatialIndexBin(index, x, y, &i, &j);
+  int b = j*index->nx+i;
+  int found = -1;
+  for (int n = index->binStart[b]; n < index->binStart[b+1]; n++) {
+    int e = index->binCells[n];
+    if (pointInTriangle(x, y, &index->nodeCoords[2*index->cellsToNodes[3*e  ]],
+                              &index->nodeCoords[2*index->cellsToNodes[3*e+1]],
+                              &index->nodeCoords[2*index->cellsToNodes[3*e+2]]))
+      found = MAX(found, e); // same cell as the former full scan when on a shared vertex
+  }
+  return found;
+}
+
+/*
+ * Returns the index of the cell whose centre is closest to (x,y); used for
+ * points that fall outside the mesh
+ */
+inline int nearestCell(const SpatialIndex *index, float x, float y, int ncell) {
+  const float *n = index->nodeCoords;
+  const int *c = index->cellsToNodes;
+  float dmin = INFINITY;
+  int nearest = -1;
+  for (int e = 0; e < ncell; e++) {
+    float cx = (n[2*c[3*e]] + n[2*c[3*e+1]] + n[2*c[3*e+2]]) / 3.0f - x;
+    float cy = (n[2*c[3*e]+1] + n[2*c[3*e+1]+1] + n[2*c[3*e+2]+1]) / 3.0f - y;
+    if (cx*cx + cy*cy < dmin) {
+      dmin = cx*cx + cy*cy;
+      nearest = e;
+    }
+  }
+  return nearest;
+}
+
+#endif // VOLNA_SPATIAL_H
@@ -0,0 +1,309 @@
+#include "volna_common.h"
+#include "computeFluxes.h"
+#include "NumericalFluxes.h"
+#include "SpaceDiscretization.h"
+#include "EvolveValuesRK2_1.h"
+#include "EvolveValuesRK2_2.h"
+
+/*
+ * Sparse tiling of the RK2 step (tiles=cells per tile). The loops of the
+ * step form two chains, split by the minTimestep reduction that gives dT:
+ *   computeFluxes, NumericalFluxes, SpaceDiscretization
+ *   EvolveValuesRK2_1, computeFluxes, NumericalFluxes, SpaceDiscretization, EvolveValuesRK2_2
+ * The cells are cut into seed tiles of consecutive cells, and the inspector
+ * grows every tile through the loops of a chain so that an iteration runs
+ * in a tile no earlier than the tiles that produced its data (and no
+ * earlier than the tiles that read what it overwrites). Each tile then runs
+ * all loops of the chain on its own iterations while its cells and edges
+ * are in cache. Tiles touching a common cell or edge are ordered by their
+ * number, and the others run in parallel, level by level. The even seed
+ * tiles are numbered before the odd ones, so on a mesh numbered with some
+ * locality most tiles fall into two levels.
+ *
+ * The executor calls the kernels on the host arrays, so tiling is only
+ * used on one process in the seq and OpenMP builds, and not together with
+ * local time stepping, ensembles, linearDepth or bathyInterp.
+ */
+
+#define TILING_LOOPS 5
+
+//Accesses of a loop in the chain, to its own element and to the ones
+//through edgesToCells (edge loops) or cellsToEdges (cell loops)
+#define TILING_READ 1
+#define TILING_WRITE 2
+
+struct TilingLoop {
+  int onEdges;
+  int own, neighbours;
+};
+
+static const TilingLoop first_loops[] = {
+  {1, TILING_WRITE, TILING_READ},                      //computeFluxes
+  {0, TILING_WRITE, TILING_READ},                      //NumericalFluxes
+  {1, TILING_READ, TILING_READ | TILING_WRITE}};       //SpaceDiscretization
+static const TilingLoop second_loops[] = {
+  {0, TILING_READ | TILING_WRITE, 0},                  //EvolveValuesRK2_1
+  {1, TILING_WRITE, TILING_READ},                      //computeFluxes
+  {0, TILING_WRITE, TILING_READ},                      //NumericalFluxes
+  {1, TILING_READ, TILING_READ | TILING_WRITE},        //SpaceDiscretization
+  {0, TILING_READ | TILING_WRITE, 0}};                 //EvolveValuesRK2_2
+
+struct TiledChain {
+  int nloops, ntiles, nlevels;
+  int *levelOffs, *levelTiles;   // tiles of level l: levelTiles[levelOffs[l] .. levelOffs[l+1]-1]
+  int *offs[TILING_LOOPS];       // iterations of loop j in tile t: elems[j][offs[j][t] .. offs[j][t+1]-1]
+  int *elems[TILING_LOOPS];
+};
+
+struct Tiling {
+  int tileSize;
+  int ncells, nedges;
+  op_map edgesToCells, cellsToEdges;  // map->map is read at every use, numa=1 moves it
+  TiledChain first, second;
+};
+
+static Tiling *tiling = NULL;
+
+static int tile_need(int acc, int w, int r) {
+  int t = 0;
+  if ((acc & TILING_READ) && w > t) t = w;
+  if (acc & TILING_WRITE) {
+    if (w > t) t = w;
+    if (r > t) t = r;
+  }
+  return t;
+}
+
+static void tile_touch(int acc, int t, int *w, int *r) {
+  if ((acc & TILING_READ) && t > *r) *r = t;
+  if ((acc & TILING_WRITE) && t > *w) *w = t;
+}
+
+/*
+ * Grow the seed tiles of the cells through the loops of a chain, then
+ * order the tiles that touch common cells or edges into levels
+ */
+static void tiling_inspect(TiledChain *chain, const TilingLoop *loops, int nloops, const int *seed, int ntiles) {
+  int size[2] = {tiling->ncells, tiling->nedges};
+  int dim[2] = {3, 2};
+  int *map[2] = {tiling->cellsToEdges->map, tiling->edgesToCells->map};
+  int *lastW[2], *lastR[2];
+  for (int s = 0; s < 2; s++) {
+    lastW[s] = (int *)calloc(size[s], sizeof(int));
+    lastR[s] = (int *)calloc(size[s], sizeof(int));
+  }
+  memcpy(lastW[0], seed, size[0] * sizeof(int));
+
+  chain->nloops = nloops;
+  chain->ntiles = ntiles;
+  for (int j = 0; j < nloops; j++) {
+    int s = loops[j].onEdges, o = 1 - s, n = size[s];
+    int *tile = (int *)malloc(n * sizeof(int));
+    //tiles from the state before the loop, its iterations are independent
+    for (int i = 0; i < n; i++) {
+      int t = tile_need(loops[j].own, lastW[s][i], lastR[s][i]);
+      for (int k = 0; k < dim[s]; k++) {
+        int x = map[s][i * dim[s] + k];
+        int tn = tile_need(loops[j].neighbours, lastW[o][x], lastR[o][x]);
+        if (tn > t) t = tn;
+      }
+      tile[i] = t;
+    }
+    for (int i = 0; i < n; i++) {
+      tile_touch(loops[j].own, tile[i], &lastW[s][i], &lastR[s][i]);
+      for (int k = 0; k < dim[s]; k++) {
+        int x = map[s][i * dim[s] + k];
+        tile_touch(loops[j].neighbours, tile[i], &lastW[o][x], &lastR[o][x]);
+      }
+    }
+    chain->offs[j] = (int *)calloc(ntiles + 1, sizeof(int));
+    chain->elems[j] = (int *)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) chain->offs[j][tile[i] + 1]++;
+    for (int t = 0; t < ntiles; t++) chain->offs[j][t + 1] += chain->offs[j][t];
+    int *pos = (int *)malloc(ntiles * sizeof(int));
+    memcpy(pos, chain->offs[j], ntiles * sizeof(int));
+    for (int i = 0; i < n; i++) chain->elems[j][pos[tile[i]]++] = i;
+    free(pos);
+    free(tile);
+  }
+
+  //level of a tile: one more than the levels of the earlier tiles it shares a cell or edge with
+  int *level = (int *)malloc(ntiles * sizeof(int));
+  for (int s = 0; s < 2; s++)
+    for (int i = 0; i < size[s]; i++) lastW[s][i] = -1;
+  chain->nlevels = 0;
+  for (int t = 0; t < ntiles; t++) {
+    for (int pass = 0; pass < 2; pass++) {
+      int L = pass ? level[t] : 0;
+      for (int j = 0; j < nloops; j++) {
+        int s = loops[j].onEdges, o = 1 - s;
+        for (int p = chain->offs[j][t]; p < chain->offs[j][t + 1]; p++) {
+          int i = chain->elems[j][p];
+          for (int k = -1; k < dim[s]; k++) {
+            int *l = k < 0 ? &lastW[s][i] : &lastW[o][map[s][i * dim[s] + k]];
+            if (pass == 0 && *l + 1 > L) L = *l + 1;
+            if (pass == 1 && L > *l) *l = L;
+          }
+        }
+      }
+      level[t] = L;
+    }
+    if (level[t] + 1 > chain->nlevels) chain->nlevels = level[t] + 1;
+  }
+  chain->levelOffs = (int *)calloc(chain->nlevels + 1, sizeof(int));
+  chain->levelTiles = (int *)malloc(ntiles * sizeof(int));
+  for (int t = 0; t < ntiles; t++) chain->levelOffs[level[t] + 1]++;
+  for (int l = 0; l < chain->nlevels; l++) chain->levelOffs[l + 1] += chain->levelOffs[l];
+  int *pos = (int *)malloc(chain->nlevels * sizeof(int));
+  memcpy(pos, chain->levelOffs, chain->nlevels * sizeof(int));
+  for (int t = 0; t < ntiles; t++) chain->levelTiles[pos[level[t]]++] = t;
+  free(pos);
+  free(level);
+  for (int s = 0; s < 2; s++) {
+    free(lastW[s]);
+    free(lastR[s]);
+  }
+}
+
+void volna_tiling_init(int argc, char **argv, op_set cells, op_set edges, op_map edgesToCells,
+                       op_map cellsToEdges, int supported) {
+  const char *size = volna_option(argc, argv, "tiles");
+  if (size == NULL) return;
+#ifdef VOLNA_CUDA
+  supported = 0;
+#endif
+  if (!supported || volna_comm_size() > 1) {
+    op_printf("tiles is ignored with MPI, CUDA, lts, ensembles, linearDepth and bathyInterp\n");
+    return;
+  }
+  tiling = new Tiling;
+  tiling->tileSize = atoi(size) > 0 ? atoi(size) : 1;
+  tiling->ncells = cells->size;
+  tiling->nedges = edges->size;
+  tiling->edgesToCells = edgesToCells;
+  tiling->cellsToEdges = cellsToEdges;
+
+  //seed tiles of consecutive cells, the even ones first
+  int nblocks = (tiling->ncells + tiling->tileSize - 1) / tiling->tileSize;
+  int neven = (nblocks + 1) / 2;
+  int *seed = (int *)malloc(tiling->ncells * sizeof(int));
+  for (int c = 0; c < tiling->ncells; c++) {
+    int b = c / tiling->tileSize;
+    seed[c] = b % 2 == 0 ? b / 2 : neven + b / 2;
+  }
+  tiling_inspect(&tiling->first, first_loops, 3, seed, nblocks);
+  tiling_inspect(&tiling->second, second_loops, 5, seed, nblocks);
+  free(seed);
+  op_printf("Sparse tiling: %d tiles of %d cells, run in %d and %d levels\n",
+            nblocks, tiling->tileSize, tiling->first.nlevels, tiling->second.nlevels);
+}
+
+int volna_tiling_enabled() {
+  return tiling != NULL;
+}
+
+static void tile_fluxes(TiledChain *chain, int j, int t, float *in, float *edgeLength, float *edgeNormals,
+                        int *isBoundary, float *bathySource, float *edgeFluxes, float *maxEdgeEigenvalues) {
+  int *e2c = tiling->edgesToCells->map;
+  for (int p = chain->offs[j][t]; p < chain->offs[j][t + 1]; p++) {
+    int e = chain->elems[j][p];
+    computeFluxes(in + 4 * e2c[2 * e], in + 4 * e2c[2 * e + 1], edgeLength + e, edgeNormals + 2 * e,
+                  isBoundary + e, bathySource + 2 * e, edgeFluxes + 3 * e, maxEdgeEigenvalues + e);
+  }
+}
+
+static void tile_numerical_fluxes(TiledChain *chain, int j, int t, float *maxEdgeEigenvalues,
+                                  float *edgeLength, float *cellVolumes, float *out, float *minTimestep) {
+  int *c2e = tiling->cellsToEdges->map;
+  for (int p = chain->offs[j][t]; p < chain->offs[j][t + 1]; p++) {
+    int c = chain->elems[j][p];
+    float *eigenvalues[3] = {maxEdgeEigenvalues + c2e[3 * c], maxEdgeEigenvalues + c2e[3 * c + 1],
+                             maxEdgeEigenvalues + c2e[3 * c + 2]};
+    float *lengths[3] = {edgeLength + c2e[3 * c], edgeLength + c2e[3 * c + 1], edgeLength + c2e[3 * c + 2]};
+    NumericalFluxes(eigenvalues, lengths, cellVolumes + c, out + 4 * c, minTimestep);
+  }
+}
+
+static void tile_space_discretization(TiledChain *chain, int j, int t, float *out, float *edgeFluxes,
+                                      float *bathySource, float *edgeNormals, int *isBoundary,
+                                      float *cellVolumes) {
+  int *e2c = tiling->edgesToCells->map;
+  for (int p = chain->offs[j][t]; p < chain->offs[j][t + 1]; p++) {
+    int e = chain->elems[j][p];
+    float *volumes[2] = {cellVolumes + e2c[2 * e], cellVolumes + e2c[2 * e + 1]};
+    SpaceDiscretization(out + 4 * e2c[2 * e], out + 4 * e2c[2 * e + 1], edgeFluxes + 3 * e,
+                        bathySource + 2 * e, edgeNormals + 2 * e, isBoundary + e, volumes);
+  }
+}
+
+/*
+ * One RK2 step by tiles, the new values are left in values_new like the
+ * untiled step. Returns dT
+ */
+float volna_tiling_step(op_dat values, op_dat values_new, op_dat midPointConservative, op_dat inConservative,
+                        op_dat outConservative, op_dat midPoint, op_dat bathySource, op_dat edgeFluxes,
+                        op_dat maxEdgeEigenvalues, op_dat edgeNormals, op_dat edgeLength,
+                        op_dat cellVolumes, op_dat isBoundary) {
+  float *v = (float *)values->data, *vNew = (float *)values_new->data;
+  float *midCons = (float *)midPointConservative->data, *inCons = (float *)inConservative->data;
+  float *outCons = (float *)outConservative->data, *mid = (float *)midPoint->data;
+  float *bathy = (float *)bathySource->data, *fluxes = (float *)edgeFluxes->data;
+  float *eig = (float *)maxEdgeEigenvalues->data, *normals = (float *)edgeNormals->data;
+  float *len = (float *)edgeLength->data, *vol = (float *)cellVolumes->data;
+  int *bnd = (int *)isBoundary->data;
+
+  TiledChain *chain = &tiling->first;
+  float minTimestep = INFINITY;
+  for (int l = 0; l < chain->nlevels; l++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(min:minTimestep)
+#endif
+    for (int k = chain->levelOffs[l]; k < chain->levelOffs[l + 1]; k++) {
+      int t = chain->levelTiles[k];
+      tile_fluxes(chain, 0, t, v, len, normals, bnd, bathy, fluxes, eig);
+      tile_numerical_fluxes(chain, 1, t, eig, len, vol, midCons, &minTimestep);
+      tile_space_discretization(chain, 2, t, midCons, fluxes, bathy, normals, bnd, vol);
+    }
+  }
+
+  float dT = CFL * minTimestep;
+  chain = &tiling->second;
+  for (int l = 0; l < chain->nlevels; l++) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int k = chain->levelOffs[l]; k < chain->levelOffs[l + 1]; k++) {
+      int t = chain->levelTiles[k];
+      float dummy = INFINITY;
+      for (int p = chain->offs[0][t]; p < chain->offs[0][t + 1]; p++) {
+        int c = chain->elems[0][p];
+        EvolveValuesRK2_1(&dT, midCons + 4 * c, v + 4 * c, inCons + 4 * c, mid + 4 * c);
+      }
+      tile_fluxes(chain, 1, t, mid, len, normals, bnd, bathy, fluxes, eig);
+      tile_numerical_fluxes(chain, 2, t, eig, len, vol, outCons, &dummy);
+      tile_space_discretization(chain, 3, t, outCons, fluxes, bathy, normals, bnd, vol);
+      for (int p = chain->offs[4][t]; p < chain->offs[4][t + 1]; p++) {
+        int c = chain->elems[4][p];
+        EvolveValuesRK2_2(&dT, outCons + 4 * c, inCons + 4 * c, midCons + 4 * c, vNew + 4 * c);
+      }
+    }
+  }
+  return dT;
+}
+
+static void tiling_free_chain(TiledChain *chain) {
+  for (int j = 0; j < chain->nloops; j++) {
+    free(chain->offs[j]);
+    free(chain->elems[j]);
+  }
+  free(chain->levelOffs);
+  free(chain->levelTiles);
+}
+
+void volna_tiling_close() {
+  if (tiling == NULL) return;
+  tiling_free_chain(&tiling->first);
+  tiling_free_chain(&tiling->second);
+  delete tiling;
+  tiling = NULL;
+}
@@ -0,0 +1,172 @@
+#include "volna_common.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#include <pthread.h>
+
+/*
+ * Timeline tracing (built with -DVOLNA_TRACE, trace=filename at run time).
+ * The OP2 loops of the generated stubs, the start of their halo exchanges
+ * and the wait for them, the time steps, the events, the dtLag reduction
+ * and the HDF5 reads and writes of the bathymetry stream and the
+ * checkpoints are recorded with their begin and end times. Every thread
+ * appends to its own buffer, reached through a thread-local pointer, so
+ * recording takes no lock; a thread gets its slot the first time it
+ * records, and gives it back when it exits, so the short-lived threads
+ * (one checkpoint writer per checkpoint) take turns on the same track
+ * instead of using up the slots. The buffers grow by chunks and are only
+ * read at the end, when the other threads have been joined.
+ *
+ * volna_trace_close writes them as a Chrome trace (chrome://tracing or
+ * ui.perfetto.dev) with a process per MPI rank and a track per thread; the
+ * processes append to the file in turn, so it has to be on a file system
+ * shared by all of them.
+ */
+
+#ifdef VOLNA_TRACE
+
+#define TRACE_FIRST_CHUNK 1024
+#define TRACE_MAX_CHUNK 65536
+#define TRACE_THREADS 4096
+
+struct TraceEvent {
+  const char *name, *cat;
+  double begin, end;
+};
+
+struct TraceBuffer {
+  std::vector<TraceEvent *> chunks;
+  std::vector<int> used;         // events in every chunk
+  int capacity;                  // of the last chunk
+};
+
+static int traceEnabled = 0;
+static std::string traceFile;
+static double traceStart;
+static TraceBuffer *traceBuffers[TRACE_THREADS];
+static int traceThreads = 0;
+static int traceDropped = 0;    // events of the threads beyond TRACE_THREADS
+static TraceBuffer traceOverflow;
+static __thread TraceBuffer *traceLocal = NULL;
+static std::vector<TraceBuffer *> traceFree;  // slots of the threads that have exited
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t traceKey;                 // gives the slot back when its thread exits
+
+static TraceBuffer *trace_buffer() {
+  TraceBuffer *b = &traceOverflow;
+  pthread_mutex_lock(&traceMutex);
+  if (!traceFree.empty()) {
+    b = traceFree.back();
+    traceFree.pop_back();
+  } else if (traceThreads < TRACE_THREADS) {
+    b = new TraceBuffer;
+    b->capacity = 0;
+    traceBuffers[traceThreads++] = b;
+  }
+  pthread_mutex_unlock(&traceMutex);
+  if (b != &traceOverflow) pthread_setspecific(traceKey, b);
+  return b;
+}
+
+static void trace_thread_exit(void *buffer) {
+  pthread_mutex_lock(&traceMutex);
+  traceFree.push_back((TraceBuffer *)buffer);
+  pthread_mutex_unlock(&traceMutex);
+}
+
+double volna_trace_time() {
+  if (!traceEnabled) return 0.0;
+  double cpu, wall;
+  op_timers_core(&cpu, &wall);
+  return wall;
+}
+
+void volna_trace_event(const char *name, const char *cat, double begin, double end) {
+  //loops over an empty set have no start time
+  if (!traceEnabled || begin <= 0.0) return;
+  TraceBuffer *b = traceLocal;
+  if (b == NULL) b = traceLocal = trace_buffer();
+  if (b == &traceOverflow) {
+    __sync_fetch_and_add(&traceDropped, 1);
+    return;
+  }
+  if (b->chunks.empty() || b->used.back() == b->capacity) {
+    b->capacity = b->chunks.empty() ? TRACE_FIRST_CHUNK : MIN(2 * b->capacity, TRACE_MAX_CHUNK);
+    b->chunks.push_back((TraceEvent *)malloc(b->capacity * sizeof(TraceEvent)));
+    b->used.push_back(0);
+  }
+  TraceEvent *e = &b->chunks.back()[b->used.back()++];
+  e->name = name;
+  e->cat = cat;
+  e->begin = begin;
+  e->end = end;
+}
+
+#endif
+
+void volna_trace_init(int argc, char **argv) {
+  const char *filename = volna_option(argc, argv, "trace");
+  if (filename == NULL) return;
+#ifdef VOLNA_TRACE
+  traceFile = filename;
+  if (volna_comm_size() > 1) MPI_Barrier(MPI_COMM_WORLD);
+  double cpu;
+  op_timers_core(&cpu, &traceStart);
+  pthread_key_create(&traceKey, trace_thread_exit);
+  //the main thread is the first track
+  traceLocal = trace_buffer();
+  traceEnabled = 1;
+  op_printf("Tracing loops, events and I/O to %s\n", filename);
+#else
+  op_printf("trace=%s needs a build with -DVOLNA_TRACE (TRACEFLAGS in the Makefile)\n", filename);
+#endif
+}
+
+/*
+ * Writes the trace, once the helper threads have been joined
+ */
+void volna_trace_close() {
+#ifdef VOLNA_TRACE
+  if (!traceEnabled) return;
+  traceEnabled = 0;
+  int rank = 0, size = volna_comm_size(), token = 0;
+  if (size > 1) {
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank > 0) MPI_Recv(&token, 1, MPI_INT, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+  long events = 0;
+  int threads = traceThreads;
+  FILE *f = fopen(traceFile.c_str(), rank == 0 ? "w" : "a");
+  if (f == NULL) {
+    printf("trace: cannot write %s on rank %d\n", traceFile.c_str(), rank);
+  } else {
+    if (rank == 0) fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    else fprintf(f, ",\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+            rank, rank);
+    for (int t = 0; t < threads; t++) {
+      TraceBuffer *b = traceBuffers[t];
+      fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+              rank, t, t == 0 ? "main" : "thread", t);
+      for (unsigned int c = 0; c < b->chunks.size(); c++) {
+        for (int i = 0; i < b->used[c]; i++) {
+          TraceEvent *e = &b->chunks[c][i];
+          fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                  "\"ts\": %.3f, \"dur\": %.3f}", e->name, e->cat, rank, t,
+                  (e->begin - traceStart) * 1e6, (e->end - e->begin) * 1e6);
+        }
+        events += b->used[c];
+        free(b->chunks[c]);
+      }
+      delete b;
+    }
+    if (rank == size - 1) fprintf(f, "\n]}\n");
+    fclose(f);
+  }
+  if (rank < size - 1) MPI_Send(&token, 1, MPI_INT, rank + 1, 0, MPI_COMM_WORLD);
+  long total[2] = {events, traceDropped};
+  if (size > 1) MPI_Allreduce(MPI_IN_PLACE, total, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  op_printf("Trace of %ld events written to %s", total[0], traceFile.c_str());
+  if (total[1] > 0) op_printf(", %ld events of threads beyond %d running at once dropped", total[1], TRACE_THREADS);
+  op_printf("\n");
+#endif
+}
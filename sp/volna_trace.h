@@ -0,0 +1,20 @@
+#ifndef VOLNA_TRACE_H
+#define VOLNA_TRACE_H
+
+// Timeline tracing of the loops, halo exchanges, events and I/O, compiled
+// in with -DVOLNA_TRACE and enabled with trace=filename. Without
+// VOLNA_TRACE the macros are empty. Times come from op_timers_core, name
+// and cat have to outlive the run (string literals, loop names).
+#ifdef VOLNA_TRACE
+double volna_trace_time();
+void volna_trace_event(const char *name, const char *cat, double begin, double end);
+#define VOLNA_TRACE_BEGIN(t) double t = volna_trace_time()
+#define VOLNA_TRACE_END(t, name, cat) volna_trace_event(name, cat, t, volna_trace_time())
+#define VOLNA_TRACE_SPAN(name, cat, begin, end) volna_trace_event(name, cat, begin, end)
+#else
+#define VOLNA_TRACE_BEGIN(t)
+#define VOLNA_TRACE_END(t, name, cat)
+#define VOLNA_TRACE_SPAN(name, cat, begin, end)
+#endif
+
+#endif
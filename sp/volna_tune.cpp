@@ -0,0 +1,193 @@
+#include "volna_common.h"
+#include "volna_tune.h"
+#include "op_lib_cpp.h"
+#include <mpi.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Autotuner of the OpenMP loops of the RK2 step (ompTune=filename). The
+ * indirect loops (computeFluxes, NumericalFluxes, SpaceDiscretization) are
+ * timed with every part size of 64 to 2048 and 1, 1/2 and 1/4 of the
+ * threads, the direct ones (EvolveValuesRK2_1/2, simulation_1) with the
+ * thread counts only, TUNE_SAMPLES calls each after one warm-up call, as
+ * they come in the first steps. The fastest setting of every loop is kept
+ * in the cache file under the host name, the number of threads and of
+ * processes and the number of cells, and later runs with the same key
+ * use it directly. With MPI every process tunes its own loops and rank 0
+ * writes the file.
+ */
+
+#define TUNE_SAMPLES 5
+static const int tunePartSizes[] = {64, 128, 256, 512, 1024, 2048};
+#define TUNE_PARTS (int)(sizeof(tunePartSizes) / sizeof(tunePartSizes[0]))
+
+struct TunedLoop {
+  std::string name;
+  int started;                // seen once
+  int indirect;
+  int done;                   // best setting found or read from the cache
+  int candidate, calls;       // setting being timed and its calls so far
+  double time;
+  int partSize, threads;      // setting in use
+  int bestPart, bestThreads;
+  double bestTime;
+};
+
+struct Tune {
+  std::string filename;
+  std::string key;            // host threads processes cells
+  int threadCounts[3], nthreadCounts;
+  std::vector<TunedLoop> loops;
+  std::vector<std::string> cached;  // lines of the cache file
+};
+
+static Tune *tune = NULL;
+
+void volna_tune_init(int argc, char **argv, op_set cells) {
+  const char *filename = volna_option(argc, argv, "ompTune");
+  if (filename == NULL) return;
+#ifdef _OPENMP
+  tune = new Tune;
+  tune->filename = filename;
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+  int ncell = cells->size;
+  if (volna_comm_size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &ncell, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  int maxThreads = omp_get_max_threads();
+  char key[512];
+  sprintf(key, "%s %d %d %d", host, maxThreads, volna_comm_size(), ncell);
+  tune->key = key;
+  tune->nthreadCounts = 0;
+  for (int t = maxThreads; t >= 1 && tune->nthreadCounts < 3 && t >= maxThreads / 4; t /= 2)
+    tune->threadCounts[tune->nthreadCounts++] = t;
+
+  FILE *f = fopen(filename, "r");
+  int found = 0;
+  if (f != NULL) {
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+      tune->cached.push_back(line);
+      found += !strncmp(line, key, strlen(key)) && line[strlen(key)] == ' ';
+    }
+    fclose(f);
+  }
+  op_printf("ompTune: %d loops tuned in %s for this machine and mesh, the others are tuned in the first steps\n",
+            found, filename);
+#else
+  op_printf("ompTune is ignored without OpenMP\n");
+#endif
+}
+
+#ifdef _OPENMP
+static int candidates(TunedLoop &l) {
+  return (l.indirect ? TUNE_PARTS : 1) * tune->nthreadCounts;
+}
+
+static void set_candidate(TunedLoop &l) {
+  l.partSize = l.indirect ? tunePartSizes[l.candidate / tune->nthreadCounts] : 0;
+  l.threads = tune->threadCounts[l.candidate % tune->nthreadCounts];
+}
+
+/*
+ * Setting of loop name in the cache file, returns 0 if there is none
+ */
+static int read_cached(TunedLoop &l) {
+  for (unsigned int i = 0; i < tune->cached.size(); i++) {
+    const char *line = tune->cached[i].c_str();
+    size_t n = tune->key.size();
+    if (strncmp(line, tune->key.c_str(), n) || line[n] != ' ') continue;
+    char name[256];
+    int partSize, threads;
+    if (sscanf(line + n, "%255s %d %d", name, &partSize, &threads) == 3 && l.name == name) {
+      l.partSize = partSize;
+      l.threads = threads;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void write_cache(TunedLoop &l) {
+  char line[1024];
+  sprintf(line, "%s %s %d %d %g\n", tune->key.c_str(), l.name.c_str(), l.partSize, l.threads, l.bestTime);
+  tune->cached.push_back(line);
+  int rank = 0;
+  if (volna_comm_size() > 1) MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank != 0) return;
+  FILE *f = fopen(tune->filename.c_str(), "w");
+  if (f == NULL) {
+    op_printf("ompTune: can't write %s\n", tune->filename.c_str());
+    return;
+  }
+  for (unsigned int i = 0; i < tune->cached.size(); i++) fputs(tune->cached[i].c_str(), f);
+  fclose(f);
+}
+#endif
+
+/*
+ * Number of threads for a call of loop kernel, and its part size
+ */
+int volna_tune_begin(const char *name, int kernel, int *part_size) {
+#ifdef _OPENMP
+  if (tune == NULL) return omp_get_max_threads();
+  if ((int)tune->loops.size() <= kernel) tune->loops.resize(kernel + 1);
+  TunedLoop &l = tune->loops[kernel];
+  if (!l.started) {
+    l.started = 1;
+    l.name = name;
+    l.indirect = part_size != NULL;
+    l.done = read_cached(l);
+    l.candidate = 0;
+    l.calls = 0;
+    l.time = 0.0;
+    l.bestTime = INFINITY;
+    if (!l.done) set_candidate(l);
+  }
+  if (part_size != NULL && l.partSize > 0) *part_size = l.partSize;
+  return l.threads;
+#else
+  return 1;
+#endif
+}
+
+void volna_tune_end(int kernel, double time) {
+#ifdef _OPENMP
+  if (tune == NULL || (int)tune->loops.size() <= kernel) return;
+  TunedLoop &l = tune->loops[kernel];
+  if (!l.started || l.done) return;
+  if (l.calls++ > 0) l.time += time;
+  if (l.calls <= TUNE_SAMPLES) return;
+  if (l.time < l.bestTime) {
+    l.bestTime = l.time;
+    l.bestPart = l.partSize;
+    l.bestThreads = l.threads;
+  }
+  l.calls = 0;
+  l.time = 0.0;
+  if (++l.candidate < candidates(l)) {
+    set_candidate(l);
+    return;
+  }
+  l.done = 1;
+  l.partSize = l.bestPart;
+  l.threads = l.bestThreads;
+  l.bestTime /= TUNE_SAMPLES;
+  if (l.indirect)
+    op_printf("ompTune: %s with part size %d and %d threads, %g s per call\n", l.name.c_str(), l.partSize,
+              l.threads, l.bestTime);
+  else
+    op_printf("ompTune: %s with %d threads, %g s per call\n", l.name.c_str(), l.threads, l.bestTime);
+  write_cache(l);
+#endif
+}
+
+void volna_tune_close() {
+  if (tune == NULL) return;
+  delete tune;
+  tune = NULL;
+}
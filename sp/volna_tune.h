@@ -0,0 +1,10 @@
+#ifndef VOLNA_TUNE_H
+#define VOLNA_TUNE_H
+
+// The OpenMP stubs of the loops of the RK2 step take their part size and
+// number of threads from the autotuner (ompTune=filename); part_size is
+// NULL for the direct loops
+int volna_tune_begin(const char *name, int kernel, int *part_size);
+void volna_tune_end(int kernel, double time);
+
+#endif
@@ -0,0 +1,8 @@
+//Zero the increments of the second RK2 stage, which needs no time step
+inline void zeroValues(float *out) //OP_WRITE
+{
+  out[0] = 0.0f;
+  out[1] = 0.0f;
+  out[2] = 0.0f;
+  out[3] = 0.0f;
+}
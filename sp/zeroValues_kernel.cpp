@@ -0,0 +1,92 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+// user function
+
+#include "zeroValues.h"
+
+
+// x86 kernel function
+
+void op_x86_zeroValues(
+  float *arg0,
+  int   start,
+  int   finish ) {
+
+
+  // process set elements
+
+  for (int n=start; n<finish; n++) {
+
+    // user-supplied kernel call
+
+
+    zeroValues(  arg0+n*4 );
+  }
+}
+
+
+// host stub function
+
+void op_par_loop_zeroValues(char const *name, op_set set,
+  op_arg arg0 ){
+
+
+  int    nargs   = 1;
+  op_arg args[1];
+
+  args[0] = arg0;
+
+  if (OP_diags>2) {
+    printf(" kernel routine w/o indirection:  zeroValues\n");
+  }
+
+  VOLNA_TRACE_BEGIN(halo_t1);
+  op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
+
+  // initialise timers
+
+  double cpu_t1, cpu_t2, wall_t1=0, wall_t2=0;
+  op_timing_realloc(40);
+  OP_kernels[40].name      = name;
+  OP_kernels[40].count    += 1;
+
+  // set number of threads
+
+#ifdef _OPENMP
+  int nthreads = omp_get_max_threads( );
+#else
+  int nthreads = 1;
+#endif
+
+  if (set->size >0) {
+
+    op_timers_core(&cpu_t1, &wall_t1);
+
+  // execute plan
+
+#pragma omp parallel for
+  for (int thr=0; thr<nthreads; thr++) {
+    int start  = (set->size* thr   )/nthreads;
+    int finish = (set->size*(thr+1))/nthreads;
+    op_x86_zeroValues( (float *) arg0.data,
+                       start, finish );
+  }
+
+  }
+
+
+  // combine reduction data
+
+  op_mpi_set_dirtybit(nargs, args);
+
+  // update kernel record
+
+  op_timers_core(&cpu_t2, &wall_t2);
+  OP_kernels[40].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  OP_kernels[40].transfer += (float)set->size * arg0.size;
+}
+
@@ -0,0 +1,124 @@
+//
+// auto-generated by op2.m on 12-Nov-2012 12:05:08
+//
+
+// user function
+
+__device__
+#include "zeroValues.h"
+
+
+// CUDA kernel function
+
+__global__ void op_cuda_zeroValues(
+  float *arg0,
+  int   offset_s,
+  int   set_size ) {
+
+  float arg0_l[4];
+  int   tid = threadIdx.x%OP_WARPSIZE;
+
+  extern __shared__ char shared[];
+
+  char *arg_s = shared + offset_s*(threadIdx.x/OP_WARPSIZE);
+
+  // process set elements
+
+  for (int n=threadIdx.x+blockIdx.x*blockDim.x;
+       n<set_size; n+=blockDim.x*gridDim.x) {
+
+    int offset = n - tid;
+    int nelems = MIN(OP_WARPSIZE,set_size-offset);
+
+    // copy data into shared memory, then into local
+
+
+    // user-supplied kernel call
+
+
+    zeroValues(  arg0_l );
+
+    // copy back into shared memory, then to device
+
+    for (int m=0; m<4; m++)
+      ((float *)arg_s)[m+tid*4] = arg0_l[m];
+
+    for (int m=0; m<4; m++)
+      arg0[tid+m*nelems+offset*4] = ((float *)arg_s)[tid+m*nelems];
+
+  }
+}
+
+
+// host stub function
+
+void op_par_loop_zeroValues(char const *name, op_set set,
+  op_arg arg0 ){
+
+
+  int    nargs   = 1;
+  op_arg args[1];
+
+  args[0] = arg0;
+
+  if (OP_diags>2) {
+    printf(" kernel routine w/o indirection:  zeroValues\n");
+  }
+
+  VOLNA_TRACE_BEGIN(halo_t1);
+  op_mpi_halo_exchanges(set, nargs, args);
+  VOLNA_TRACE_END(halo_t1, name, "halo");
+
+  // initialise timers
+
+  double cpu_t1, cpu_t2, wall_t1=0, wall_t2=0;
+  op_timing_realloc(40);
+  OP_kernels[40].name      = name;
+  OP_kernels[40].count    += 1;
+
+  if (set->size >0) {
+
+    op_timers_core(&cpu_t1, &wall_t1);
+
+    // set CUDA execution parameters
+
+    #ifdef OP_BLOCK_SIZE_40
+      int nthread = OP_BLOCK_SIZE_40;
+    #else
+      // int nthread = OP_block_size;
+      int nthread = 128;
+    #endif
+
+    int nblocks = 200;
+
+    // work out shared memory requirements per element
+
+    int nshared = 0;
+    nshared = MAX(nshared,sizeof(float)*4);
+
+    // execute plan
+
+    int offset_s = nshared*OP_WARPSIZE;
+
+    nshared = nshared*nthread;
+
+    op_cuda_zeroValues<<<nblocks,nthread,nshared>>>( (float *) arg0.data_d,
+                                                     offset_s,
+                                                     set->size );
+
+    cutilSafeCall(cudaThreadSynchronize());
+    cutilCheckMsg("op_cuda_zeroValues execution failed\n");
+
+  }
+
+
+  op_mpi_set_dirtybit(nargs, args);
+
+  // update kernel record
+
+  op_timers_core(&cpu_t2, &wall_t2);
+  OP_kernels[40].time     += wall_t2 - wall_t1;
+  VOLNA_TRACE_SPAN(name, "loop", wall_t1, wall_t2);
+  OP_kernels[40].transfer += (float)set->size * arg0.size;
+}
+
@@ -693,6 +693,54 @@ std::vector<double> const make_arg_list(stack::iterator const & begin,
   
   
 
+  std::string postfix(stack const & stk)
+  {
+    ostringstream ss;
+    ss.precision(9);
+    bool returned = false;
+    stack::const_iterator it = stk.begin();
+    for (; it != stk.end(); ++it) {
+      if (returned)
+        return string();
+      if (dynamic_cast<print_node const *>(&*it)) {
+        returned = true;
+        continue;
+      }
+      if (number_node const * nn = dynamic_cast<number_node const *>(&*it)) {
+        // variables left in the stack are globals such as pi
+        ss << nn->value() << ' ';
+        continue;
+      }
+      if (sys_function_node const * f =
+          dynamic_cast<sys_function_node const *>(&*it)) {
+        function & func = const_cast<function &>(f->func());
+        if (func.as_user_function())
+          return string();
+        string name = func.name();
+        if (!name.empty() && name[name.size()-1] == '#')
+          name.erase(name.size()-1);
+        ss << name << ' ';
+        continue;
+      }
+      if (dynamic_cast<x_node const *>(&*it)) {
+        ss << "x ";
+        continue;
+      }
+      if (dynamic_cast<y_node const *>(&*it)) {
+        ss << "y ";
+        continue;
+      }
+      if (dynamic_cast<t_node const *>(&*it)) {
+        ss << "t ";
+        continue;
+      }
+      // branches, assignments and function definitions
+      return string();
+    }
+    return returned ? ss.str() : string();
+  }
+
+
   std::vector<RealType> vectorizedEval(stack stk, 
 				       std::vector<RealType> &X,
 				       std::vector<RealType> &Y, 
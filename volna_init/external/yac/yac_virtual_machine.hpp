@@ -101,6 +101,11 @@ struct virtual_machine
 std::string const name_mangler( std::string const & name,
 				std::size_t const arity );
 
+  // Postfix form of stk ("x y multiply 2 add ..."), that the Volna solver
+  // compiles at run time. Empty if stk uses anything but numbers, x, y, t
+  // and the built-in functions, with a single return at the end.
+  std::string postfix( stack const & stk );
+
 
 //////////////////////////////////
 struct user_function;
@@ -294,6 +294,26 @@ public:
 	    return std::vector<RealType> ( x_vector.size(), 0.0 );
         }
     }
+
+  // Postfix program of a formula, stored by volna2hdf5 for the solver to
+  // compile at run time; empty if it can not be expressed (see yac::postfix)
+    template <typename ItT>
+    std::string compile( ItT first, ItT last )
+  {
+        using phoenix::arg1;
+        using phoenix::var;
+
+        typedef spirit::parse_info<ItT> parse_info_t;
+
+        stack stk;
+        gnuplot_grammar calculator(vm.funcs, vm.global_vars);
+
+        parse_info_t info = spirit::parse(first, last,
+                                          calculator[var(stk) = arg1],
+                                          skip_grammar());
+
+        return info.full ? postfix(stk) : std::string();
+    }
 };
 
 } // namespace yac